@@ -0,0 +1,1123 @@
+//> Optimization omit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "common.h"
+#include "memory.h"
+#include "vm.h"
+
+typedef struct {
+  Token current;
+  Token previous;
+  bool hadError;
+  bool panicMode;
+  // Set while checking a function for the single-pass compiler, which
+  // reports any errors itself. See preparseFunction().
+  bool preparsing;
+  int tokenCount;
+  bool usesSuper;
+} TreeParser;
+
+typedef enum {
+  PREC_NONE,
+  PREC_ASSIGNMENT,  // =
+  PREC_OR,          // or
+  PREC_AND,         // and
+  PREC_EQUALITY,    // == !=
+  PREC_COMPARISON,  // < > <= >=
+  PREC_TERM,        // + -
+  PREC_FACTOR,      // * /
+  PREC_UNARY,       // ! -
+  PREC_CALL,        // . ()
+  PREC_PRIMARY
+} Precedence;
+
+typedef Node* (*PrefixFn)(bool canAssign);
+typedef Node* (*InfixFn)(Node* left, bool canAssign);
+
+typedef struct {
+  PrefixFn prefix;
+  InfixFn infix;
+  Precedence precedence;
+} TreeRule;
+
+// The same bookkeeping the single-pass compiler does for locals and
+// upvalues, kept only to bind names to their Decls and to report the
+// same errors. The code generator assigns the real slots.
+typedef struct {
+  Token name;
+  int depth;
+  Decl* decl;
+} Binding;
+
+typedef struct {
+  uint16_t index;
+  bool isLocal;
+} UpvalueBinding;
+
+typedef struct Resolver {
+  struct Resolver* enclosing;
+  FunctionNode* function;
+  Binding* locals;
+  int localCount;
+  int localCapacity;
+  UpvalueBinding* upvalues;
+  int upvalueCount;
+  int upvalueCapacity;
+  int scopeDepth;
+} Resolver;
+
+typedef struct ClassResolver {
+  struct ClassResolver* enclosing;
+  bool hasSuperclass;
+} ClassResolver;
+
+typedef struct {
+  Node* head;
+  Node* tail;
+} NodeList;
+
+static TreeParser parser;
+static Resolver* current = NULL;
+static ClassResolver* currentClass = NULL;
+
+// Arena ---------------------------------------------------------------
+
+// Nodes are carved out of blocks this big.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock* next;
+  size_t size;
+  size_t used;
+} ArenaBlock;
+
+static ArenaBlock* arena = NULL;
+static ValueArray roots;
+
+void* astAllocate(size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  if (arena == NULL || arena->used + size > arena->size) {
+    size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock* block = (ArenaBlock*)reallocate(
+        NULL, 0, sizeof(ArenaBlock) + blockSize);
+    block->next = arena;
+    block->size = blockSize;
+    block->used = 0;
+    arena = block;
+  }
+
+  void* memory = (char*)(arena + 1) + arena->used;
+  arena->used += size;
+  memset(memory, 0, size);
+  return memory;
+}
+
+void* astGrow(void* array, int* capacity, int count, size_t size) {
+  if (count < *capacity) return array;
+
+  int oldCapacity = *capacity;
+  *capacity = GROW_CAPACITY(oldCapacity);
+  void* grown = astAllocate(size * *capacity);
+  if (oldCapacity > 0) memcpy(grown, array, size * oldCapacity);
+  return grown;
+}
+
+static void freeArena() {
+  while (arena != NULL) {
+    ArenaBlock* next = arena->next;
+    reallocate(arena, sizeof(ArenaBlock) + arena->size, 0);
+    arena = next;
+  }
+}
+
+void astRoot(Value value) {
+  if (!IS_OBJ(value)) return;
+
+  push(value);
+  writeValueArray(&roots, value);
+  pop();
+}
+
+void markAstRoots() {
+  for (int i = 0; i < roots.count; i++) {
+    markValue(roots.values[i]);
+  }
+}
+
+// Parser --------------------------------------------------------------
+
+void astError(Token* token, const char* message) {
+  if (parser.panicMode) return;
+  parser.panicMode = true;
+  if (parser.preparsing) {
+    parser.hadError = true;
+    return;
+  }
+
+  fprintf(stderr, "[line %d] Error", token->line);
+
+  if (token->type == TOKEN_EOF) {
+    fprintf(stderr, " at end");
+  } else if (token->type == TOKEN_ERROR) {
+    // Nothing.
+  } else {
+    fprintf(stderr, " at '%.*s'", token->length, token->start);
+  }
+
+  fprintf(stderr, ": %s\n", message);
+  parser.hadError = true;
+}
+
+static void error(const char* message) {
+  astError(&parser.previous, message);
+}
+
+static void errorAtCurrent(const char* message) {
+  astError(&parser.current, message);
+}
+
+static void advance() {
+  parser.previous = parser.current;
+
+  for (;;) {
+    parser.current = scanToken();
+    parser.tokenCount++;
+    if (parser.current.type != TOKEN_ERROR) break;
+
+    errorAtCurrent(parser.current.start);
+  }
+}
+
+static void consume(TokenType type, const char* message) {
+  if (parser.current.type == type) {
+    advance();
+    return;
+  }
+
+  errorAtCurrent(message);
+}
+
+static bool check(TokenType type) {
+  return parser.current.type == type;
+}
+
+static bool match(TokenType type) {
+  if (!check(type)) return false;
+  advance();
+  return true;
+}
+
+static Node* newNode(NodeType type, Token token) {
+  Node* node = (Node*)astAllocate(sizeof(Node));
+  node->type = type;
+  node->token = token;
+  node->line = parser.previous.line;
+  return node;
+}
+
+static Node* literalNode(Token token, Value value) {
+  Node* node = newNode(NODE_LITERAL, token);
+  node->as.literal = value;
+  astRoot(value);
+  return node;
+}
+
+// Nodes that failed to parse are left out. Nothing is compiled from a
+// tree with errors anyway.
+static void appendNode(NodeList* list, Node* node) {
+  if (node == NULL) return;
+
+  if (list->tail == NULL) {
+    list->head = node;
+  } else {
+    list->tail->next = node;
+  }
+  list->tail = node;
+}
+
+static Decl* newDecl(Token name) {
+  Decl* decl = (Decl*)astAllocate(sizeof(Decl));
+  decl->name = name;
+  decl->function = current->function;
+  decl->slot = -1;
+  return decl;
+}
+
+static Binding* pushBinding(Resolver* resolver) {
+  resolver->locals = (Binding*)astGrow(resolver->locals,
+      &resolver->localCapacity, resolver->localCount, sizeof(Binding));
+  return &resolver->locals[resolver->localCount++];
+}
+
+static void initResolver(Resolver* resolver, FunctionKind kind) {
+  resolver->enclosing = current;
+  resolver->locals = NULL;
+  resolver->localCount = 0;
+  resolver->localCapacity = 0;
+  resolver->upvalues = NULL;
+  resolver->upvalueCount = 0;
+  resolver->upvalueCapacity = 0;
+  resolver->scopeDepth = 0;
+
+  FunctionNode* function =
+      (FunctionNode*)astAllocate(sizeof(FunctionNode));
+  function->kind = kind;
+  if (kind != KIND_SCRIPT) function->name = parser.previous;
+  resolver->function = function;
+  current = resolver;
+
+  Binding* local = pushBinding(current);
+  local->depth = 0;
+  if (kind != KIND_FUNCTION) {
+    local->name.start = "this";
+    local->name.length = 4;
+  } else {
+    local->name.start = "";
+    local->name.length = 0;
+  }
+  local->decl = newDecl(local->name);
+  function->receiver = local->decl;
+}
+
+static FunctionNode* endResolver() {
+  FunctionNode* function = current->function;
+  function->endLine = parser.previous.line;
+  current = current->enclosing;
+  return function;
+}
+
+static void beginScope() {
+  current->scopeDepth++;
+}
+
+static void endScope() {
+  current->scopeDepth--;
+
+  while (current->localCount > 0 &&
+         current->locals[current->localCount - 1].depth >
+            current->scopeDepth) {
+    current->localCount--;
+  }
+}
+
+static Node* expression();
+static Node* statement();
+static Node* declaration();
+static TreeRule* getRule(TokenType type);
+static Node* parsePrecedence(Precedence precedence);
+
+static bool identifiersEqual(Token* a, Token* b) {
+  if (a->length != b->length) return false;
+  return memcmp(a->start, b->start, a->length) == 0;
+}
+
+static int resolveLocal(Resolver* resolver, Token* name) {
+  for (int i = resolver->localCount - 1; i >= 0; i--) {
+    Binding* local = &resolver->locals[i];
+    if (identifiersEqual(name, &local->name)) {
+      if (local->depth == -1) {
+        error("Can't read local variable in its own initializer.");
+      }
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int addUpvalue(Resolver* resolver, int index, bool isLocal) {
+  int upvalueCount = resolver->upvalueCount;
+
+  for (int i = 0; i < upvalueCount; i++) {
+    UpvalueBinding* upvalue = &resolver->upvalues[i];
+    if (upvalue->index == index && upvalue->isLocal == isLocal) {
+      return i;
+    }
+  }
+
+  if (upvalueCount == UINT16_COUNT) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+
+  resolver->upvalues = (UpvalueBinding*)astGrow(resolver->upvalues,
+      &resolver->upvalueCapacity, upvalueCount, sizeof(UpvalueBinding));
+  resolver->upvalues[upvalueCount].isLocal = isLocal;
+  resolver->upvalues[upvalueCount].index = (uint16_t)index;
+  return resolver->upvalueCount++;
+}
+
+static int resolveUpvalue(Resolver* resolver, Token* name, Decl** decl) {
+  if (resolver->enclosing == NULL) return -1;
+
+  int local = resolveLocal(resolver->enclosing, name);
+  if (local != -1) {
+    *decl = resolver->enclosing->locals[local].decl;
+    return addUpvalue(resolver, local, true);
+  }
+
+  int upvalue = resolveUpvalue(resolver->enclosing, name, decl);
+  if (upvalue != -1) {
+    return addUpvalue(resolver, upvalue, false);
+  }
+
+  return -1;
+}
+
+static void addLocal(Token name) {
+  if (current->localCount == UINT16_COUNT) {
+    error("Too many local variables in function.");
+    return;
+  }
+
+  Binding* local = pushBinding(current);
+  local->name = name;
+  local->depth = -1;
+  local->decl = newDecl(name);
+}
+
+static void declareVariable() {
+  if (current->scopeDepth == 0) return;
+
+  Token* name = &parser.previous;
+  for (int i = current->localCount - 1; i >= 0; i--) {
+    Binding* local = &current->locals[i];
+    if (local->depth != -1 && local->depth < current->scopeDepth) {
+      break;
+    }
+
+    if (identifiersEqual(name, &local->name)) {
+      error("Already variable with this name in this scope.");
+    }
+  }
+
+  addLocal(*name);
+}
+
+static void parseVariable(const char* errorMessage) {
+  consume(TOKEN_IDENTIFIER, errorMessage);
+  declareVariable();
+}
+
+// The Decl for the variable just declared, or NULL for a global.
+static Decl* declaredVariable() {
+  if (current->scopeDepth == 0) return NULL;
+  return current->locals[current->localCount - 1].decl;
+}
+
+static void markInitialized() {
+  if (current->scopeDepth == 0) return;
+  current->locals[current->localCount - 1].depth =
+      current->scopeDepth;
+}
+
+static Node* argumentList(int* argCount) {
+  NodeList arguments = {NULL, NULL};
+  *argCount = 0;
+  if (!check(TOKEN_RIGHT_PAREN)) {
+    do {
+      appendNode(&arguments, expression());
+
+      if (*argCount == 255) {
+        error("Can't have more than 255 arguments.");
+      }
+      (*argCount)++;
+    } while (match(TOKEN_COMMA));
+  }
+
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+  return arguments.head;
+}
+
+static Node* logical(Node* left, bool canAssign) {
+  Token operatorToken = parser.previous;
+  Node* right = parsePrecedence(
+      operatorToken.type == TOKEN_AND ? PREC_AND : PREC_OR);
+
+  Node* node = newNode(NODE_LOGICAL, operatorToken);
+  node->as.binary.left = left;
+  node->as.binary.right = right;
+  node->as.binary.end = parser.previous;
+  return node;
+}
+
+static Node* binary(Node* left, bool canAssign) {
+  Token operatorToken = parser.previous;
+  TreeRule* rule = getRule(operatorToken.type);
+  Node* right = parsePrecedence((Precedence)(rule->precedence + 1));
+
+  Node* node = newNode(NODE_BINARY, operatorToken);
+  node->as.binary.left = left;
+  node->as.binary.right = right;
+  return node;
+}
+
+static Node* call(Node* left, bool canAssign) {
+  Token paren = parser.previous;
+  int argCount;
+  Node* arguments = argumentList(&argCount);
+
+  Node* node = newNode(NODE_CALL, paren);
+  node->as.access.object = left;
+  node->as.access.arguments = arguments;
+  node->as.access.argCount = argCount;
+  return node;
+}
+
+static Node* subscript(Node* left, bool canAssign) {
+  Token bracket = parser.previous;
+  Node* index = expression();
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+  Node* node;
+  if (canAssign && match(TOKEN_EQUAL)) {
+    Node* value = expression();
+    node = newNode(NODE_SET_INDEX, bracket);
+    node->as.access.value = value;
+  } else {
+    node = newNode(NODE_GET_INDEX, bracket);
+  }
+
+  node->as.access.object = left;
+  node->as.access.index = index;
+  return node;
+}
+
+static Node* dot(Node* left, bool canAssign) {
+  consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+  Token name = parser.previous;
+
+  Node* node;
+  if (canAssign && match(TOKEN_EQUAL)) {
+    Node* value = expression();
+    node = newNode(NODE_SET_PROPERTY, name);
+    node->as.access.value = value;
+  } else if (match(TOKEN_LEFT_PAREN)) {
+    int argCount;
+    Node* arguments = argumentList(&argCount);
+    node = newNode(NODE_INVOKE, name);
+    node->as.access.arguments = arguments;
+    node->as.access.argCount = argCount;
+  } else {
+    node = newNode(NODE_GET_PROPERTY, name);
+  }
+
+  node->as.access.object = left;
+  return node;
+}
+
+static Node* literal(bool canAssign) {
+  switch (parser.previous.type) {
+    case TOKEN_FALSE: return literalNode(parser.previous, BOOL_VAL(false));
+    case TOKEN_NIL: return literalNode(parser.previous, NIL_VAL);
+    case TOKEN_TRUE: return literalNode(parser.previous, BOOL_VAL(true));
+    default:
+      return NULL; // Unreachable.
+  }
+}
+
+static Node* grouping(bool canAssign) {
+  Node* node = expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+  return node;
+}
+
+static Node* number(bool canAssign) {
+  double value = strtod(parser.previous.start, NULL);
+  if (value <= INT32_MAX && value == (int32_t)value) {
+    return literalNode(parser.previous, INT_VAL((int32_t)value));
+  }
+
+  return literalNode(parser.previous, NUMBER_VAL(value));
+}
+
+static Node* string(bool canAssign) {
+  return literalNode(parser.previous,
+                     stringValue(parser.previous.start + 1,
+                                 parser.previous.length - 2));
+}
+
+static Node* list(bool canAssign) {
+  Token bracket = parser.previous;
+  NodeList items = {NULL, NULL};
+  int itemCount = 0;
+  if (!check(TOKEN_RIGHT_BRACKET)) {
+    do {
+      appendNode(&items, expression());
+      if (itemCount == UINT16_MAX) {
+        error("Can't have more than 65535 items in a list literal.");
+      }
+      itemCount++;
+    } while (match(TOKEN_COMMA));
+  }
+
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list items.");
+
+  Node* node = newNode(NODE_LIST, bracket);
+  node->as.access.arguments = items.head;
+  node->as.access.argCount = itemCount;
+  return node;
+}
+
+static Node* namedVariable(Token name, bool canAssign) {
+  Decl* decl = NULL;
+  int arg = resolveLocal(current, &name);
+  if (arg != -1) {
+    decl = current->locals[arg].decl;
+  } else {
+    resolveUpvalue(current, &name, &decl);
+  }
+
+  if (canAssign && match(TOKEN_EQUAL)) {
+    Node* value = expression();
+    Node* node = newNode(NODE_ASSIGN, name);
+    node->as.variable.decl = decl;
+    node->as.variable.value = value;
+    if (decl != NULL) decl->assignments++;
+    return node;
+  }
+
+  Node* node = newNode(NODE_VARIABLE, name);
+  node->as.variable.decl = decl;
+  return node;
+}
+
+static Node* variable(bool canAssign) {
+  return namedVariable(parser.previous, canAssign);
+}
+
+static Token syntheticToken(const char* text) {
+  Token token;
+  token.type = TOKEN_IDENTIFIER;
+  token.start = text;
+  token.length = (int)strlen(text);
+  token.line = parser.previous.line;
+  return token;
+}
+
+static Node* super_(bool canAssign) {
+  parser.usesSuper = true;
+  if (currentClass == NULL) {
+    error("Can't use 'super' outside of a class.");
+  } else if (!currentClass->hasSuperclass) {
+    error("Can't use 'super' in a class with no superclass.");
+  }
+
+  consume(TOKEN_DOT, "Expect '.' after 'super'.");
+  consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+  Token name = parser.previous;
+
+  Node* self = namedVariable(syntheticToken("this"), false);
+  Node* node;
+  if (match(TOKEN_LEFT_PAREN)) {
+    int argCount;
+    Node* arguments = argumentList(&argCount);
+    Node* superclass = namedVariable(syntheticToken("super"), false);
+    node = newNode(NODE_SUPER_INVOKE, name);
+    node->as.access.index = superclass;
+    node->as.access.arguments = arguments;
+    node->as.access.argCount = argCount;
+  } else {
+    Node* superclass = namedVariable(syntheticToken("super"), false);
+    node = newNode(NODE_SUPER_GET, name);
+    node->as.access.index = superclass;
+  }
+
+  node->as.access.object = self;
+  return node;
+}
+
+static Node* this_(bool canAssign) {
+  if (currentClass == NULL) {
+    error("Can't use 'this' outside of a class.");
+    return NULL;
+  }
+
+  return variable(false);
+}
+
+static Node* unary(bool canAssign) {
+  Token operatorToken = parser.previous;
+  Node* operand = parsePrecedence(PREC_UNARY);
+
+  Node* node = newNode(NODE_UNARY, operatorToken);
+  node->as.binary.left = operand;
+  return node;
+}
+
+static TreeRule rules[] = {
+  [TOKEN_LEFT_PAREN]    = {grouping, call,      PREC_CALL},
+  [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_LEFT_BRACE]    = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_LEFT_BRACKET]  = {list,     subscript, PREC_CALL},
+  [TOKEN_RIGHT_BRACKET] = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_COMMA]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_DOT]           = {NULL,     dot,       PREC_CALL},
+  [TOKEN_MINUS]         = {unary,    binary,    PREC_TERM},
+  [TOKEN_PLUS]          = {NULL,     binary,    PREC_TERM},
+  [TOKEN_SEMICOLON]     = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_SLASH]         = {NULL,     binary,    PREC_FACTOR},
+  [TOKEN_STAR]          = {NULL,     binary,    PREC_FACTOR},
+  [TOKEN_BANG]          = {unary,    NULL,      PREC_NONE},
+  [TOKEN_BANG_EQUAL]    = {NULL,     binary,    PREC_EQUALITY},
+  [TOKEN_EQUAL]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_EQUAL_EQUAL]   = {NULL,     binary,    PREC_EQUALITY},
+  [TOKEN_GREATER]       = {NULL,     binary,    PREC_COMPARISON},
+  [TOKEN_GREATER_EQUAL] = {NULL,     binary,    PREC_COMPARISON},
+  [TOKEN_LESS]          = {NULL,     binary,    PREC_COMPARISON},
+  [TOKEN_LESS_EQUAL]    = {NULL,     binary,    PREC_COMPARISON},
+  [TOKEN_IDENTIFIER]    = {variable, NULL,      PREC_NONE},
+  [TOKEN_STRING]        = {string,   NULL,      PREC_NONE},
+  [TOKEN_NUMBER]        = {number,   NULL,      PREC_NONE},
+  [TOKEN_AND]           = {NULL,     logical,   PREC_AND},
+  [TOKEN_CLASS]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_ELSE]          = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_FALSE]         = {literal,  NULL,      PREC_NONE},
+  [TOKEN_FOR]           = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_FUN]           = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_IF]            = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_NIL]           = {literal,  NULL,      PREC_NONE},
+  [TOKEN_OR]            = {NULL,     logical,   PREC_OR},
+  [TOKEN_PRINT]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_RETURN]        = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_SUPER]         = {super_,   NULL,      PREC_NONE},
+  [TOKEN_THIS]          = {this_,    NULL,      PREC_NONE},
+  [TOKEN_TRUE]          = {literal,  NULL,      PREC_NONE},
+  [TOKEN_VAR]           = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_WHILE]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_ERROR]         = {NULL,     NULL,      PREC_NONE},
+  [TOKEN_EOF]           = {NULL,     NULL,      PREC_NONE},
+};
+
+static Node* parsePrecedence(Precedence precedence) {
+  advance();
+  PrefixFn prefixRule = getRule(parser.previous.type)->prefix;
+  if (prefixRule == NULL) {
+    error("Expect expression.");
+    return NULL;
+  }
+
+  bool canAssign = precedence <= PREC_ASSIGNMENT;
+  Node* node = prefixRule(canAssign);
+
+  while (precedence <= getRule(parser.current.type)->precedence) {
+    advance();
+    InfixFn infixRule = getRule(parser.previous.type)->infix;
+    node = infixRule(node, canAssign);
+  }
+
+  if (canAssign && match(TOKEN_EQUAL)) {
+    error("Invalid assignment target.");
+  }
+
+  return node;
+}
+
+static TreeRule* getRule(TokenType type) {
+  return &rules[type];
+}
+
+static Node* expression() {
+  return parsePrecedence(PREC_ASSIGNMENT);
+}
+
+static Node* block() {
+  NodeList statements = {NULL, NULL};
+  while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+    appendNode(&statements, declaration());
+  }
+
+  consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+  return statements.head;
+}
+
+static FunctionNode* function(FunctionKind kind) {
+  Resolver resolver;
+  initResolver(&resolver, kind);
+  beginScope();
+
+  FunctionNode* function = current->function;
+  Decl** parameter = &function->parameters;
+
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+  if (!check(TOKEN_RIGHT_PAREN)) {
+    do {
+      function->arity++;
+      if (function->arity > 255) {
+        errorAtCurrent("Can't have more than 255 parameters.");
+      }
+
+      parseVariable("Expect parameter name.");
+      markInitialized();
+      *parameter = declaredVariable();
+      parameter = &(*parameter)->next;
+    } while (match(TOKEN_COMMA));
+  }
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+
+  consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+  function->body = block();
+
+  return endResolver();
+}
+
+static FunctionNode* method() {
+  consume(TOKEN_IDENTIFIER, "Expect method name.");
+
+  FunctionKind kind = KIND_METHOD;
+  if (parser.previous.length == 4 &&
+      memcmp(parser.previous.start, "init", 4) == 0) {
+    kind = KIND_INITIALIZER;
+  }
+
+  return function(kind);
+}
+
+static Node* classDeclaration() {
+  consume(TOKEN_IDENTIFIER, "Expect class name.");
+  Token className = parser.previous;
+  declareVariable();
+
+  Node* node = newNode(NODE_CLASS, className);
+  node->as.klass.decl = declaredVariable();
+  markInitialized();
+
+  ClassResolver classResolver;
+  classResolver.hasSuperclass = false;
+  classResolver.enclosing = currentClass;
+  currentClass = &classResolver;
+
+  if (match(TOKEN_LESS)) {
+    consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+    node->as.klass.superclass = variable(false);
+
+    if (identifiersEqual(&className, &parser.previous)) {
+      error("A class can't inherit from itself.");
+    }
+
+    beginScope();
+    addLocal(syntheticToken("super"));
+    markInitialized();
+    node->as.klass.superDecl = declaredVariable();
+    classResolver.hasSuperclass = true;
+  }
+
+  node->as.klass.self = namedVariable(className, false);
+  consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+  FunctionNode** method_ = &node->as.klass.methods;
+  while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
+    *method_ = method();
+    method_ = &(*method_)->next;
+  }
+  consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+
+  if (classResolver.hasSuperclass) {
+    endScope();
+  }
+
+  currentClass = currentClass->enclosing;
+  return node;
+}
+
+static Node* funDeclaration() {
+  parseVariable("Expect function name.");
+  Token name = parser.previous;
+  Decl* decl = declaredVariable();
+  markInitialized();
+  FunctionNode* body = function(KIND_FUNCTION);
+
+  Node* node = newNode(NODE_FUNCTION, name);
+  node->as.function.decl = decl;
+  node->as.function.function = body;
+  return node;
+}
+
+static Node* varDeclaration() {
+  parseVariable("Expect variable name.");
+  Token name = parser.previous;
+  Decl* decl = declaredVariable();
+
+  Node* initializer;
+  if (match(TOKEN_EQUAL)) {
+    initializer = expression();
+  } else {
+    initializer = literalNode(name, NIL_VAL);
+  }
+  consume(TOKEN_SEMICOLON,
+          "Expect ';' after variable declaration.");
+  markInitialized();
+
+  Node* node = newNode(NODE_VAR, name);
+  node->as.variable.decl = decl;
+  node->as.variable.value = initializer;
+  return node;
+}
+
+static Node* expressionStatement() {
+  Node* expr = expression();
+  consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+
+  Node* node = newNode(NODE_EXPRESSION, parser.previous);
+  node->as.expression = expr;
+  return node;
+}
+
+// A for loop becomes a block holding the initializer and a while loop
+// whose body runs the increment after the original body.
+static Node* forStatement() {
+  Token keyword = parser.previous;
+  NodeList statements = {NULL, NULL};
+  beginScope();
+
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
+  if (match(TOKEN_SEMICOLON)) {
+    // No initializer.
+  } else if (match(TOKEN_VAR)) {
+    appendNode(&statements, varDeclaration());
+  } else {
+    appendNode(&statements, expressionStatement());
+  }
+
+  Node* condition = NULL;
+  if (!match(TOKEN_SEMICOLON)) {
+    condition = expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
+  }
+
+  Node* increment = NULL;
+  if (!match(TOKEN_RIGHT_PAREN)) {
+    increment = expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+  }
+
+  Node* body = statement();
+  Token end = parser.previous;
+
+  if (increment != NULL) {
+    Node* incrementStatement = newNode(NODE_EXPRESSION, end);
+    incrementStatement->as.expression = increment;
+
+    NodeList bodyStatements = {NULL, NULL};
+    appendNode(&bodyStatements, body);
+    appendNode(&bodyStatements, incrementStatement);
+    body = newNode(NODE_BLOCK, end);
+    body->as.statements = bodyStatements.head;
+  }
+
+  Node* loop = newNode(NODE_WHILE, keyword);
+  loop->as.branch.condition = condition;
+  loop->as.branch.thenBranch = body;
+  loop->as.branch.thenEnd = end;
+  appendNode(&statements, loop);
+
+  endScope();
+
+  Node* node = newNode(NODE_BLOCK, keyword);
+  node->as.statements = statements.head;
+  return node;
+}
+
+static Node* ifStatement() {
+  Token keyword = parser.previous;
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+  Node* condition = expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+  Node* node = newNode(NODE_IF, keyword);
+  node->as.branch.condition = condition;
+  node->as.branch.thenBranch = statement();
+  node->as.branch.thenEnd = parser.previous;
+
+  if (match(TOKEN_ELSE)) node->as.branch.elseBranch = statement();
+  node->as.branch.elseEnd = parser.previous;
+  return node;
+}
+
+static Node* printStatement() {
+  Token keyword = parser.previous;
+  Node* value = expression();
+  consume(TOKEN_SEMICOLON, "Expect ';' after value.");
+
+  Node* node = newNode(NODE_PRINT, keyword);
+  node->as.expression = value;
+  return node;
+}
+
+static Node* returnStatement() {
+  Token keyword = parser.previous;
+  if (current->function->kind == KIND_SCRIPT) {
+    error("Can't return from top-level code.");
+  }
+
+  Node* value = NULL;
+  if (!match(TOKEN_SEMICOLON)) {
+    if (current->function->kind == KIND_INITIALIZER) {
+      error("Can't return a value from an initializer.");
+    }
+
+    value = expression();
+    consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+  }
+
+  Node* node = newNode(NODE_RETURN, keyword);
+  node->as.expression = value;
+  return node;
+}
+
+static Node* whileStatement() {
+  Token keyword = parser.previous;
+  consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+  Node* condition = expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+  Node* node = newNode(NODE_WHILE, keyword);
+  node->as.branch.condition = condition;
+  node->as.branch.thenBranch = statement();
+  node->as.branch.thenEnd = parser.previous;
+  return node;
+}
+
+static void synchronize() {
+  parser.panicMode = false;
+
+  while (parser.current.type != TOKEN_EOF) {
+    if (parser.previous.type == TOKEN_SEMICOLON) return;
+
+    switch (parser.current.type) {
+      case TOKEN_CLASS:
+      case TOKEN_FUN:
+      case TOKEN_VAR:
+      case TOKEN_FOR:
+      case TOKEN_IF:
+      case TOKEN_WHILE:
+      case TOKEN_PRINT:
+      case TOKEN_RETURN:
+        return;
+
+      default:
+        // Do nothing.
+        ;
+    }
+
+    advance();
+  }
+}
+
+static Node* declaration() {
+  Node* node;
+  if (match(TOKEN_CLASS)) {
+    node = classDeclaration();
+  } else if (match(TOKEN_FUN)) {
+    node = funDeclaration();
+  } else if (match(TOKEN_VAR)) {
+    node = varDeclaration();
+  } else {
+    node = statement();
+  }
+
+  if (parser.panicMode) synchronize();
+  return node;
+}
+
+static Node* statement() {
+  if (match(TOKEN_PRINT)) {
+    return printStatement();
+  } else if (match(TOKEN_FOR)) {
+    return forStatement();
+  } else if (match(TOKEN_IF)) {
+    return ifStatement();
+  } else if (match(TOKEN_RETURN)) {
+    return returnStatement();
+  } else if (match(TOKEN_WHILE)) {
+    return whileStatement();
+  } else if (match(TOKEN_LEFT_BRACE)) {
+    Node* node = newNode(NODE_BLOCK, parser.previous);
+    beginScope();
+    node->as.statements = block();
+    endScope();
+    return node;
+  } else {
+    return expressionStatement();
+  }
+}
+
+ObjFunction* compileAst(const char* source) {
+  initScanner(source);
+  initValueArray(&roots);
+
+  Resolver resolver;
+  initResolver(&resolver, KIND_SCRIPT);
+
+  parser.hadError = false;
+  parser.panicMode = false;
+
+  advance();
+
+  NodeList statements = {NULL, NULL};
+  while (!match(TOKEN_EOF)) {
+    appendNode(&statements, declaration());
+  }
+
+  FunctionNode* script = endResolver();
+  script->body = statements.head;
+
+  ObjFunction* function = NULL;
+  if (!parser.hadError) {
+    optimizeAst(script);
+    function = generateCode(script);
+  }
+
+  freeValueArray(&roots);
+  freeArena();
+  return parser.hadError ? NULL : function;
+}
+
+// Pre-parsing ---------------------------------------------------------
+
+// Longer bodies are compiled right away. No token compiles to enough
+// code or constants that this many could overflow an operand.
+#define PREPARSE_MAX_TOKENS 2048
+
+bool preparseFunction(FunctionKind kind, Token* previous, Token* current,
+                      int* arity) {
+  initValueArray(&roots);
+
+  Resolver resolver;
+  initResolver(&resolver, KIND_SCRIPT);
+
+  ClassResolver classResolver;
+  classResolver.enclosing = NULL;
+  classResolver.hasSuperclass = false;
+  if (kind != KIND_FUNCTION) currentClass = &classResolver;
+
+  parser.previous = *previous;
+  parser.current = *current;
+  parser.hadError = false;
+  parser.panicMode = false;
+  parser.preparsing = true;
+  parser.tokenCount = 0;
+  parser.usesSuper = false;
+
+  *arity = function(kind)->arity;
+
+  // A method using `super` captures the enclosing class's superclass,
+  // which a closure created before its body is compiled can't do.
+  bool isValid = !parser.hadError && !parser.usesSuper &&
+      parser.tokenCount <= PREPARSE_MAX_TOKENS;
+  if (isValid) {
+    *previous = parser.previous;
+    *current = parser.current;
+  }
+
+  parser.preparsing = false;
+  endResolver();
+  currentClass = NULL;
+  freeValueArray(&roots);
+  freeArena();
+  return isValid;
+}
+//< Optimization omit
@@ -0,0 +1,204 @@
+//> Optimization omit
+#ifndef clox_ast_h
+#define clox_ast_h
+
+#include "object.h"
+#include "scanner.h"
+
+// The optimizing compiler parses the whole script into a syntax tree,
+// rewrites the tree, and only then emits bytecode. Variables are
+// resolved while parsing, in the same order the single-pass compiler
+// resolves them, so both report exactly the same compile errors.
+//
+// Nodes live in an arena that is freed in one go once the bytecode has
+// been emitted.
+
+typedef enum {
+  KIND_FUNCTION,
+  KIND_INITIALIZER,
+  KIND_METHOD,
+  KIND_SCRIPT
+} FunctionKind;
+
+typedef struct FunctionNode FunctionNode;
+
+// A local variable. Globals are looked up by name and have no Decl.
+typedef struct Decl {
+  Token name;
+  // The function whose stack frame holds the variable.
+  FunctionNode* function;
+  // The next parameter, for parameters.
+  struct Decl* next;
+
+  // Filled in by the analysis passes.
+  int assignments;
+  bool isCaptured;
+  bool isConstant;
+  Value constant;
+  // Set while the function the variable names is analyzed or
+  // generated. That function can refer to itself before the variable
+  // holds it.
+  bool isDefining;
+
+  // Assigned by the code generator.
+  int slot;
+} Decl;
+
+typedef enum {
+  // Expressions.
+  NODE_ASSIGN,
+  NODE_BINARY,
+  NODE_CALL,
+  NODE_GET_INDEX,
+  NODE_GET_PROPERTY,
+  NODE_INLINE,
+  NODE_INVOKE,
+  NODE_LIST,
+  NODE_LITERAL,
+  NODE_LOGICAL,
+  NODE_SET_INDEX,
+  NODE_SET_PROPERTY,
+  NODE_SUPER_GET,
+  NODE_SUPER_INVOKE,
+  NODE_UNARY,
+  NODE_VARIABLE,
+
+  // Statements.
+  NODE_BLOCK,
+  NODE_CLASS,
+  NODE_EXPRESSION,
+  NODE_FUNCTION,
+  NODE_IF,
+  NODE_PRINT,
+  NODE_RETURN,
+  NODE_VAR,
+  NODE_WHILE
+} NodeType;
+
+typedef struct Node {
+  NodeType type;
+  // The operator, literal, or name the node is about. Compile errors
+  // found while emitting code are reported here.
+  Token token;
+  // The line its instructions are attributed to, which is where the
+  // single-pass compiler would have emitted them.
+  int line;
+  // The next node in an argument list or block.
+  struct Node* next;
+
+  union {
+    Value literal;
+
+    // NODE_VARIABLE, NODE_ASSIGN and NODE_VAR. A NULL [decl] is a
+    // global named by the token.
+    struct {
+      Decl* decl;
+      struct Node* value;
+    } variable;
+
+    // NODE_UNARY uses only [left]. [end] is the last token of a
+    // NODE_LOGICAL, which is where a too-long jump is reported.
+    struct {
+      struct Node* left;
+      struct Node* right;
+      Token end;
+    } binary;
+
+    // Calls, lists, and property, index and super accesses. The token
+    // is the property or method name. For super accesses, [object] is
+    // `this` and [index] is `super`.
+    struct {
+      struct Node* object;
+      struct Node* index;
+      struct Node* value;
+      struct Node* arguments;
+      int argCount;
+    } access;
+
+    // NODE_INLINE, a call or invoke of [function] replaced by a copy of
+    // its body with the arguments in place of the parameters. [body] is
+    // a list of expressions, and the last one is the result. The
+    // original [call] only runs if the callee turns out to be something
+    // else at runtime.
+    struct {
+      struct Node* call;
+      struct Node* body;
+      FunctionNode* function;
+    } inlined;
+
+    // NODE_EXPRESSION, NODE_PRINT, and NODE_RETURN, where it may be
+    // NULL.
+    struct Node* expression;
+
+    struct Node* statements;
+
+    struct {
+      Decl* decl;
+      FunctionNode* function;
+    } function;
+
+    struct {
+      Decl* decl;
+      // The superclass expression, or NULL.
+      struct Node* superclass;
+      Decl* superDecl;
+      // Loads the class itself.
+      struct Node* self;
+      FunctionNode* methods;
+    } klass;
+
+    // NODE_IF and NODE_WHILE. A NULL condition is always true. The end
+    // tokens close each branch.
+    struct {
+      struct Node* condition;
+      struct Node* thenBranch;
+      struct Node* elseBranch;
+      Token thenEnd;
+      Token elseEnd;
+    } branch;
+  } as;
+} Node;
+
+struct FunctionNode {
+  FunctionKind kind;
+  Token name;
+  int arity;
+  // Slot zero, which holds `this` in methods.
+  Decl* receiver;
+  Decl* parameters;
+  Node* body;
+  // The line of the closing brace, where the implicit return goes.
+  int endLine;
+  // The next method in a class.
+  FunctionNode* next;
+  // What the function compiles to. Created early if a guard for an
+  // inlined call needs it first.
+  ObjFunction* object;
+};
+
+void* astAllocate(size_t size);
+// Returns [array], which has room for [*capacity] elements of [size]
+// bytes, or a copy with more room if [count] of them fill it.
+void* astGrow(void* array, int* capacity, int count, size_t size);
+// Keeps [value] alive until compilation is done.
+void astRoot(Value value);
+void astError(Token* token, const char* message);
+
+void optimizeAst(FunctionNode* script);
+// Whether closures copy [decl] instead of capturing it.
+bool isCopied(Decl* decl);
+ObjFunction* generateCode(FunctionNode* script);
+
+ObjFunction* compileAst(const char* source);
+
+// Checks the parameter list and body of a function without compiling
+// it. [*previous] is its name and [*current] the '(' after it, the
+// scanner's position. Returns true, leaving them on the closing brace
+// and the token after it, if there are no errors and compiling it
+// later can't run into a limit. Reports nothing.
+bool preparseFunction(FunctionKind kind, Token* previous, Token* current,
+                      int* arity);
+void markAstRoots();
+
+#endif
+//< Optimization omit
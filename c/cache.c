@@ -0,0 +1,1154 @@
+//> Optimization omit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+#include "memory.h"
+#include "vm.h"
+
+#define CACHE_MAGIC "LOXC"
+#define CACHE_VERSION 7
+
+// Bytecode from a different build of clox can't be trusted, so the
+// header also records the value representation, opcode numbering and
+// superinstructions.
+#ifdef NAN_BOXING
+#define CACHE_FINGERPRINT \
+    ((((uint32_t)OP_METHOD << 8) | 1) ^ SUPERINSTRUCTIONS_HASH)
+#else
+#define CACHE_FINGERPRINT \
+    ((((uint32_t)OP_METHOD << 8) | 0) ^ SUPERINSTRUCTIONS_HASH)
+#endif
+
+typedef enum {
+  CONSTANT_NIL,
+  CONSTANT_FALSE,
+  CONSTANT_TRUE,
+  CONSTANT_NUMBER,
+  CONSTANT_INT,
+  CONSTANT_SHORT_STRING,
+  CONSTANT_STRING,
+  CONSTANT_FUNCTION,
+  // A function that was already written, by its index in FunctionList.
+  CONSTANT_SEEN_FUNCTION,
+  // Only used in heap images, where objects are referred to by index.
+  CONSTANT_OBJECT
+} ConstantTag;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t fingerprint;
+  uint32_t sourceLength;
+  uint64_t sourceHash;
+} CacheHeader;
+
+// Functions written or read so far, in order. A guard for an inlined
+// call makes a function a constant of more than one chunk. It is stored
+// in full the first time and by index after that, so that it is still a
+// single object once loaded and the guard can recognize it.
+typedef struct {
+  ObjFunction** functions;
+  int count;
+  int capacity;
+} FunctionList;
+
+static FunctionList seenFunctions = {NULL, 0, 0};
+
+static bool addSeenFunction(ObjFunction* function) {
+  if (seenFunctions.count == seenFunctions.capacity) {
+    int capacity = seenFunctions.capacity < 8
+        ? 8 : seenFunctions.capacity * 2;
+    ObjFunction** grown = (ObjFunction**)realloc(
+        seenFunctions.functions, sizeof(ObjFunction*) * capacity);
+    if (grown == NULL) return false;
+
+    seenFunctions.functions = grown;
+    seenFunctions.capacity = capacity;
+  }
+
+  seenFunctions.functions[seenFunctions.count++] = function;
+  return true;
+}
+
+static int seenFunctionIndex(ObjFunction* function) {
+  for (int i = 0; i < seenFunctions.count; i++) {
+    if (seenFunctions.functions[i] == function) return i;
+  }
+  return -1;
+}
+
+static void freeSeenFunctions() {
+  free(seenFunctions.functions);
+  seenFunctions.functions = NULL;
+  seenFunctions.count = 0;
+  seenFunctions.capacity = 0;
+}
+
+// The cache file for "script.lox" is "script.loxc".
+static char* cachePath(const char* path) {
+  size_t length = strlen(path);
+  char* result = (char*)malloc(length + 2);
+  if (result == NULL) return NULL;
+
+  memcpy(result, path, length);
+  result[length] = 'c';
+  result[length + 1] = '\0';
+  return result;
+}
+
+static uint64_t hashSource(const char* source, size_t length) {
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)source[i];
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+static void initHeader(CacheHeader* header, const char* source) {
+  size_t length = strlen(source);
+  memset(header, 0, sizeof(CacheHeader));
+  memcpy(header->magic, CACHE_MAGIC, 4);
+  header->version = CACHE_VERSION;
+  header->fingerprint = CACHE_FINGERPRINT;
+  header->sourceLength = (uint32_t)length;
+  header->sourceHash = hashSource(source, length);
+}
+
+// Writing -------------------------------------------------------------
+
+typedef struct {
+  uint8_t* bytes;
+  size_t count;
+  size_t capacity;
+  bool failed;
+} Writer;
+
+static void writeBytes(Writer* writer, const void* bytes, size_t count) {
+  if (writer->failed) return;
+
+  if (writer->count + count > writer->capacity) {
+    size_t capacity = writer->capacity < 256 ? 256 : writer->capacity;
+    while (capacity < writer->count + count) capacity *= 2;
+
+    uint8_t* grown = (uint8_t*)realloc(writer->bytes, capacity);
+    if (grown == NULL) {
+      writer->failed = true;
+      return;
+    }
+
+    writer->bytes = grown;
+    writer->capacity = capacity;
+  }
+
+  memcpy(writer->bytes + writer->count, bytes, count);
+  writer->count += count;
+}
+
+static void writeInt(Writer* writer, int32_t value) {
+  writeBytes(writer, &value, sizeof(value));
+}
+
+static void writeTag(Writer* writer, ConstantTag tag) {
+  uint8_t byte = (uint8_t)tag;
+  writeBytes(writer, &byte, 1);
+}
+
+static void writeString(Writer* writer, const char* chars, int length) {
+  writeInt(writer, length);
+  writeBytes(writer, chars, length);
+}
+
+static void writeFunction(Writer* writer, ObjFunction* function);
+
+static void writeConstant(Writer* writer, Value value) {
+  if (IS_NIL(value)) {
+    writeTag(writer, CONSTANT_NIL);
+  } else if (IS_BOOL(value)) {
+    writeTag(writer, AS_BOOL(value) ? CONSTANT_TRUE : CONSTANT_FALSE);
+  } else if (IS_INT(value)) {
+    writeTag(writer, CONSTANT_INT);
+    writeInt(writer, AS_INT(value));
+  } else if (IS_NUMBER(value)) {
+    double number = AS_NUMBER(value);
+    writeTag(writer, CONSTANT_NUMBER);
+    writeBytes(writer, &number, sizeof(number));
+  } else if (IS_ANY_STRING(value)) {
+    // Identifier constants are always ObjStrings, even short ones, so
+    // keep track of which form each string had.
+    char buffer[SHORT_STRING_MAX + 1];
+    int length;
+    const char* chars = stringChars(value, buffer, &length);
+    writeTag(writer, IS_SHORT_STRING(value) ? CONSTANT_SHORT_STRING
+                                            : CONSTANT_STRING);
+    writeString(writer, chars, length);
+  } else if (IS_FUNCTION(value)) {
+    int index = seenFunctionIndex(AS_FUNCTION(value));
+    if (index != -1) {
+      writeTag(writer, CONSTANT_SEEN_FUNCTION);
+      writeInt(writer, index);
+    } else {
+      writeTag(writer, CONSTANT_FUNCTION);
+      writeFunction(writer, AS_FUNCTION(value));
+    }
+  } else {
+    // The compiler never creates other kinds of constants.
+    writer->failed = true;
+  }
+}
+
+static void writeFunction(Writer* writer, ObjFunction* function) {
+  if (!addSeenFunction(function)) writer->failed = true;
+  writeInt(writer, function->arity);
+  writeInt(writer, function->upvalueCount);
+  writeInt(writer, function->captureCount);
+  writeInt(writer, function->slotCount);
+  if (function->name == NULL) {
+    writeInt(writer, -1);
+  } else {
+    writeString(writer, function->name->chars, function->name->length);
+  }
+
+  Chunk* chunk = &function->chunk;
+  writeInt(writer, chunk->count);
+  writeBytes(writer, chunk->code, chunk->count);
+  writeInt(writer, chunk->lineCount);
+  writeBytes(writer, chunk->lines, sizeof(LineStart) * chunk->lineCount);
+
+  writeInt(writer, chunk->constants.count);
+  for (int i = 0; i < chunk->constants.count; i++) {
+    writeConstant(writer, chunk->constants.values[i]);
+  }
+}
+
+void writeCache(const char* path, const char* source,
+                ObjFunction* function) {
+  Writer writer = {NULL, 0, 0, false};
+  CacheHeader header;
+  initHeader(&header, source);
+  writeBytes(&writer, &header, sizeof(header));
+  writeFunction(&writer, function);
+
+  // Failing to write the cache isn't an error. The script just gets
+  // compiled again next time.
+  char* outPath = cachePath(path);
+  if (!writer.failed && outPath != NULL) {
+    FILE* file = fopen(outPath, "wb");
+    if (file != NULL) {
+      size_t written = fwrite(writer.bytes, 1, writer.count, file);
+      bool closed = fclose(file) == 0;
+      if (written != writer.count || !closed) remove(outPath);
+    }
+  }
+
+  free(outPath);
+  free(writer.bytes);
+  freeSeenFunctions();
+}
+
+// Reading -------------------------------------------------------------
+
+typedef struct {
+  const uint8_t* current;
+  const uint8_t* end;
+  bool failed;
+} Reader;
+
+static const uint8_t* readBytes(Reader* reader, size_t count) {
+  if (reader->failed || (size_t)(reader->end - reader->current) < count) {
+    reader->failed = true;
+    return NULL;
+  }
+
+  const uint8_t* bytes = reader->current;
+  reader->current += count;
+  return bytes;
+}
+
+static int32_t readInt(Reader* reader) {
+  const uint8_t* bytes = readBytes(reader, sizeof(int32_t));
+  if (bytes == NULL) return 0;
+
+  int32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+// Reads a length-prefixed string. Returns NULL if the length is -1.
+static const char* readString(Reader* reader, int* length) {
+  *length = readInt(reader);
+  if (*length < 0) {
+    if (*length != -1) reader->failed = true;
+    return NULL;
+  }
+
+  return (const char*)readBytes(reader, *length);
+}
+
+static ObjFunction* readFunction(Reader* reader);
+
+// Reads a value that doesn't live on the heap. Returns false if [tag]
+// isn't one of those.
+static bool readSimpleValue(Reader* reader, uint8_t tag, Value* value) {
+  switch (tag) {
+    case CONSTANT_NIL: *value = NIL_VAL; return true;
+    case CONSTANT_FALSE: *value = BOOL_VAL(false); return true;
+    case CONSTANT_TRUE: *value = BOOL_VAL(true); return true;
+    case CONSTANT_INT: *value = INT_VAL(readInt(reader)); return true;
+    case CONSTANT_NUMBER: {
+      const uint8_t* bytes = readBytes(reader, sizeof(double));
+      double number = 0;
+      if (bytes != NULL) memcpy(&number, bytes, sizeof(number));
+      *value = NUMBER_VAL(number);
+      return true;
+    }
+    case CONSTANT_SHORT_STRING: {
+      int length;
+      const char* chars = readString(reader, &length);
+      if (chars == NULL || length > SHORT_STRING_MAX) {
+        reader->failed = true;
+        return true;
+      }
+
+      *value = stringValue(chars, length);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Reads one constant and adds it to [function], which must be rooted.
+static void readConstant(Reader* reader, ObjFunction* function) {
+  const uint8_t* tag = readBytes(reader, 1);
+  if (tag == NULL) return;
+
+  Value value;
+  if (readSimpleValue(reader, *tag, &value)) {
+    // Done.
+  } else if (*tag == CONSTANT_STRING) {
+    int length;
+    const char* chars = readString(reader, &length);
+    if (chars == NULL) {
+      reader->failed = true;
+      return;
+    }
+
+    value = OBJ_VAL(copyString(chars, length));
+  } else if (*tag == CONSTANT_FUNCTION) {
+    ObjFunction* nested = readFunction(reader);
+    if (nested == NULL) return;
+    value = OBJ_VAL(nested);
+  } else if (*tag == CONSTANT_SEEN_FUNCTION) {
+    int index = readInt(reader);
+    if (reader->failed || index < 0 || index >= seenFunctions.count) {
+      reader->failed = true;
+      return;
+    }
+
+    value = OBJ_VAL(seenFunctions.functions[index]);
+  } else {
+    reader->failed = true;
+    return;
+  }
+
+  if (!reader->failed) addConstant(&function->chunk, value);
+}
+
+static ObjFunction* readFunction(Reader* reader) {
+  ObjFunction* function = newFunction();
+  push(OBJ_VAL(function));
+  if (!addSeenFunction(function)) reader->failed = true;
+
+  function->arity = readInt(reader);
+  function->upvalueCount = readInt(reader);
+  function->captureCount = readInt(reader);
+  function->slotCount = readInt(reader);
+
+  int nameLength;
+  const char* name = readString(reader, &nameLength);
+  if (name != NULL) function->name = copyString(name, nameLength);
+
+  int count = readInt(reader);
+  if (count < 0) reader->failed = true;
+  const uint8_t* code = readBytes(reader, count);
+  int lineCount = readInt(reader);
+  // Every byte of code needs a line.
+  if (lineCount < 0 || (count > 0 && lineCount == 0)) {
+    reader->failed = true;
+  }
+  const uint8_t* lines = readBytes(reader, sizeof(LineStart) * lineCount);
+  if (reader->failed) {
+    pop();
+    return NULL;
+  }
+
+  uint8_t* codeCopy = ALLOCATE(uint8_t, count);
+  LineStart* linesCopy = ALLOCATE(LineStart, lineCount);
+  memcpy(codeCopy, code, count);
+  memcpy(linesCopy, lines, sizeof(LineStart) * lineCount);
+  function->chunk.code = codeCopy;
+  function->chunk.count = count;
+  function->chunk.capacity = count;
+  function->chunk.lines = linesCopy;
+  function->chunk.lineCount = lineCount;
+  function->chunk.lineCapacity = lineCount;
+
+  int constantCount = readInt(reader);
+  for (int i = 0; i < constantCount && !reader->failed; i++) {
+    readConstant(reader, function);
+  }
+  if (!reader->failed) packChunk(&function->chunk);
+
+  pop();
+  return reader->failed ? NULL : function;
+}
+
+// Maps the whole cache file into memory. Falls back to reading it on
+// platforms without mmap().
+static const uint8_t* mapFile(const char* path, size_t* size) {
+#ifdef HAS_MMAP
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *size = (size_t)info.st_size;
+  void* bytes = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return bytes == MAP_FAILED ? NULL : (const uint8_t*)bytes;
+#else
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+
+  fseek(file, 0L, SEEK_END);
+  long fileSize = ftell(file);
+  rewind(file);
+
+  uint8_t* bytes = fileSize > 0 ? (uint8_t*)malloc(fileSize) : NULL;
+  if (bytes != NULL &&
+      fread(bytes, 1, fileSize, file) != (size_t)fileSize) {
+    free(bytes);
+    bytes = NULL;
+  }
+
+  fclose(file);
+  *size = (size_t)fileSize;
+  return bytes;
+#endif
+}
+
+static void unmapFile(const uint8_t* bytes, size_t size) {
+#ifdef HAS_MMAP
+  munmap((void*)bytes, size);
+#else
+  free((void*)bytes);
+#endif
+}
+
+ObjFunction* loadCache(const char* path, const char* source) {
+  char* inPath = cachePath(path);
+  if (inPath == NULL) return NULL;
+
+  size_t size = 0;
+  const uint8_t* bytes = mapFile(inPath, &size);
+  free(inPath);
+  if (bytes == NULL) return NULL;
+
+  ObjFunction* function = NULL;
+  CacheHeader expected;
+  initHeader(&expected, source);
+  if (size >= sizeof(CacheHeader) &&
+      memcmp(bytes, &expected, sizeof(CacheHeader)) == 0) {
+    Reader reader = {bytes + sizeof(CacheHeader), bytes + size, false};
+    Value* stackTop = vm.stackTop;
+    function = readFunction(&reader);
+
+    // A truncated or corrupt file is treated like a stale one.
+    if (reader.failed || reader.current != reader.end) function = NULL;
+    vm.stackTop = stackTop;
+    freeSeenFunctions();
+  }
+
+  unmapFile(bytes, size);
+  return function;
+}
+
+// Heap images --------------------------------------------------------
+//
+// An image holds every object reachable from the globals. Objects are
+// numbered and refer to each other by index. Loading happens in two
+// passes: the first allocates an empty "shell" for each object, and
+// the second fills in the fields once every index has an address.
+
+#define IMAGE_MAGIC "LOXI"
+
+// Maps each object being saved to its index in the image.
+typedef struct {
+  Obj** objects;
+  int count;
+  int capacity;
+  // Open addressed. Each slot holds an index + 1, or 0 when empty.
+  int* slots;
+  int slotCapacity;
+} HeapIndex;
+
+typedef struct {
+  Writer out;
+  HeapIndex heap;
+} ImageWriter;
+
+static uint32_t hashPointer(Obj* object) {
+  return (uint32_t)(((uintptr_t)object >> 3) * 2654435761u);
+}
+
+static int* findSlot(HeapIndex* heap, Obj* object) {
+  uint32_t index = hashPointer(object) & (heap->slotCapacity - 1);
+  for (;;) {
+    int* slot = &heap->slots[index];
+    if (*slot == 0 || heap->objects[*slot - 1] == object) return slot;
+    index = (index + 1) & (heap->slotCapacity - 1);
+  }
+}
+
+static bool rehashHeap(HeapIndex* heap, int slotCapacity) {
+  int* slots = (int*)calloc(slotCapacity, sizeof(int));
+  if (slots == NULL) return false;
+
+  free(heap->slots);
+  heap->slots = slots;
+  heap->slotCapacity = slotCapacity;
+  for (int i = 0; i < heap->count; i++) {
+    *findSlot(heap, heap->objects[i]) = i + 1;
+  }
+  return true;
+}
+
+static int objectIndex(HeapIndex* heap, Obj* object) {
+  if (object == NULL) return -1;
+  return *findSlot(heap, object) - 1;
+}
+
+static void addObject(ImageWriter* writer, Obj* object) {
+  HeapIndex* heap = &writer->heap;
+  if (object == NULL || writer->out.failed) return;
+  if (heap->slotCapacity > 0 && *findSlot(heap, object) != 0) return;
+
+  if (heap->count + 1 > heap->capacity) {
+    int capacity = heap->capacity < 64 ? 64 : heap->capacity * 2;
+    Obj** objects = (Obj**)realloc(heap->objects,
+                                   sizeof(Obj*) * capacity);
+    if (objects == NULL) {
+      writer->out.failed = true;
+      return;
+    }
+
+    heap->objects = objects;
+    heap->capacity = capacity;
+  }
+
+  heap->objects[heap->count++] = object;
+
+  // Keep the load factor under one half.
+  if (heap->count * 2 > heap->slotCapacity) {
+    if (!rehashHeap(heap, heap->capacity * 2)) writer->out.failed = true;
+  } else {
+    *findSlot(heap, object) = heap->count;
+  }
+}
+
+static void addValue(ImageWriter* writer, Value value) {
+  if (IS_OBJ(value)) addObject(writer, AS_OBJ(value));
+}
+
+static void addTable(ImageWriter* writer, Table* table) {
+  for (int i = 0; i < table->capacity; i++) {
+    Entry* entry = &table->entries[i];
+    if (entry->key == NULL) continue;
+    addObject(writer, (Obj*)entry->key);
+    addValue(writer, entry->value);
+  }
+}
+
+// Adds the objects [object] refers to.
+static void addReferences(ImageWriter* writer, Obj* object) {
+  switch (object->type) {
+    case OBJ_BOUND_METHOD: {
+      ObjBoundMethod* bound = (ObjBoundMethod*)object;
+      addValue(writer, bound->receiver);
+      addObject(writer, (Obj*)bound->method);
+      break;
+    }
+    case OBJ_CLASS: {
+      ObjClass* klass = (ObjClass*)object;
+      addObject(writer, (Obj*)klass->name);
+      addTable(writer, &klass->methods);
+      break;
+    }
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      addObject(writer, (Obj*)closure->function);
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        addObject(writer, (Obj*)closure->upvalues[i]);
+      }
+      for (int i = 0; i < closure->captureCount; i++) {
+        addValue(writer, closure->captures[i]);
+      }
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      addObject(writer, (Obj*)function->name);
+      for (int i = 0; i < function->chunk.constants.count; i++) {
+        addValue(writer, function->chunk.constants.values[i]);
+      }
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = (ObjInstance*)object;
+      addObject(writer, (Obj*)instance->klass);
+      addTable(writer, &instance->fields);
+      break;
+    }
+    case OBJ_LIST: {
+      ValueArray* items = &((ObjList*)object)->items;
+      for (int i = 0; i < items->count; i++) {
+        addValue(writer, items->values[i]);
+      }
+      break;
+    }
+    case OBJ_MAP: {
+      ValueTable* table = &((ObjMap*)object)->table;
+      for (int i = 0; i < table->capacity; i++) {
+        ValueEntry* entry = &table->entries[i];
+        if (!valueTableIsLive(entry)) continue;
+        addValue(writer, entry->key);
+        addValue(writer, entry->value);
+      }
+      break;
+    }
+    case OBJ_NATIVE: {
+      ObjNative* native = (ObjNative*)object;
+      if (native->name == NULL) writer->out.failed = true;
+      addObject(writer, (Obj*)native->name);
+      break;
+    }
+    case OBJ_UPVALUE: {
+      // Once the script has finished, every upvalue is closed.
+      ObjUpvalue* upvalue = (ObjUpvalue*)object;
+      if (upvalue->location != &upvalue->closed) writer->out.failed = true;
+      addValue(writer, upvalue->closed);
+      break;
+    }
+    case OBJ_FLOAT_ARRAY:
+    case OBJ_STRING:
+      break;
+  }
+}
+
+// Shells of other objects refer to strings and functions, so those
+// need to come first.
+static bool isLeafShell(Obj* object) {
+  return object->type == OBJ_STRING || object->type == OBJ_FUNCTION;
+}
+
+static void orderObjects(ImageWriter* writer) {
+  HeapIndex* heap = &writer->heap;
+  Obj** ordered = (Obj**)malloc(sizeof(Obj*) * (heap->count + 1));
+  if (ordered == NULL) {
+    writer->out.failed = true;
+    return;
+  }
+
+  int count = 0;
+  for (int i = 0; i < heap->count; i++) {
+    if (isLeafShell(heap->objects[i])) ordered[count++] = heap->objects[i];
+  }
+  for (int i = 0; i < heap->count; i++) {
+    if (!isLeafShell(heap->objects[i])) ordered[count++] = heap->objects[i];
+  }
+
+  memcpy(heap->objects, ordered, sizeof(Obj*) * heap->count);
+  free(ordered);
+  if (!rehashHeap(heap, heap->slotCapacity)) writer->out.failed = true;
+}
+
+static void writeValue(ImageWriter* writer, Value value) {
+  if (IS_OBJ(value)) {
+    writeTag(&writer->out, CONSTANT_OBJECT);
+    writeInt(&writer->out, objectIndex(&writer->heap, AS_OBJ(value)));
+  } else {
+    writeConstant(&writer->out, value);
+  }
+}
+
+static void writeReference(ImageWriter* writer, Obj* object) {
+  writeInt(&writer->out, objectIndex(&writer->heap, object));
+}
+
+static void writeTable(ImageWriter* writer, Table* table) {
+  // The table's count includes tombstones, which aren't written.
+  int count = 0;
+  for (int i = 0; i < table->capacity; i++) {
+    if (table->entries[i].key != NULL) count++;
+  }
+
+  writeInt(&writer->out, count);
+  for (int i = 0; i < table->capacity; i++) {
+    Entry* entry = &table->entries[i];
+    if (entry->key == NULL) continue;
+    writeReference(writer, (Obj*)entry->key);
+    writeValue(writer, entry->value);
+  }
+}
+
+// Writes what the loader needs to allocate [object].
+static void writeShell(ImageWriter* writer, Obj* object) {
+  Writer* out = &writer->out;
+  uint8_t type = (uint8_t)object->type;
+  writeBytes(out, &type, 1);
+
+  switch (object->type) {
+    case OBJ_CLASS:
+      writeReference(writer, (Obj*)((ObjClass*)object)->name);
+      break;
+    case OBJ_CLOSURE:
+      writeReference(writer, (Obj*)((ObjClosure*)object)->function);
+      break;
+    case OBJ_FLOAT_ARRAY:
+      writeInt(out, ((ObjFloatArray*)object)->count);
+      break;
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      writeInt(out, function->arity);
+      writeInt(out, function->upvalueCount);
+      writeInt(out, function->captureCount);
+      writeInt(out, function->slotCount);
+      break;
+    }
+    case OBJ_NATIVE:
+      writeReference(writer, (Obj*)((ObjNative*)object)->name);
+      break;
+    case OBJ_STRING: {
+      ObjString* string = (ObjString*)object;
+      writeString(out, string->chars, string->length);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// Writes the fields the shell didn't cover.
+static void writeBody(ImageWriter* writer, Obj* object) {
+  Writer* out = &writer->out;
+  switch (object->type) {
+    case OBJ_BOUND_METHOD: {
+      ObjBoundMethod* bound = (ObjBoundMethod*)object;
+      writeValue(writer, bound->receiver);
+      writeReference(writer, (Obj*)bound->method);
+      break;
+    }
+    case OBJ_CLASS:
+      writeTable(writer, &((ObjClass*)object)->methods);
+      break;
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        writeReference(writer, (Obj*)closure->upvalues[i]);
+      }
+      for (int i = 0; i < closure->captureCount; i++) {
+        writeValue(writer, closure->captures[i]);
+      }
+      break;
+    }
+    case OBJ_FLOAT_ARRAY: {
+      ObjFloatArray* array = (ObjFloatArray*)object;
+      writeBytes(out, array->values, sizeof(double) * array->count);
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      Chunk* chunk = &function->chunk;
+      writeReference(writer, (Obj*)function->name);
+      writeInt(out, chunk->count);
+      writeBytes(out, chunk->code, chunk->count);
+      writeInt(out, chunk->lineCount);
+      writeBytes(out, chunk->lines, sizeof(LineStart) * chunk->lineCount);
+      writeInt(out, chunk->constants.count);
+      for (int i = 0; i < chunk->constants.count; i++) {
+        writeValue(writer, chunk->constants.values[i]);
+      }
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = (ObjInstance*)object;
+      writeReference(writer, (Obj*)instance->klass);
+      writeTable(writer, &instance->fields);
+      break;
+    }
+    case OBJ_LIST: {
+      ValueArray* items = &((ObjList*)object)->items;
+      writeInt(out, items->count);
+      for (int i = 0; i < items->count; i++) {
+        writeValue(writer, items->values[i]);
+      }
+      break;
+    }
+    case OBJ_MAP: {
+      ValueTable* table = &((ObjMap*)object)->table;
+      writeInt(out, table->count);
+      for (int i = 0; i < table->capacity; i++) {
+        ValueEntry* entry = &table->entries[i];
+        if (!valueTableIsLive(entry)) continue;
+        writeValue(writer, entry->key);
+        writeValue(writer, entry->value);
+      }
+      break;
+    }
+    case OBJ_UPVALUE:
+      writeValue(writer, ((ObjUpvalue*)object)->closed);
+      break;
+    case OBJ_NATIVE:
+    case OBJ_STRING:
+      break;
+  }
+}
+
+bool saveImage(const char* path) {
+  ImageWriter writer;
+  memset(&writer, 0, sizeof(writer));
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IMAGE_MAGIC, 4);
+  header.version = CACHE_VERSION;
+  header.fingerprint = CACHE_FINGERPRINT;
+  writeBytes(&writer.out, &header, sizeof(header));
+
+  // Find everything reachable from the globals. The object list doubles
+  // as the worklist.
+  addTable(&writer, &vm.globals);
+  for (int i = 0; i < writer.heap.count && !writer.out.failed; i++) {
+    addReferences(&writer, writer.heap.objects[i]);
+  }
+  orderObjects(&writer);
+
+  writeInt(&writer.out, writer.heap.count);
+  for (int i = 0; i < writer.heap.count; i++) {
+    writeShell(&writer, writer.heap.objects[i]);
+  }
+  for (int i = 0; i < writer.heap.count; i++) {
+    writeBody(&writer, writer.heap.objects[i]);
+  }
+  writeTable(&writer, &vm.globals);
+
+  bool saved = false;
+  if (!writer.out.failed) {
+    FILE* file = fopen(path, "wb");
+    if (file != NULL) {
+      size_t written = fwrite(writer.out.bytes, 1, writer.out.count, file);
+      saved = fclose(file) == 0 && written == writer.out.count;
+      if (!saved) remove(path);
+    }
+  }
+
+  free(writer.out.bytes);
+  free(writer.heap.objects);
+  free(writer.heap.slots);
+  return saved;
+}
+
+typedef struct {
+  Reader in;
+  // Every object loaded so far, in index order. It also keeps them
+  // from being collected while the image is half built.
+  ObjList* objects;
+} ImageReader;
+
+static void addLoaded(ImageReader* reader, Obj* object) {
+  push(OBJ_VAL(object));
+  writeValueArray(&reader->objects->items, OBJ_VAL(object));
+  pop();
+}
+
+// Returns the object at [index] if it has [type].
+static Obj* objectAt(ImageReader* reader, int index, ObjType type) {
+  if (reader->in.failed || index < 0 ||
+      index >= reader->objects->items.count) {
+    reader->in.failed = true;
+    return NULL;
+  }
+
+  Obj* object = AS_OBJ(reader->objects->items.values[index]);
+  if (object->type != type) {
+    reader->in.failed = true;
+    return NULL;
+  }
+  return object;
+}
+
+static Obj* readReference(ImageReader* reader, ObjType type) {
+  return objectAt(reader, readInt(&reader->in), type);
+}
+
+static Value readImageValue(ImageReader* reader) {
+  const uint8_t* tag = readBytes(&reader->in, 1);
+  if (tag == NULL) return NIL_VAL;
+
+  Value value = NIL_VAL;
+  if (readSimpleValue(&reader->in, *tag, &value)) return value;
+
+  int index = readInt(&reader->in);
+  if (*tag != CONSTANT_OBJECT || index < 0 ||
+      index >= reader->objects->items.count) {
+    reader->in.failed = true;
+    return NIL_VAL;
+  }
+  return reader->objects->items.values[index];
+}
+
+// Reads [table] entries until [count] are read or the image is bad.
+static void readTable(ImageReader* reader, Table* table) {
+  int count = readInt(&reader->in);
+  for (int i = 0; i < count && !reader->in.failed; i++) {
+    ObjString* key = (ObjString*)readReference(reader, OBJ_STRING);
+    Value value = readImageValue(reader);
+    if (!reader->in.failed) tableSet(table, key, value);
+  }
+}
+
+static Obj* readShell(ImageReader* reader) {
+  const uint8_t* type = readBytes(&reader->in, 1);
+  if (type == NULL) return NULL;
+
+  switch (*type) {
+    case OBJ_BOUND_METHOD:
+      return (Obj*)newBoundMethod(NIL_VAL, NULL);
+    case OBJ_CLASS: {
+      Obj* name = readReference(reader, OBJ_STRING);
+      if (name == NULL) return NULL;
+      return (Obj*)newClass((ObjString*)name);
+    }
+    case OBJ_CLOSURE: {
+      Obj* function = readReference(reader, OBJ_FUNCTION);
+      if (function == NULL) return NULL;
+      return (Obj*)newClosure((ObjFunction*)function);
+    }
+    case OBJ_FLOAT_ARRAY: {
+      int count = readInt(&reader->in);
+      if (reader->in.failed || count < 0) return NULL;
+      return (Obj*)newFloatArray(count);
+    }
+    case OBJ_FUNCTION: {
+      int arity = readInt(&reader->in);
+      int upvalueCount = readInt(&reader->in);
+      int captureCount = readInt(&reader->in);
+      int slotCount = readInt(&reader->in);
+      if (reader->in.failed || upvalueCount < 0 || captureCount < 0) {
+        return NULL;
+      }
+
+      ObjFunction* function = newFunction();
+      function->arity = arity;
+      function->upvalueCount = upvalueCount;
+      function->captureCount = captureCount;
+      function->slotCount = slotCount;
+      return (Obj*)function;
+    }
+    case OBJ_INSTANCE:
+      return (Obj*)newInstance(NULL);
+    case OBJ_LIST:
+      return (Obj*)newList();
+    case OBJ_MAP:
+      return (Obj*)newMap();
+    case OBJ_NATIVE: {
+      // Natives can't be saved, so bind to the one this VM defined
+      // under the same name.
+      Obj* name = readReference(reader, OBJ_STRING);
+      Value native;
+      if (name == NULL ||
+          !tableGet(&vm.globals, (ObjString*)name, &native) ||
+          !IS_NATIVE(native)) {
+        return NULL;
+      }
+      return AS_OBJ(native);
+    }
+    case OBJ_STRING: {
+      int length;
+      const char* chars = readString(&reader->in, &length);
+      if (chars == NULL) return NULL;
+      return (Obj*)copyString(chars, length);
+    }
+    case OBJ_UPVALUE: {
+      ObjUpvalue* upvalue = newUpvalue(NULL);
+      upvalue->location = &upvalue->closed;
+      return (Obj*)upvalue;
+    }
+    default:
+      return NULL;
+  }
+}
+
+static void readFunctionBody(ImageReader* reader, ObjFunction* function) {
+  Reader* in = &reader->in;
+  int nameIndex = readInt(in);
+  if (nameIndex != -1) {
+    function->name = (ObjString*)objectAt(reader, nameIndex, OBJ_STRING);
+  }
+
+  int count = readInt(in);
+  if (count < 0) in->failed = true;
+  const uint8_t* code = readBytes(in, count);
+  int lineCount = readInt(in);
+  if (lineCount < 0 || (count > 0 && lineCount == 0)) in->failed = true;
+  const uint8_t* lines = readBytes(in, sizeof(LineStart) * lineCount);
+  if (in->failed) return;
+
+  function->chunk.code = ALLOCATE(uint8_t, count);
+  memcpy(function->chunk.code, code, count);
+  function->chunk.capacity = count;
+  function->chunk.count = count;
+  function->chunk.lines = ALLOCATE(LineStart, lineCount);
+  memcpy(function->chunk.lines, lines, sizeof(LineStart) * lineCount);
+  function->chunk.lineCapacity = lineCount;
+  function->chunk.lineCount = lineCount;
+
+  int constantCount = readInt(in);
+  for (int i = 0; i < constantCount && !in->failed; i++) {
+    Value value = readImageValue(reader);
+    if (!in->failed) addConstant(&function->chunk, value);
+  }
+  if (!in->failed) packChunk(&function->chunk);
+}
+
+static void readBody(ImageReader* reader, Obj* object) {
+  Reader* in = &reader->in;
+  switch (object->type) {
+    case OBJ_BOUND_METHOD: {
+      ObjBoundMethod* bound = (ObjBoundMethod*)object;
+      bound->receiver = readImageValue(reader);
+      bound->method = (ObjClosure*)readReference(reader, OBJ_CLOSURE);
+      break;
+    }
+    case OBJ_CLASS:
+      readTable(reader, &((ObjClass*)object)->methods);
+      break;
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        closure->upvalues[i] =
+            (ObjUpvalue*)readReference(reader, OBJ_UPVALUE);
+      }
+      for (int i = 0; i < closure->captureCount; i++) {
+        closure->captures[i] = readImageValue(reader);
+      }
+      break;
+    }
+    case OBJ_FLOAT_ARRAY: {
+      ObjFloatArray* array = (ObjFloatArray*)object;
+      const uint8_t* values =
+          readBytes(in, sizeof(double) * array->count);
+      if (values != NULL) {
+        memcpy(array->values, values, sizeof(double) * array->count);
+      }
+      break;
+    }
+    case OBJ_FUNCTION:
+      readFunctionBody(reader, (ObjFunction*)object);
+      break;
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = (ObjInstance*)object;
+      instance->klass = (ObjClass*)readReference(reader, OBJ_CLASS);
+      readTable(reader, &instance->fields);
+      break;
+    }
+    case OBJ_LIST: {
+      ObjList* list = (ObjList*)object;
+      int count = readInt(in);
+      for (int i = 0; i < count && !in->failed; i++) {
+        Value value = readImageValue(reader);
+        if (!in->failed) writeValueArray(&list->items, value);
+      }
+      break;
+    }
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      int count = readInt(in);
+      for (int i = 0; i < count && !in->failed; i++) {
+        Value key = readImageValue(reader);
+        Value value = readImageValue(reader);
+        if (!in->failed) valueTableSet(&map->table, key, value);
+      }
+      break;
+    }
+    case OBJ_UPVALUE:
+      ((ObjUpvalue*)object)->closed = readImageValue(reader);
+      break;
+    case OBJ_NATIVE:
+    case OBJ_STRING:
+      break;
+  }
+}
+
+bool loadImage(const char* path) {
+  size_t size = 0;
+  const uint8_t* bytes = mapFile(path, &size);
+  if (bytes == NULL) return false;
+
+  CacheHeader expected;
+  memset(&expected, 0, sizeof(expected));
+  memcpy(expected.magic, IMAGE_MAGIC, 4);
+  expected.version = CACHE_VERSION;
+  expected.fingerprint = CACHE_FINGERPRINT;
+  if (size < sizeof(CacheHeader) ||
+      memcmp(bytes, &expected, sizeof(CacheHeader)) != 0) {
+    unmapFile(bytes, size);
+    return false;
+  }
+
+  ImageReader reader;
+  reader.in.current = bytes + sizeof(CacheHeader);
+  reader.in.end = bytes + size;
+  reader.in.failed = false;
+  reader.objects = newList();
+  push(OBJ_VAL(reader.objects));
+
+  int count = readInt(&reader.in);
+  for (int i = 0; i < count && !reader.in.failed; i++) {
+    Obj* object = readShell(&reader);
+    if (object == NULL) {
+      reader.in.failed = true;
+    } else {
+      addLoaded(&reader, object);
+    }
+  }
+
+  for (int i = 0; i < count && !reader.in.failed; i++) {
+    readBody(&reader, AS_OBJ(reader.objects->items.values[i]));
+  }
+
+  // The globals go last so that natives are rebound before a script's
+  // own definitions of those names replace them.
+  readTable(&reader, &vm.globals);
+
+  bool loaded = !reader.in.failed && reader.in.current == reader.in.end;
+  pop();
+  unmapFile(bytes, size);
+  return loaded;
+}
+//< Optimization omit
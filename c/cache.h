@@ -0,0 +1,22 @@
+//> Optimization omit
+#ifndef clox_cache_h
+#define clox_cache_h
+
+#include "object.h"
+
+// Compiled scripts can be cached in a ".loxc" file next to the source.
+// The cache records a hash of the source it was compiled from, so an
+// edited script is recompiled instead of running stale bytecode.
+ObjFunction* loadCache(const char* path, const char* source);
+void writeCache(const char* path, const char* source,
+                ObjFunction* function);
+
+// A heap image is a snapshot of the globals and everything reachable
+// from them, saved after a script has run so that later runs can skip
+// its setup. loadImage() must be called right after initVM(). If it
+// fails, the VM may be left partly loaded.
+bool saveImage(const char* path);
+bool loadImage(const char* path);
+
+#endif
+//< Optimization omit
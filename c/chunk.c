@@ -1,5 +1,9 @@
 //> Chunks of Bytecode chunk-c
 #include <stdlib.h>
+//> Optimization omit
+#include <math.h>
+#include <string.h>
+//< Optimization omit
 
 #include "chunk.h"
 //> chunk-c-include-memory
@@ -15,16 +19,59 @@ void initChunk(Chunk* chunk) {
   chunk->code = NULL;
 //> chunk-null-lines
   chunk->lines = NULL;
+//> Optimization omit
+  chunk->lineCount = 0;
+  chunk->lineCapacity = 0;
+//< Optimization omit
 //< chunk-null-lines
 //> chunk-init-constant-array
   initValueArray(&chunk->constants);
 //< chunk-init-constant-array
+//> Optimization omit
+  chunk->block = NULL;
+  chunk->words = NULL;
+  chunk->wordOffsets = NULL;
+  chunk->wordCount = 0;
+//< Optimization omit
 }
+//> Optimization omit
+
+// Packed chunks start on a cache line, so the first constants and the
+// code after them share as few lines as possible.
+#define CHUNK_ALIGNMENT 64
+
+// Where the line runs start in a packed chunk, after the constants
+// and the code.
+static size_t linesOffset(Chunk* chunk) {
+  size_t offset = sizeof(Value) * chunk->constants.count + chunk->count;
+  return (offset + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+static size_t blockSize(Chunk* chunk) {
+  return CHUNK_ALIGNMENT - 1 + linesOffset(chunk) +
+      sizeof(LineStart) * chunk->lineCount;
+}
+//< Optimization omit
 //> free-chunk
 void freeChunk(Chunk* chunk) {
+//> Optimization omit
+  FREE_ARRAY(Word, chunk->words, chunk->wordCount);
+  FREE_ARRAY(int, chunk->wordOffsets, chunk->wordCount);
+  if (chunk->block != NULL) {
+    reallocate(chunk->block, blockSize(chunk), 0);
+    initChunk(chunk);
+    return;
+  }
+
+//< Optimization omit
   FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
 //> chunk-free-lines
+/* Chunks of Bytecode chunk-free-lines < Optimization omit
   FREE_ARRAY(int, chunk->lines, chunk->capacity);
+*/
+//> Optimization omit
+  FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
+//< Optimization omit
 //< chunk-free-lines
 //> chunk-free-constants
   freeValueArray(&chunk->constants);
@@ -45,14 +92,40 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
     chunk->code = GROW_ARRAY(uint8_t, chunk->code,
         oldCapacity, chunk->capacity);
 //> write-chunk-line
+/* Chunks of Bytecode write-chunk-line < Optimization omit
     chunk->lines = GROW_ARRAY(int, chunk->lines,
         oldCapacity, chunk->capacity);
+*/
 //< write-chunk-line
   }
 
   chunk->code[chunk->count] = byte;
 //> chunk-write-line
+/* Chunks of Bytecode chunk-write-line < Optimization omit
   chunk->lines[chunk->count] = line;
+*/
+//> Optimization omit
+  // The compiler sometimes discards code it just wrote, so drop any
+  // runs that started in it.
+  while (chunk->lineCount > 0 &&
+         chunk->lines[chunk->lineCount - 1].offset >= chunk->count) {
+    chunk->lineCount--;
+  }
+
+  if (chunk->lineCount == 0 ||
+      chunk->lines[chunk->lineCount - 1].line != line) {
+    if (chunk->lineCapacity < chunk->lineCount + 1) {
+      int oldCapacity = chunk->lineCapacity;
+      chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
+      chunk->lines = GROW_ARRAY(LineStart, chunk->lines,
+          oldCapacity, chunk->lineCapacity);
+    }
+
+    LineStart* start = &chunk->lines[chunk->lineCount++];
+    start->offset = chunk->count;
+    start->line = line;
+  }
+//< Optimization omit
 //< chunk-write-line
   chunk->count++;
 }
@@ -69,3 +142,196 @@ int addConstant(Chunk* chunk, Value value) {
   return chunk->constants.count - 1;
 }
 //< add-constant
+//> Optimization omit
+int getLine(Chunk* chunk, int offset) {
+  // Find the last run that starts at or before [offset].
+  int low = 0;
+  int high = chunk->lineCount - 1;
+  while (low < high) {
+    int middle = low + (high - low + 1) / 2;
+    if (chunk->lines[middle].offset > offset) {
+      high = middle - 1;
+    } else {
+      low = middle;
+    }
+  }
+
+  return chunk->lines[low].line;
+}
+
+// Whether identical copies of [value] can share a constant. Only
+// strings and numbers repeat often. NaN can't be a ValueTable key, and
+// -0 would be taken for 0.
+static bool isShareable(Value value) {
+  if (IS_ANY_STRING(value)) return true;
+  if (!IS_NUMBER(value)) return false;
+
+  double number = AS_NUMBER(value);
+  return !isnan(number) && !(number == 0 && signbit(number));
+}
+
+int addSharedConstant(Chunk* chunk, ValueTable* indexes, Value value) {
+  if (!isShareable(value)) return addConstant(chunk, value);
+
+  Value index;
+  if (valueTableGet(indexes, value, &index)) return (int)AS_NUMBER(index);
+
+  int constant = addConstant(chunk, value);
+  valueTableSet(indexes, value, NUMBER_VAL(constant));
+  return constant;
+}
+
+void removeLastConstant(Chunk* chunk, ValueTable* indexes) {
+  Value value = chunk->constants.values[--chunk->constants.count];
+  if (isShareable(value)) valueTableDelete(indexes, value);
+}
+
+void packChunk(Chunk* chunk) {
+  uint8_t* block = (uint8_t*)reallocate(NULL, 0, blockSize(chunk));
+  size_t misalignment = (uintptr_t)block % CHUNK_ALIGNMENT;
+  uint8_t* start = block +
+      (misalignment == 0 ? 0 : CHUNK_ALIGNMENT - misalignment);
+
+  Value* constants = (Value*)start;
+  uint8_t* code = start + sizeof(Value) * chunk->constants.count;
+  LineStart* lines = (LineStart*)(start + linesOffset(chunk));
+  if (chunk->constants.count > 0) {
+    memcpy(constants, chunk->constants.values,
+           sizeof(Value) * chunk->constants.count);
+  }
+  if (chunk->count > 0) memcpy(code, chunk->code, chunk->count);
+  if (chunk->lineCount > 0) {
+    memcpy(lines, chunk->lines, sizeof(LineStart) * chunk->lineCount);
+  }
+
+  FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+  FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
+  FREE_ARRAY(Value, chunk->constants.values, chunk->constants.capacity);
+
+  chunk->block = block;
+  chunk->code = code;
+  chunk->capacity = chunk->count;
+  chunk->lines = lines;
+  chunk->lineCapacity = chunk->lineCount;
+  chunk->constants.values = constants;
+  chunk->constants.capacity = chunk->constants.count;
+}
+//< Optimization omit
+//> Optimization omit
+
+#define PAIR(name, a, b) {2, {OP_##a, OP_##b, 0}},
+#define TRIPLE(name, a, b, c) {3, {OP_##a, OP_##b, OP_##c}},
+const Superinstruction superinstructions[] = {
+  SUPERINSTRUCTIONS(PAIR, TRIPLE)
+};
+#undef PAIR
+#undef TRIPLE
+
+const int superinstructionCount =
+    (int)(sizeof(superinstructions) / sizeof(Superinstruction));
+
+int superinstructionLength(uint8_t instruction) {
+  const Superinstruction* super =
+      &superinstructions[instruction - FIRST_SUPERINSTRUCTION];
+  int length = 1;
+  for (int i = 0; i < super->count; i++) {
+    switch (super->parts[i]) {
+      case OP_CONSTANT:
+      case OP_GET_LOCAL:
+      case OP_SET_LOCAL:
+      case OP_SET_LOCAL_POP:
+      case OP_GET_UPVALUE:
+        length += 1;
+        break;
+      default:
+        break;
+    }
+  }
+  return length;
+}
+
+// How many bytes the variables captured by an OP_CLOSURE for the
+// function in [constant] take, starting at [offset].
+static int captureListLength(Chunk* chunk, int offset, int constant) {
+  ObjFunction* function = AS_FUNCTION(chunk->constants.values[constant]);
+  int count = function->upvalueCount + function->captureCount;
+  int length = 0;
+  for (int i = 0; i < count; i++) {
+    length += chunk->code[offset + length] & CAPTURE_WIDE ? 3 : 2;
+  }
+  return length;
+}
+
+int instructionLength(Chunk* chunk, int offset) {
+  if (chunk->code[offset] >= FIRST_SUPERINSTRUCTION) {
+    return superinstructionLength(chunk->code[offset]);
+  }
+
+  switch (chunk->code[offset]) {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_SET_LOCAL_POP:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_CAPTURE:
+    case OP_GET_OUTER:
+    case OP_SET_OUTER:
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_BUILD_LIST:
+    case OP_GET_SUPER:
+    case OP_CALL:
+    case OP_CLASS:
+    case OP_METHOD:
+      return 2;
+
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_JUMP_FAR:
+    case OP_JUMP_IF_FALSE_FAR:
+    case OP_LOOP:
+    case OP_LOOP_FAR:
+    case OP_INVOKE:
+    case OP_SUPER_INVOKE:
+      return 3;
+
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+    case OP_JUMP_IF_NOT_GREATER:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL:
+      return 3;
+
+    case OP_GUARD_CALL:
+    case OP_GUARD_INVOKE:
+    case OP_JUMP_IF_NOT_LESS_CONSTANT:
+    case OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT:
+    case OP_JUMP_IF_NOT_GREATER_CONSTANT:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT:
+      return 4;
+
+    case OP_CLOSURE:
+      return 2 + captureListLength(chunk, offset + 2,
+                                   chunk->code[offset + 1]);
+
+    case OP_WIDE: {
+      uint8_t instruction = chunk->code[offset + 1];
+      if (instruction == OP_INVOKE || instruction == OP_SUPER_INVOKE) {
+        return 5;
+      } else if (instruction == OP_CLOSURE) {
+        int constant = (chunk->code[offset + 2] << 8) |
+                       chunk->code[offset + 3];
+        return 4 + captureListLength(chunk, offset + 4, constant);
+      }
+      return 4;
+    }
+
+    default:
+      return 1;
+  }
+}
+//< Optimization omit
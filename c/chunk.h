@@ -6,12 +6,21 @@
 //> chunk-h-include-value
 #include "value.h"
 //< chunk-h-include-value
+//> Optimization omit
+#include "superinstructions.h"
+#include "table.h"
+//< Optimization omit
 //> op-enum
 
 typedef enum {
 //> op-constant
   OP_CONSTANT,
 //< op-constant
+//> Optimization omit
+  // Followed by another instruction whose first operand is two bytes
+  // instead of one.
+  OP_WIDE,
+//< Optimization omit
 //> Types of Values literal-ops
   OP_NIL,
   OP_TRUE,
@@ -25,6 +34,9 @@ typedef enum {
 //< Local Variables get-local-op
 //> Local Variables set-local-op
   OP_SET_LOCAL,
+//> Optimization omit
+  OP_SET_LOCAL_POP,
+//< Optimization omit
 //< Local Variables set-local-op
 //> Global Variables get-global-op
   OP_GET_GLOBAL,
@@ -39,10 +51,20 @@ typedef enum {
   OP_GET_UPVALUE,
   OP_SET_UPVALUE,
 //< Closures upvalue-ops
+//> Optimization omit
+  OP_GET_CAPTURE,
+  OP_GET_OUTER,
+  OP_SET_OUTER,
+//< Optimization omit
 //> Classes and Instances property-ops
   OP_GET_PROPERTY,
   OP_SET_PROPERTY,
 //< Classes and Instances property-ops
+//> Optimization omit
+  OP_BUILD_LIST,
+  OP_GET_INDEX,
+  OP_SET_INDEX,
+//< Optimization omit
 //> Superclasses get-super-op
   OP_GET_SUPER,
 //< Superclasses get-super-op
@@ -50,6 +72,11 @@ typedef enum {
   OP_EQUAL,
   OP_GREATER,
   OP_LESS,
+//> Optimization omit
+  OP_NOT_EQUAL,
+  OP_GREATER_EQUAL,
+  OP_LESS_EQUAL,
+//< Optimization omit
 //< Types of Values comparison-ops
 //> A Virtual Machine binary-ops
   OP_ADD,
@@ -71,9 +98,30 @@ typedef enum {
 //< Jumping Back and Forth jump-op
 //> Jumping Back and Forth jump-if-false-op
   OP_JUMP_IF_FALSE,
+//> Optimization omit
+  OP_JUMP_IF_TRUE,
+  // Jumps too far for two bytes. The operand is the index of a constant
+  // holding the offset.
+  OP_JUMP_FAR,
+  OP_JUMP_IF_FALSE_FAR,
+  // A comparison and the conditional jump on its result. They pop the
+  // operands and jump if the comparison is false. The _CONSTANT forms
+  // take the right operand from the constant after the offset.
+  OP_JUMP_IF_NOT_LESS,
+  OP_JUMP_IF_NOT_LESS_EQUAL,
+  OP_JUMP_IF_NOT_GREATER,
+  OP_JUMP_IF_NOT_GREATER_EQUAL,
+  OP_JUMP_IF_NOT_LESS_CONSTANT,
+  OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT,
+  OP_JUMP_IF_NOT_GREATER_CONSTANT,
+  OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT,
+//< Optimization omit
 //< Jumping Back and Forth jump-if-false-op
 //> Jumping Back and Forth loop-op
   OP_LOOP,
+//> Optimization omit
+  OP_LOOP_FAR,
+//< Optimization omit
 //< Jumping Back and Forth loop-op
 //> Calls and Functions op-call
   OP_CALL,
@@ -81,6 +129,10 @@ typedef enum {
 //> Methods and Initializers invoke-op
   OP_INVOKE,
 //< Methods and Initializers invoke-op
+//> Optimization omit
+  OP_GUARD_CALL,
+  OP_GUARD_INVOKE,
+//< Optimization omit
 //> Superclasses super-invoke-op
   OP_SUPER_INVOKE,
 //< Superclasses super-invoke-op
@@ -91,6 +143,9 @@ typedef enum {
   OP_CLOSE_UPVALUE,
 //< Closures close-upvalue-op
   OP_RETURN,
+//> Optimization omit
+  OP_RETURN_NIL,
+//< Optimization omit
 //> Classes and Instances class-op
   OP_CLASS,
 //< Classes and Instances class-op
@@ -98,10 +153,59 @@ typedef enum {
   OP_INHERIT,
 //< Superclasses inherit-op
 //> Methods and Initializers method-op
+/* Methods and Initializers method-op < Optimization omit
   OP_METHOD
+*/
+//> Optimization omit
+  OP_METHOD,
+//< Optimization omit
 //< Methods and Initializers method-op
+//> Optimization omit
+  // The superinstructions come last so that regenerating them leaves
+  // the other opcodes alone.
+#define SUPERINSTRUCTION_OP(name, ...) OP_##name,
+  SUPERINSTRUCTIONS(SUPERINSTRUCTION_OP, SUPERINSTRUCTION_OP)
+#undef SUPERINSTRUCTION_OP
+//< Optimization omit
 } OpCode;
 //< op-enum
+//> Optimization omit
+
+// Set in the first byte of a variable OP_CLOSURE captures, along with
+// whether it is local, if its index takes two bytes.
+#define CAPTURE_WIDE 2
+
+// Every byte from [offset] up to the next LineStart's offset was
+// compiled from [line].
+typedef struct {
+  int offset;
+  int line;
+} LineStart;
+
+// A slot in the decoded form of a chunk's code, which is what the VM
+// runs. Each instruction takes a word for its opcode and one for each
+// operand, so operands never need to be pieced together from bytes.
+typedef union {
+  // An opcode, or an operand decoded to its full value. Jump offsets
+  // count words.
+  uint32_t value;
+  // A constant operand, resolved to where the constant is stored.
+  Value* constant;
+} Word;
+
+#define FIRST_SUPERINSTRUCTION (OP_METHOD + 1)
+
+// The two or three instructions a superinstruction does, in order.
+// Their operands follow it in the same order.
+typedef struct {
+  int count;
+  uint8_t parts[3];
+} Superinstruction;
+
+// Indexed by opcode minus FIRST_SUPERINSTRUCTION.
+extern const Superinstruction superinstructions[];
+extern const int superinstructionCount;
+//< Optimization omit
 //> chunk-struct
 
 typedef struct {
@@ -111,11 +215,31 @@ typedef struct {
 //< count-and-capacity
   uint8_t* code;
 //> chunk-lines
+/* Chunks of Bytecode chunk-lines < Optimization omit
   int* lines;
+*/
+//> Optimization omit
+  // Run-length encoded, since most lines compile to several bytes.
+  // Lines are only looked up for errors and disassembly.
+  int lineCount;
+  int lineCapacity;
+  LineStart* lines;
+//< Optimization omit
 //< chunk-lines
 //> chunk-constants
   ValueArray constants;
 //< chunk-constants
+//> Optimization omit
+  // Once compiled, the constants, code and lines are copied into this
+  // one allocation and the arrays point into it. NULL until then.
+  void* block;
+  // Decoded from the code when its function is first called, and NULL
+  // until then. [wordOffsets] has the offset in [code] each word was
+  // decoded from, to find lines and disassemble.
+  Word* words;
+  int* wordOffsets;
+  int wordCount;
+//< Optimization omit
 } Chunk;
 //< chunk-struct
 //> init-chunk-h
@@ -134,5 +258,23 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line);
 //> add-constant-h
 int addConstant(Chunk* chunk, Value value);
 //< add-constant-h
+//> Optimization omit
+// The line the byte at [offset] was compiled from.
+int getLine(Chunk* chunk, int offset);
+// Returns the index of a constant identical to [value] that [indexes]
+// has seen added to [chunk], or else adds it.
+int addSharedConstant(Chunk* chunk, ValueTable* indexes, Value value);
+// Removes the last constant, which must have been added by
+// addSharedConstant() with [indexes].
+void removeLastConstant(Chunk* chunk, ValueTable* indexes);
+// Moves the chunk's arrays into a single, tightly sized block. Nothing
+// can be written to it afterwards, though its code can still be
+// patched in place.
+void packChunk(Chunk* chunk);
+// The length of a superinstruction, counting its operands.
+int superinstructionLength(uint8_t instruction);
+// The length of the instruction at [offset], counting its operands.
+int instructionLength(Chunk* chunk, int offset);
+//< Optimization omit
 
 #endif
@@ -0,0 +1,737 @@
+//> Optimization omit
+#include <stdio.h>
+
+#include "ast.h"
+#include "common.h"
+#include "memory.h"
+#include "peephole.h"
+
+#ifdef DEBUG_PRINT_CODE
+#include "debug.h"
+#endif
+
+typedef struct {
+  uint16_t index;
+  bool isLocal;
+} Capture;
+
+typedef struct Generator {
+  struct Generator* enclosing;
+  FunctionNode* node;
+  ObjFunction* function;
+
+  // The variable in each stack slot. These arrays live in the arena.
+  Decl** locals;
+  int localCount;
+  int localCapacity;
+  Capture* upvalues;
+  int upvalueCapacity;
+  Capture* captures;
+  int captureCapacity;
+
+  // Maps each string and number constant to its index, so each is only
+  // stored once.
+  ValueTable constantIndexes;
+
+  // The line the next instruction is attributed to.
+  int line;
+} Generator;
+
+static Generator* current = NULL;
+static bool hadError;
+
+static Chunk* currentChunk() {
+  return &current->function->chunk;
+}
+
+static void error(Token* token, const char* message) {
+  astError(token, message);
+  hadError = true;
+}
+
+static void emitByte(uint8_t byte) {
+  writeChunk(currentChunk(), byte, current->line);
+}
+
+static void emitBytes(uint8_t byte1, uint8_t byte2) {
+  emitByte(byte1);
+  emitByte(byte2);
+}
+
+// Emits [instruction] with its first operand, in the wide form if the
+// operand doesn't fit in a byte.
+static void emitOperand(uint8_t instruction, int operand) {
+  if (operand > UINT8_MAX) {
+    emitBytes(OP_WIDE, instruction);
+    emitBytes((operand >> 8) & 0xff, operand & 0xff);
+  } else {
+    emitBytes(instruction, (uint8_t)operand);
+  }
+}
+
+// Emits a variable OP_CLOSURE captures.
+static void emitCapture(Capture* capture) {
+  uint8_t isLocal = capture->isLocal ? 1 : 0;
+  if (capture->index > UINT8_MAX) {
+    emitByte(isLocal | CAPTURE_WIDE);
+    emitBytes((capture->index >> 8) & 0xff, capture->index & 0xff);
+  } else {
+    emitBytes(isLocal, (uint8_t)capture->index);
+  }
+}
+
+// Stores a jump offset too big for two bytes in the constant table, for
+// the far form of a jump to load.
+static int farJumpConstant(int offset, Token* end, const char* message) {
+  int constant = addSharedConstant(currentChunk(),
+                                   &current->constantIndexes,
+                                   NUMBER_VAL(offset));
+  if (constant > UINT16_MAX) {
+    error(end, message);
+    return 0;
+  }
+
+  return constant;
+}
+
+static void emitLoop(int loopStart, Token* end) {
+  int offset = currentChunk()->count - loopStart + 3;
+  if (offset > UINT16_MAX) {
+    offset = farJumpConstant(offset, end, "Loop body too large.");
+    emitByte(OP_LOOP_FAR);
+  } else {
+    emitByte(OP_LOOP);
+  }
+
+  emitByte((offset >> 8) & 0xff);
+  emitByte(offset & 0xff);
+}
+
+static int emitJump(uint8_t instruction) {
+  emitByte(instruction);
+  emitByte(0xff);
+  emitByte(0xff);
+  return currentChunk()->count - 2;
+}
+
+static void patchJump(int offset, Token* end) {
+  // -2 to adjust for the bytecode for the jump offset itself.
+  int jump = currentChunk()->count - offset - 2;
+
+  if (jump > UINT16_MAX) {
+    jump = farJumpConstant(jump, end, "Too much code to jump over.");
+    uint8_t* instruction = &currentChunk()->code[offset - 1];
+    *instruction = *instruction == OP_JUMP
+        ? OP_JUMP_FAR : OP_JUMP_IF_FALSE_FAR;
+  }
+
+  currentChunk()->code[offset] = (jump >> 8) & 0xff;
+  currentChunk()->code[offset + 1] = jump & 0xff;
+}
+
+// Guards are jumps followed by the function they check for.
+static int emitGuard(uint8_t instruction, uint8_t function) {
+  int offset = emitJump(instruction);
+  emitByte(function);
+  return offset;
+}
+
+static void patchGuard(int offset, Token* end) {
+  // -3 to adjust for the offset and the function after it.
+  int jump = currentChunk()->count - offset - 3;
+
+  if (jump > UINT16_MAX) {
+    error(end, "Too much code to jump over.");
+  }
+
+  currentChunk()->code[offset] = (jump >> 8) & 0xff;
+  currentChunk()->code[offset + 1] = jump & 0xff;
+}
+
+static void emitReturn() {
+  if (current->node->kind == KIND_INITIALIZER) {
+    emitBytes(OP_GET_LOCAL, 0);
+  } else {
+    emitByte(OP_NIL);
+  }
+
+  emitByte(OP_RETURN);
+}
+
+static int makeConstant(Value value, Token* token) {
+  int constant = addSharedConstant(currentChunk(),
+                                   &current->constantIndexes, value);
+  if (constant > UINT16_MAX) {
+    error(token, "Too many constants in one chunk.");
+    return 0;
+  }
+
+  return constant;
+}
+
+static int identifierConstant(Token* name) {
+  return makeConstant(OBJ_VAL(copyString(name->start, name->length)),
+                      name);
+}
+
+static void emitValue(Value value, Token* token) {
+  if (IS_NIL(value)) {
+    emitByte(OP_NIL);
+  } else if (IS_BOOL(value)) {
+    emitByte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+  } else {
+    emitOperand(OP_CONSTANT, makeConstant(value, token));
+  }
+}
+
+static void addLocal(Decl* decl) {
+  current->locals = (Decl**)astGrow(current->locals,
+      &current->localCapacity, current->localCount, sizeof(Decl*));
+  decl->slot = current->localCount;
+  current->locals[current->localCount++] = decl;
+  if (current->localCount > current->function->slotCount) {
+    current->function->slotCount = current->localCount;
+  }
+}
+
+static void endScope(int localCount) {
+  while (current->localCount > localCount) {
+    Decl* decl = current->locals[--current->localCount];
+    emitByte(decl->isCaptured ? OP_CLOSE_UPVALUE : OP_POP);
+  }
+}
+
+static int addUpvalue(Generator* generator, int index, bool isLocal) {
+  int upvalueCount = generator->function->upvalueCount;
+
+  for (int i = 0; i < upvalueCount; i++) {
+    Capture* upvalue = &generator->upvalues[i];
+    if (upvalue->index == index && upvalue->isLocal == isLocal) {
+      return i;
+    }
+  }
+
+  // The resolver already checked the limit against a superset of
+  // these upvalues.
+  generator->upvalues = (Capture*)astGrow(generator->upvalues,
+      &generator->upvalueCapacity, upvalueCount, sizeof(Capture));
+  generator->upvalues[upvalueCount].isLocal = isLocal;
+  generator->upvalues[upvalueCount].index = (uint16_t)index;
+  return generator->function->upvalueCount++;
+}
+
+static int resolveUpvalue(Generator* generator, Decl* decl) {
+  Generator* enclosing = generator->enclosing;
+  if (decl->function == enclosing->node) {
+    return addUpvalue(generator, decl->slot, true);
+  }
+
+  int upvalue = resolveUpvalue(enclosing, decl);
+  return addUpvalue(generator, upvalue, false);
+}
+
+static int addCapture(Generator* generator, int index, bool isLocal) {
+  int captureCount = generator->function->captureCount;
+
+  for (int i = 0; i < captureCount; i++) {
+    Capture* capture = &generator->captures[i];
+    if (capture->index == index && capture->isLocal == isLocal) {
+      return i;
+    }
+  }
+
+  generator->captures = (Capture*)astGrow(generator->captures,
+      &generator->captureCapacity, captureCount, sizeof(Capture));
+  generator->captures[captureCount].isLocal = isLocal;
+  generator->captures[captureCount].index = (uint16_t)index;
+  return generator->function->captureCount++;
+}
+
+static int resolveCapture(Generator* generator, Decl* decl) {
+  Generator* enclosing = generator->enclosing;
+  if (decl->function == enclosing->node) {
+    return addCapture(generator, decl->slot, true);
+  }
+
+  int capture = resolveCapture(enclosing, decl);
+  return addCapture(generator, capture, false);
+}
+
+static void expression(Node* node);
+static void statement(Node* node);
+static void statements(Node* list);
+static void function(FunctionNode* node);
+
+static void variable(Node* node, bool isSet) {
+  Decl* decl = node->as.variable.decl;
+  uint8_t getOp, setOp;
+  int arg;
+  if (decl == NULL) {
+    arg = identifierConstant(&node->token);
+    getOp = OP_GET_GLOBAL;
+    setOp = OP_SET_GLOBAL;
+  } else if (decl->function == current->node) {
+    arg = decl->slot;
+    getOp = OP_GET_LOCAL;
+    setOp = OP_SET_LOCAL;
+  } else if (isCopied(decl)) {
+    arg = resolveCapture(current, decl);
+    getOp = OP_GET_CAPTURE;
+    setOp = OP_GET_CAPTURE; // Never assigned.
+  } else {
+    arg = resolveUpvalue(current, decl);
+    getOp = OP_GET_UPVALUE;
+    setOp = OP_SET_UPVALUE;
+  }
+
+  current->line = node->line;
+  emitOperand(isSet ? setOp : getOp, arg);
+}
+
+static void arguments(Node* list) {
+  for (Node* node = list; node != NULL; node = node->next) {
+    expression(node);
+  }
+}
+
+// The object [node] compiles to. A guard for an inlined call may refer
+// to it before the function is generated.
+static ObjFunction* functionObject(FunctionNode* node) {
+  if (node->object == NULL) {
+    node->object = newFunction();
+    astRoot(OBJ_VAL(node->object));
+
+    node->object->arity = node->arity;
+    if (node->kind != KIND_SCRIPT) {
+      node->object->name = copyString(node->name.start,
+                                      node->name.length);
+    }
+  }
+  return node->object;
+}
+
+// Emits the end of a call or invoke, once the callee is on the stack.
+static void call(Node* node) {
+  arguments(node->as.access.arguments);
+  current->line = node->line;
+  if (node->type == NODE_CALL) {
+    emitBytes(OP_CALL, (uint8_t)node->as.access.argCount);
+  } else {
+    int name = identifierConstant(&node->token);
+    emitOperand(OP_INVOKE, name);
+    emitByte((uint8_t)node->as.access.argCount);
+  }
+}
+
+static void inlinedCall(Node* node) {
+  Node* original = node->as.inlined.call;
+  expression(original->as.access.object);
+
+  current->line = original->line;
+  ObjFunction* callee = functionObject(node->as.inlined.function);
+  // The optimizer stops inlining before the function's constants could
+  // outgrow a guard's one-byte operand.
+  int constant = makeConstant(OBJ_VAL(callee), &original->token);
+  int guard = emitGuard(original->type == NODE_CALL
+      ? OP_GUARD_CALL : OP_GUARD_INVOKE, (uint8_t)constant);
+
+  // The guard pops the callee if it's the inlined function.
+  for (Node* body = node->as.inlined.body; body != NULL;
+       body = body->next) {
+    expression(body);
+    if (body->next != NULL) emitByte(OP_POP);
+  }
+  int endJump = emitJump(OP_JUMP);
+
+  patchGuard(guard, &original->token);
+  call(original);
+  patchJump(endJump, &original->token);
+}
+
+static void logical(Node* node) {
+  expression(node->as.binary.left);
+
+  if (node->token.type == TOKEN_AND) {
+    int endJump = emitJump(OP_JUMP_IF_FALSE);
+
+    emitByte(OP_POP);
+    expression(node->as.binary.right);
+
+    patchJump(endJump, &node->as.binary.end);
+  } else {
+    int elseJump = emitJump(OP_JUMP_IF_FALSE);
+    int endJump = emitJump(OP_JUMP);
+
+    patchJump(elseJump, &node->as.binary.end);
+    emitByte(OP_POP);
+
+    expression(node->as.binary.right);
+    patchJump(endJump, &node->as.binary.end);
+  }
+}
+
+static void binary(Node* node) {
+  expression(node->as.binary.left);
+  expression(node->as.binary.right);
+
+  current->line = node->line;
+  switch (node->token.type) {
+    case TOKEN_BANG_EQUAL:    emitByte(OP_NOT_EQUAL); break;
+    case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
+    case TOKEN_GREATER:       emitByte(OP_GREATER); break;
+    case TOKEN_GREATER_EQUAL: emitByte(OP_GREATER_EQUAL); break;
+    case TOKEN_LESS:          emitByte(OP_LESS); break;
+    case TOKEN_LESS_EQUAL:    emitByte(OP_LESS_EQUAL); break;
+    case TOKEN_PLUS:          emitByte(OP_ADD); break;
+    case TOKEN_MINUS:         emitByte(OP_SUBTRACT); break;
+    case TOKEN_STAR:          emitByte(OP_MULTIPLY); break;
+    case TOKEN_SLASH:         emitByte(OP_DIVIDE); break;
+    default:
+      return; // Unreachable.
+  }
+}
+
+static void expression(Node* node) {
+  switch (node->type) {
+    case NODE_ASSIGN:
+      expression(node->as.variable.value);
+      variable(node, true);
+      break;
+
+    case NODE_BINARY:
+      binary(node);
+      break;
+
+    case NODE_CALL:
+    case NODE_INVOKE:
+      expression(node->as.access.object);
+      call(node);
+      break;
+
+    case NODE_GET_INDEX:
+      expression(node->as.access.object);
+      expression(node->as.access.index);
+      current->line = node->line;
+      emitByte(OP_GET_INDEX);
+      break;
+
+    case NODE_GET_PROPERTY: {
+      expression(node->as.access.object);
+      current->line = node->line;
+      int name = identifierConstant(&node->token);
+      emitOperand(OP_GET_PROPERTY, name);
+      break;
+    }
+
+    case NODE_INLINE:
+      inlinedCall(node);
+      break;
+
+    case NODE_LIST:
+      arguments(node->as.access.arguments);
+      current->line = node->line;
+      // The items are all on the stack until the list is built.
+      if (current->localCount + node->as.access.argCount >
+          current->function->slotCount) {
+        current->function->slotCount =
+            current->localCount + node->as.access.argCount;
+      }
+      emitOperand(OP_BUILD_LIST, node->as.access.argCount);
+      break;
+
+    case NODE_LITERAL:
+      current->line = node->line;
+      emitValue(node->as.literal, &node->token);
+      break;
+
+    case NODE_LOGICAL:
+      logical(node);
+      break;
+
+    case NODE_SET_INDEX:
+      expression(node->as.access.object);
+      expression(node->as.access.index);
+      expression(node->as.access.value);
+      current->line = node->line;
+      emitByte(OP_SET_INDEX);
+      break;
+
+    case NODE_SET_PROPERTY: {
+      expression(node->as.access.object);
+      expression(node->as.access.value);
+      current->line = node->line;
+      int name = identifierConstant(&node->token);
+      emitOperand(OP_SET_PROPERTY, name);
+      break;
+    }
+
+    case NODE_SUPER_GET: {
+      expression(node->as.access.object);
+      expression(node->as.access.index);
+      current->line = node->line;
+      int name = identifierConstant(&node->token);
+      emitOperand(OP_GET_SUPER, name);
+      break;
+    }
+
+    case NODE_SUPER_INVOKE: {
+      expression(node->as.access.object);
+      arguments(node->as.access.arguments);
+      expression(node->as.access.index);
+      current->line = node->line;
+      int name = identifierConstant(&node->token);
+      emitOperand(OP_SUPER_INVOKE, name);
+      emitByte((uint8_t)node->as.access.argCount);
+      break;
+    }
+
+    case NODE_UNARY:
+      expression(node->as.binary.left);
+      current->line = node->line;
+      emitByte(node->token.type == TOKEN_BANG ? OP_NOT : OP_NEGATE);
+      break;
+
+    case NODE_VARIABLE:
+      variable(node, false);
+      break;
+
+    default:
+      break; // Unreachable.
+  }
+}
+
+static void statements(Node* list) {
+  for (Node* node = list; node != NULL; node = node->next) {
+    statement(node);
+  }
+}
+
+static void block(Node* list) {
+  int localCount = current->localCount;
+  statements(list);
+  endScope(localCount);
+}
+
+static void classDeclaration(Node* node) {
+  current->line = node->line;
+  int nameConstant = identifierConstant(&node->token);
+  emitOperand(OP_CLASS, nameConstant);
+  if (node->as.klass.decl != NULL) {
+    addLocal(node->as.klass.decl);
+  } else {
+    emitOperand(OP_DEFINE_GLOBAL, nameConstant);
+  }
+
+  int localCount = current->localCount;
+  Node* superclass = node->as.klass.superclass;
+  if (superclass != NULL) {
+    expression(superclass);
+    addLocal(node->as.klass.superDecl);
+    expression(node->as.klass.self);
+    current->line = superclass->line;
+    emitByte(OP_INHERIT);
+  }
+
+  expression(node->as.klass.self);
+
+  FunctionNode* method = node->as.klass.methods;
+  for (; method != NULL; method = method->next) {
+    function(method);
+    int name = identifierConstant(&method->name);
+    emitOperand(OP_METHOD, name);
+  }
+  emitByte(OP_POP);
+
+  endScope(localCount);
+}
+
+static void ifStatement(Node* node) {
+  expression(node->as.branch.condition);
+
+  int thenJump = emitJump(OP_JUMP_IF_FALSE);
+  emitByte(OP_POP);
+  if (node->as.branch.thenBranch != NULL) {
+    statement(node->as.branch.thenBranch);
+  }
+
+  int elseJump = emitJump(OP_JUMP);
+
+  patchJump(thenJump, &node->as.branch.thenEnd);
+  emitByte(OP_POP);
+
+  if (node->as.branch.elseBranch != NULL) {
+    statement(node->as.branch.elseBranch);
+  }
+  patchJump(elseJump, &node->as.branch.elseEnd);
+}
+
+static void whileStatement(Node* node) {
+  int loopStart = currentChunk()->count;
+
+  int exitJump = -1;
+  if (node->as.branch.condition != NULL) {
+    expression(node->as.branch.condition);
+    exitJump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+  }
+
+  if (node->as.branch.thenBranch != NULL) {
+    statement(node->as.branch.thenBranch);
+  }
+
+  emitLoop(loopStart, &node->as.branch.thenEnd);
+
+  if (exitJump != -1) {
+    patchJump(exitJump, &node->as.branch.thenEnd);
+    emitByte(OP_POP);
+  }
+}
+
+static void statement(Node* node) {
+  switch (node->type) {
+    case NODE_BLOCK:
+      block(node->as.statements);
+      break;
+
+    case NODE_CLASS:
+      classDeclaration(node);
+      break;
+
+    case NODE_EXPRESSION:
+      expression(node->as.expression);
+      emitByte(OP_POP);
+      break;
+
+    case NODE_FUNCTION: {
+      Decl* decl = node->as.function.decl;
+      if (decl != NULL) {
+        addLocal(decl);
+        decl->isDefining = true;
+        function(node->as.function.function);
+        decl->isDefining = false;
+      } else {
+        function(node->as.function.function);
+        int name = identifierConstant(&node->token);
+        emitOperand(OP_DEFINE_GLOBAL, name);
+      }
+      break;
+    }
+
+    case NODE_IF:
+      ifStatement(node);
+      break;
+
+    case NODE_PRINT:
+      expression(node->as.expression);
+      current->line = node->line;
+      emitByte(OP_PRINT);
+      break;
+
+    case NODE_RETURN:
+      if (node->as.expression == NULL) {
+        current->line = node->line;
+        emitReturn();
+      } else {
+        expression(node->as.expression);
+        current->line = node->line;
+        emitByte(OP_RETURN);
+      }
+      break;
+
+    case NODE_VAR: {
+      expression(node->as.variable.value);
+      Decl* decl = node->as.variable.decl;
+      if (decl != NULL) {
+        addLocal(decl);
+      } else {
+        current->line = node->line;
+        int name = identifierConstant(&node->token);
+        emitOperand(OP_DEFINE_GLOBAL, name);
+      }
+      break;
+    }
+
+    case NODE_WHILE:
+      whileStatement(node);
+      break;
+
+    default:
+      break; // Unreachable.
+  }
+}
+
+static void beginFunction(Generator* generator, FunctionNode* node) {
+  generator->enclosing = current;
+  generator->node = node;
+  generator->locals = NULL;
+  generator->localCount = 0;
+  generator->localCapacity = 0;
+  generator->upvalues = NULL;
+  generator->upvalueCapacity = 0;
+  generator->captures = NULL;
+  generator->captureCapacity = 0;
+  initValueTable(&generator->constantIndexes);
+  generator->line = node->endLine;
+  generator->function = functionObject(node);
+  current = generator;
+
+  addLocal(node->receiver);
+  for (Decl* decl = node->parameters; decl != NULL; decl = decl->next) {
+    addLocal(decl);
+  }
+}
+
+static ObjFunction* endFunction() {
+  current->line = current->node->endLine;
+  emitReturn();
+  ObjFunction* function = current->function;
+  freeValueTable(&current->constantIndexes);
+
+  if (!hadError) {
+    optimizeChunk(currentChunk());
+    packChunk(currentChunk());
+  }
+
+#ifdef DEBUG_PRINT_CODE
+  if (!hadError) {
+    disassembleChunk(currentChunk(), function->name != NULL
+        ? function->name->chars : "<script>");
+  }
+#endif
+
+  current = current->enclosing;
+  return function;
+}
+
+static void function(FunctionNode* node) {
+  Generator generator;
+  beginFunction(&generator, node);
+
+  // No scope to end. Returning discards the whole frame.
+  statements(node->body);
+
+  ObjFunction* function = endFunction();
+
+  current->line = node->endLine;
+  emitOperand(OP_CLOSURE, makeConstant(OBJ_VAL(function), &node->name));
+
+  for (int i = 0; i < function->upvalueCount; i++) {
+    emitCapture(&generator.upvalues[i]);
+  }
+
+  for (int i = 0; i < function->captureCount; i++) {
+    emitCapture(&generator.captures[i]);
+  }
+}
+
+ObjFunction* generateCode(FunctionNode* script) {
+  hadError = false;
+
+  Generator generator;
+  beginFunction(&generator, script);
+  statements(script->body);
+
+  ObjFunction* function = endFunction();
+  return hadError ? NULL : function;
+}
+//< Optimization omit
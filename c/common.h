@@ -26,6 +26,9 @@
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 //< Local Variables uint8-count
+//> Optimization omit
+#define UINT16_COUNT (UINT16_MAX + 1)
+//< Optimization omit
 
 #endif
 //> omit
@@ -12,6 +12,11 @@
 //> Garbage Collection compiler-include-memory
 #include "memory.h"
 //< Garbage Collection compiler-include-memory
+//> Optimization omit
+#include "ast.h"
+#include "fold.h"
+#include "peephole.h"
+//< Optimization omit
 #include "scanner.h"
 //> Compiling Expressions include-debug
 
@@ -30,6 +35,17 @@ typedef struct {
 //> panic-mode-field
   bool panicMode;
 //< panic-mode-field
+//> Optimization omit
+  // Where the code for the left operand of the infix expression being
+  // compiled starts.
+  int leftStart;
+  // How many braces enclose the current token.
+  int braceDepth;
+  // Where the last property get compiled by dot() ends, or -1 if code
+  // after it has been jumped to since, and the constant for its name.
+  int propertyGetEnd;
+  int propertyGetName;
+//< Optimization omit
 } Parser;
 //> precedence
 
@@ -72,11 +88,32 @@ typedef struct {
 //> Closures is-captured-field
   bool isCaptured;
 //< Closures is-captured-field
+//> Optimization omit
+  // If the variable holds a constant and is never assigned, this is
+  // the instruction that loads the constant. Otherwise the length is 0.
+  uint8_t constantCode[4];
+  int constantLength;
+  // The brace depth it was declared at, which bounds its scope.
+  int braceDepth;
+  // Whether it is assigned after its declaration. Closures copy the
+  // variable instead of capturing it if not. Any assignment compiled
+  // so far sets this. The rest of the scope is checked against its
+  // block's assigned names once the variable is captured.
+  bool isAssigned;
+  // Set while compiling the function the variable names. That function
+  // can refer to itself before the variable holds it.
+  bool isDefining;
+//< Optimization omit
 } Local;
 //< Local Variables local-struct
 //> Closures upvalue-struct
 typedef struct {
+/* Closures upvalue-struct < Optimization omit
   uint8_t index;
+*/
+//> Optimization omit
+  uint16_t index;
+//< Optimization omit
   bool isLocal;
 } Upvalue;
 //< Closures upvalue-struct
@@ -106,12 +143,44 @@ typedef struct Compiler {
   FunctionType type;
 
 //< Calls and Functions function-fields
+/* Local Variables compiler-struct < Optimization omit
   Local locals[UINT8_COUNT];
+*/
+//> Optimization omit
+  // Wide operands allow up to UINT16_COUNT of each of these, so the
+  // arrays grow as needed instead of living in the struct.
+  Local* locals;
+  int localCapacity;
+//< Optimization omit
   int localCount;
 //> Closures upvalues-array
+/* Closures upvalues-array < Optimization omit
   Upvalue upvalues[UINT8_COUNT];
+*/
+//> Optimization omit
+  Upvalue* upvalues;
+  int upvalueCapacity;
+//< Optimization omit
 //< Closures upvalues-array
   int scopeDepth;
+//> Optimization omit
+  // Constants below this index are loaded from more than one place, so
+  // folding must not discard them.
+  int keptConstants;
+  // Maps each string and number constant to its index, so each is only
+  // stored once.
+  ValueTable constantIndexes;
+  // Variables copied into the closure when it is created.
+  Upvalue* captures;
+  int captureCapacity;
+  // Whether the closure can outlive the call that creates it. If not,
+  // it uses that call's locals directly instead of capturing them.
+  bool escapes;
+  // Which of the enclosing function's locals it uses that way.
+  bool* usesOuterLocal;
+  int usesOuterLocalCapacity;
+  int outerLocalCount;
+//< Optimization omit
 } Compiler;
 //< Local Variables compiler-struct
 //> Methods and Initializers class-compiler-struct
@@ -135,6 +204,25 @@ Compiler* current = NULL;
 
 ClassCompiler* currentClass = NULL;
 //< Methods and Initializers current-class
+//> Optimization omit
+
+bool useAstCompiler = false;
+bool lazyCompilation = false;
+
+// The names assigned anywhere in the rest of a block, as an open-
+// addressed set of identifier tokens. Empty slots have a NULL start.
+typedef struct {
+  bool scanned;
+  int count;
+  int capacity;
+  Token* names;
+} AssignedNames;
+
+// Indexed by brace depth. Each enclosing block is scanned ahead once,
+// the first time one of its locals asks, and forgotten when it ends.
+static AssignedNames* blockAssignments = NULL;
+static int blockAssignmentCapacity = 0;
+//< Optimization omit
 //> Compiling Expressions compiling-chunk
 
 /* Compiling Expressions compiling-chunk < Calls and Functions current-chunk
@@ -186,8 +274,18 @@ static void errorAtCurrent(const char* message) {
 //< Compiling Expressions error-at-current
 //> Compiling Expressions advance
 
+//> Optimization omit
+static void forgetAssignments(int depth);
+
+//< Optimization omit
 static void advance() {
   parser.previous = parser.current;
+//> Optimization omit
+  if (parser.previous.type == TOKEN_LEFT_BRACE) parser.braceDepth++;
+  if (parser.previous.type == TOKEN_RIGHT_BRACE) {
+    forgetAssignments(parser.braceDepth--);
+  }
+//< Optimization omit
 
   for (;;) {
     parser.current = scanToken();
@@ -230,12 +328,75 @@ static void emitBytes(uint8_t byte1, uint8_t byte2) {
   emitByte(byte2);
 }
 //< Compiling Expressions emit-bytes
+//> Optimization omit
+// Emits [instruction] with its first operand, in the wide form if the
+// operand doesn't fit in a byte.
+static void emitOperand(uint8_t instruction, int operand) {
+  if (operand > UINT8_MAX) {
+    emitBytes(OP_WIDE, instruction);
+    emitBytes((operand >> 8) & 0xff, operand & 0xff);
+  } else {
+    emitBytes(instruction, (uint8_t)operand);
+  }
+}
+
+// Emits a variable OP_CLOSURE captures, which is a local of the
+// enclosing function or one of its upvalues or captures.
+static void emitCapture(Upvalue* capture) {
+  uint8_t isLocal = capture->isLocal ? 1 : 0;
+  if (capture->index > UINT8_MAX) {
+    emitByte(isLocal | CAPTURE_WIDE);
+    emitBytes((capture->index >> 8) & 0xff, capture->index & 0xff);
+  } else {
+    emitBytes(isLocal, (uint8_t)capture->index);
+  }
+}
+
+// Adds [value] to the constant table unless it is already there.
+static int shareConstant(Value value) {
+  Chunk* chunk = currentChunk();
+  int count = chunk->constants.count;
+  int constant = addSharedConstant(chunk, &current->constantIndexes,
+                                   value);
+
+  // An existing constant is now loaded from more than one place.
+  if (constant < count && constant >= current->keptConstants) {
+    current->keptConstants = constant + 1;
+  }
+
+  return constant;
+}
+
+// Stores a jump offset too big for two bytes in the constant table, for
+// the far form of a jump to load.
+static int farJumpConstant(int offset, const char* message) {
+  int constant = shareConstant(NUMBER_VAL(offset));
+  if (constant > UINT16_MAX) {
+    error(message);
+    return 0;
+  }
+
+  return constant;
+}
+
+//< Optimization omit
 //> Jumping Back and Forth emit-loop
 static void emitLoop(int loopStart) {
+/* Jumping Back and Forth emit-loop < Optimization omit
   emitByte(OP_LOOP);
 
   int offset = currentChunk()->count - loopStart + 2;
   if (offset > UINT16_MAX) error("Loop body too large.");
+*/
+//> Optimization omit
+  int offset = currentChunk()->count - loopStart + 3;
+  if (offset > UINT16_MAX) {
+    offset = farJumpConstant(offset, "Loop body too large.");
+    emitByte(OP_LOOP_FAR);
+  } else {
+    emitByte(OP_LOOP);
+  }
+//< Optimization omit
 
   emitByte((offset >> 8) & 0xff);
   emitByte(offset & 0xff);
@@ -266,6 +427,7 @@ static void emitReturn() {
 }
 //< Compiling Expressions emit-return
 //> Compiling Expressions make-constant
+/* Compiling Expressions make-constant < Optimization omit
 static uint8_t makeConstant(Value value) {
   int constant = addConstant(currentChunk(), value);
   if (constant > UINT8_MAX) {
@@ -275,25 +437,196 @@ static uint8_t makeConstant(Value value) {
 
   return (uint8_t)constant;
 }
+*/
+//> Optimization omit
+static int makeConstant(Value value) {
+  int constant = shareConstant(value);
+  if (constant > UINT16_MAX) {
+    error("Too many constants in one chunk.");
+    return 0;
+  }
+
+  return constant;
+}
+//< Optimization omit
 //< Compiling Expressions make-constant
 //> Compiling Expressions emit-constant
 static void emitConstant(Value value) {
+/* Compiling Expressions emit-constant < Optimization omit
   emitBytes(OP_CONSTANT, makeConstant(value));
+*/
+//> Optimization omit
+  emitOperand(OP_CONSTANT, makeConstant(value));
+//< Optimization omit
 }
 //< Compiling Expressions emit-constant
+//> Optimization omit
+// Constant folding ----------------------------------------------------
+//
+// An operand whose code is a single instruction loading a constant can
+// be evaluated at compile time. Anything that would be a runtime error
+// is left for the VM to report.
+
+static void emitValue(Value value) {
+  if (IS_NIL(value)) {
+    emitByte(OP_NIL);
+  } else if (IS_BOOL(value)) {
+    emitByte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+  } else {
+    emitConstant(value);
+  }
+}
+
+// If the code from [start] to [end] loads a single constant, stores it
+// in [value].
+static bool constantOperand(int start, int end, Value* value) {
+  Chunk* chunk = currentChunk();
+  if (end - start == 1) {
+    switch (chunk->code[start]) {
+      case OP_NIL: *value = NIL_VAL; return true;
+      case OP_TRUE: *value = BOOL_VAL(true); return true;
+      case OP_FALSE: *value = BOOL_VAL(false); return true;
+      default: return false;
+    }
+  }
+
+  if (end - start == 2 && chunk->code[start] == OP_CONSTANT) {
+    *value = chunk->constants.values[chunk->code[start + 1]];
+    return true;
+  }
+
+  if (end - start == 4 && chunk->code[start] == OP_WIDE &&
+      chunk->code[start + 1] == OP_CONSTANT) {
+    int constant = (chunk->code[start + 2] << 8) | chunk->code[start + 3];
+    *value = chunk->constants.values[constant];
+    return true;
+  }
+
+  return false;
+}
+
+// Removes the operand code from [start] on, along with any constants
+// only it used. The operands are at most two constant instructions.
+static void discardOperands(int start) {
+  Chunk* chunk = currentChunk();
+  int constants[2];
+  int constantCount = 0;
+  for (int offset = start; offset < chunk->count; offset++) {
+    if (chunk->code[offset] == OP_CONSTANT) {
+      constants[constantCount++] = chunk->code[++offset];
+    } else if (chunk->code[offset] == OP_WIDE) {
+      constants[constantCount++] =
+          (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+      offset += 3;
+    }
+  }
+
+  // Later operands added their constants later.
+  for (int i = constantCount - 1; i >= 0; i--) {
+    if (constants[i] == chunk->constants.count - 1 &&
+        constants[i] >= current->keptConstants) {
+      removeLastConstant(chunk, &current->constantIndexes);
+    }
+  }
+
+  chunk->count = start;
+}
+
+static bool foldUnary(TokenType operatorType, int operandStart) {
+  Value operand;
+  Value result;
+  if (!constantOperand(operandStart, currentChunk()->count, &operand) ||
+      !evaluateUnary(operatorType, operand, &result)) {
+    return false;
+  }
+
+  discardOperands(operandStart);
+  emitValue(result);
+  return true;
+}
+
+static bool foldBinary(TokenType operatorType, int leftStart,
+                       int rightStart) {
+  Value a;
+  Value b;
+  Value result;
+  if (!constantOperand(leftStart, rightStart, &a) ||
+      !constantOperand(rightStart, currentChunk()->count, &b) ||
+      !evaluateBinary(operatorType, a, b, &result)) {
+    return false;
+  }
+
+  discardOperands(leftStart);
+  emitValue(result);
+  return true;
+}
+//< Optimization omit
 //> Jumping Back and Forth patch-jump
 static void patchJump(int offset) {
   // -2 to adjust for the bytecode for the jump offset itself.
   int jump = currentChunk()->count - offset - 2;
 
+/* Jumping Back and Forth patch-jump < Optimization omit
   if (jump > UINT16_MAX) {
     error("Too much code to jump over.");
   }
+*/
+//> Optimization omit
+  if (jump > UINT16_MAX) {
+    jump = farJumpConstant(jump, "Too much code to jump over.");
+    uint8_t* instruction = &currentChunk()->code[offset - 1];
+    *instruction = *instruction == OP_JUMP
+        ? OP_JUMP_FAR : OP_JUMP_IF_FALSE_FAR;
+  }
+//< Optimization omit
 
   currentChunk()->code[offset] = (jump >> 8) & 0xff;
   currentChunk()->code[offset + 1] = jump & 0xff;
+//> Optimization omit
+  parser.propertyGetEnd = -1;
+//< Optimization omit
 }
 //< Jumping Back and Forth patch-jump
+//> Optimization omit
+// Makes room in [compiler] for one more local and returns it.
+static Local* pushLocal(Compiler* compiler) {
+  if (compiler->localCount == compiler->localCapacity) {
+    int oldCapacity = compiler->localCapacity;
+    compiler->localCapacity = GROW_CAPACITY(oldCapacity);
+    compiler->locals = GROW_ARRAY(Local, compiler->locals,
+                                  oldCapacity, compiler->localCapacity);
+  }
+
+  Local* local = &compiler->locals[compiler->localCount++];
+  if (compiler->localCount > compiler->function->slotCount) {
+    compiler->function->slotCount = compiler->localCount;
+  }
+  return local;
+}
+
+// Returns where the entry after the first [count] in [*array] goes,
+// growing it if it is full.
+static Upvalue* reserveUpvalue(Upvalue** array, int* capacity,
+                               int count) {
+  if (count == *capacity) {
+    int oldCapacity = *capacity;
+    *capacity = GROW_CAPACITY(oldCapacity);
+    *array = GROW_ARRAY(Upvalue, *array, oldCapacity, *capacity);
+  }
+
+  return &(*array)[count];
+}
+
+static void freeCompiler(Compiler* compiler) {
+  FREE_ARRAY(Local, compiler->locals, compiler->localCapacity);
+  FREE_ARRAY(Upvalue, compiler->upvalues, compiler->upvalueCapacity);
+  FREE_ARRAY(Upvalue, compiler->captures, compiler->captureCapacity);
+  FREE_ARRAY(bool, compiler->usesOuterLocal,
+             compiler->usesOuterLocalCapacity);
+  freeValueTable(&compiler->constantIndexes);
+}
+
+//< Optimization omit
 //> Local Variables init-compiler
 /* Local Variables init-compiler < Calls and Functions init-compiler
 static void initCompiler(Compiler* compiler) {
@@ -308,6 +641,20 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
 //< Calls and Functions init-compiler
   compiler->localCount = 0;
   compiler->scopeDepth = 0;
+//> Optimization omit
+  compiler->locals = NULL;
+  compiler->localCapacity = 0;
+  compiler->upvalues = NULL;
+  compiler->upvalueCapacity = 0;
+  compiler->keptConstants = 0;
+  initValueTable(&compiler->constantIndexes);
+  compiler->captures = NULL;
+  compiler->captureCapacity = 0;
+  compiler->escapes = true;
+  compiler->usesOuterLocal = NULL;
+  compiler->usesOuterLocalCapacity = 0;
+  compiler->outerLocalCount = 0;
+//< Optimization omit
 //> Calls and Functions init-function
   compiler->function = newFunction();
 //< Calls and Functions init-function
@@ -321,11 +668,22 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
 //< Calls and Functions init-function-name
 //> Calls and Functions init-function-slot
 
+/* Calls and Functions init-function-slot < Optimization omit
   Local* local = &current->locals[current->localCount++];
+*/
+//> Optimization omit
+  Local* local = pushLocal(current);
+//< Optimization omit
   local->depth = 0;
 //> Closures init-zero-local-is-captured
   local->isCaptured = false;
 //< Closures init-zero-local-is-captured
+//> Optimization omit
+  local->constantLength = 0;
+  local->braceDepth = parser.braceDepth;
+  local->isAssigned = false;
+  local->isDefining = false;
+//< Optimization omit
 /* Calls and Functions init-function-slot < Methods and Initializers slot-zero
   local->name.start = "";
   local->name.length = 0;
@@ -354,6 +712,13 @@ static ObjFunction* endCompiler() {
   ObjFunction* function = current->function;
 
 //< Calls and Functions end-function
+//> Optimization omit
+  if (!parser.hadError) {
+    optimizeChunk(currentChunk());
+    packChunk(currentChunk());
+  }
+
+//< Optimization omit
 //> dump-chunk
 #ifdef DEBUG_PRINT_CODE
   if (!parser.hadError) {
@@ -416,7 +781,12 @@ static void parsePrecedence(Precedence precedence);
 
 //< Compiling Expressions forward-declarations
 //> Global Variables identifier-constant
+/* Global Variables identifier-constant < Optimization omit
 static uint8_t identifierConstant(Token* name) {
+*/
+//> Optimization omit
+static int identifierConstant(Token* name) {
+//< Optimization omit
   return makeConstant(OBJ_VAL(copyString(name->start,
                                          name->length)));
 }
@@ -444,9 +814,23 @@ static int resolveLocal(Compiler* compiler, Token* name) {
   return -1;
 }
 //< Local Variables resolve-local
+//> Optimization omit
+// Upvalues, captures and enclosing locals used directly all count
+// against the one limit on the variables a function closes over.
+static int closureVariableCount(Compiler* compiler) {
+  return compiler->function->upvalueCount +
+         compiler->function->captureCount + compiler->outerLocalCount;
+}
+
+//< Optimization omit
 //> Closures add-upvalue
+/* Closures add-upvalue < Optimization omit
 static int addUpvalue(Compiler* compiler, uint8_t index,
                       bool isLocal) {
+*/
+//> Optimization omit
+static int addUpvalue(Compiler* compiler, int index, bool isLocal) {
+//< Optimization omit
   int upvalueCount = compiler->function->upvalueCount;
 //> existing-upvalue
 
@@ -459,14 +843,28 @@ static int addUpvalue(Compiler* compiler, uint8_t index,
 
 //< existing-upvalue
 //> too-many-upvalues
+/* Closures too-many-upvalues < Optimization omit
   if (upvalueCount == UINT8_COUNT) {
+*/
+//> Optimization omit
+  if (closureVariableCount(compiler) == UINT16_COUNT) {
+//< Optimization omit
     error("Too many closure variables in function.");
     return 0;
   }
 
 //< too-many-upvalues
+/* Closures add-upvalue < Optimization omit
   compiler->upvalues[upvalueCount].isLocal = isLocal;
   compiler->upvalues[upvalueCount].index = index;
+*/
+//> Optimization omit
+  Upvalue* upvalue = reserveUpvalue(&compiler->upvalues,
+                                    &compiler->upvalueCapacity,
+                                    upvalueCount);
+  upvalue->isLocal = isLocal;
+  upvalue->index = (uint16_t)index;
+//< Optimization omit
   return compiler->function->upvalueCount++;
 }
 //< Closures add-upvalue
@@ -479,29 +877,273 @@ static int resolveUpvalue(Compiler* compiler, Token* name) {
 //> mark-local-captured
     compiler->enclosing->locals[local].isCaptured = true;
 //< mark-local-captured
+/* Closures resolve-upvalue < Optimization omit
     return addUpvalue(compiler, (uint8_t)local, true);
+*/
+//> Optimization omit
+    return addUpvalue(compiler, local, true);
+//< Optimization omit
   }
 //> resolve-upvalue-recurse
 
   int upvalue = resolveUpvalue(compiler->enclosing, name);
   if (upvalue != -1) {
+/* Closures resolve-upvalue-recurse < Optimization omit
     return addUpvalue(compiler, (uint8_t)upvalue, false);
+*/
+//> Optimization omit
+    return addUpvalue(compiler, upvalue, false);
+//< Optimization omit
   }
 //< resolve-upvalue-recurse
 
   return -1;
 }
 //< Closures resolve-upvalue
+//> Optimization omit
+static uint32_t hashName(Token* name) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < name->length; i++) {
+    hash ^= (uint8_t)name->start[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static Token* findAssignedName(Token* names, int capacity, Token* name) {
+  uint32_t index = hashName(name) & (capacity - 1);
+  for (;;) {
+    Token* entry = &names[index];
+    if (entry->start == NULL || identifiersEqual(entry, name)) {
+      return entry;
+    }
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+static void addAssignedName(AssignedNames* set, Token* name) {
+  if (set->count + 1 > set->capacity * 3 / 4) {
+    int capacity = GROW_CAPACITY(set->capacity);
+    Token* names = ALLOCATE(Token, capacity);
+    for (int i = 0; i < capacity; i++) names[i].start = NULL;
+
+    for (int i = 0; i < set->capacity; i++) {
+      if (set->names[i].start == NULL) continue;
+      *findAssignedName(names, capacity, &set->names[i]) = set->names[i];
+    }
+
+    FREE_ARRAY(Token, set->names, set->capacity);
+    set->names = names;
+    set->capacity = capacity;
+  }
+
+  Token* entry = findAssignedName(set->names, set->capacity, name);
+  if (entry->start == NULL) {
+    *entry = *name;
+    set->count++;
+  }
+}
+
+// Called when the block at [depth] ends, so the next block at that
+// depth is scanned afresh.
+static void forgetAssignments(int depth) {
+  if (depth < 0 || depth >= blockAssignmentCapacity) return;
+
+  AssignedNames* set = &blockAssignments[depth];
+  if (!set->scanned) return;
+  set->scanned = false;
+  set->count = 0;
+  for (int i = 0; i < set->capacity; i++) set->names[i].start = NULL;
+}
+
+static void freeAssignments() {
+  for (int i = 0; i < blockAssignmentCapacity; i++) {
+    FREE_ARRAY(Token, blockAssignments[i].names,
+               blockAssignments[i].capacity);
+  }
+  FREE_ARRAY(AssignedNames, blockAssignments, blockAssignmentCapacity);
+  blockAssignments = NULL;
+  blockAssignmentCapacity = 0;
+}
+
+// Scans the rest of the block at [depth] once for the names it assigns,
+// including inside nested functions.
+static AssignedNames* blockAssignmentsAt(int depth) {
+  if (depth >= blockAssignmentCapacity) {
+    int oldCapacity = blockAssignmentCapacity;
+    while (blockAssignmentCapacity <= depth) {
+      blockAssignmentCapacity = GROW_CAPACITY(blockAssignmentCapacity);
+    }
+    blockAssignments = GROW_ARRAY(AssignedNames, blockAssignments,
+        oldCapacity, blockAssignmentCapacity);
+    for (int i = oldCapacity; i < blockAssignmentCapacity; i++) {
+      blockAssignments[i].scanned = false;
+      blockAssignments[i].count = 0;
+      blockAssignments[i].capacity = 0;
+      blockAssignments[i].names = NULL;
+    }
+  }
+
+  AssignedNames* set = &blockAssignments[depth];
+  if (set->scanned) return set;
+
+  ScannerState saved = saveScanner();
+  Token token = parser.current;
+  int braces = 0;
+  while (token.type != TOKEN_EOF) {
+    if (token.type == TOKEN_LEFT_BRACE) braces++;
+    if (token.type == TOKEN_RIGHT_BRACE &&
+        --braces < depth - parser.braceDepth) {
+      break;
+    }
+
+    Token next = scanToken();
+    if (token.type == TOKEN_IDENTIFIER && next.type == TOKEN_EQUAL) {
+      // Reallocating may collect garbage, but the set holds no objects.
+      addAssignedName(set, &token);
+    }
+    token = next;
+  }
+  restoreScanner(saved);
+
+  set->scanned = true;
+  return set;
+}
+
+// Whether [name] is assigned anywhere in the rest of the block
+// [levels] out from the current one, including inside nested
+// functions. Errs on the side of yes, since any assignment to a
+// variable with that name counts, and the block may have been scanned
+// from an earlier point in it.
+static bool isAssignedLater(Token* name, int levels) {
+  int depth = parser.braceDepth - levels;
+  if (depth < 0) return true;
+
+  AssignedNames* set = blockAssignmentsAt(depth);
+  return set->count > 0 &&
+         findAssignedName(set->names, set->capacity, name)->start != NULL;
+}
+
+// Whether closures can copy [local] because it never changes once
+// they have been created.
+static bool isFinal(Local* local) {
+  // The block's names are shared by all its locals, so asking again
+  // for each capture doesn't rescan the source.
+  if (!local->isAssigned &&
+      isAssignedLater(&local->name, parser.braceDepth - local->braceDepth)) {
+    local->isAssigned = true;
+  }
+
+  return !local->isAssigned && !local->isDefining;
+}
+
+// Records an assignment to [name] in whichever function declares it.
+static void markAssigned(Compiler* compiler, Token* name) {
+  for (; compiler != NULL; compiler = compiler->enclosing) {
+    for (int i = compiler->localCount - 1; i >= 0; i--) {
+      if (identifiersEqual(name, &compiler->locals[i].name)) {
+        compiler->locals[i].isAssigned = true;
+        return;
+      }
+    }
+  }
+}
+
+static int addCapture(Compiler* compiler, int index, bool isLocal) {
+  int captureCount = compiler->function->captureCount;
+
+  for (int i = 0; i < captureCount; i++) {
+    Upvalue* capture = &compiler->captures[i];
+    if (capture->index == index && capture->isLocal == isLocal) {
+      return i;
+    }
+  }
+
+  if (closureVariableCount(compiler) == UINT16_COUNT) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+
+  Upvalue* capture = reserveUpvalue(&compiler->captures,
+                                    &compiler->captureCapacity,
+                                    captureCount);
+  capture->isLocal = isLocal;
+  capture->index = (uint16_t)index;
+  return compiler->function->captureCount++;
+}
+
+// Like resolveUpvalue(), but only succeeds if every function between
+// here and the declaration can copy the variable.
+static int resolveCapture(Compiler* compiler, Token* name) {
+  if (compiler->enclosing == NULL) return -1;
+
+  int local = resolveLocal(compiler->enclosing, name);
+  if (local != -1) {
+    if (!isFinal(&compiler->enclosing->locals[local])) return -1;
+    return addCapture(compiler, local, true);
+  }
+
+  int capture = resolveCapture(compiler->enclosing, name);
+  if (capture != -1) {
+    return addCapture(compiler, capture, false);
+  }
+
+  return -1;
+}
+
+// A function that never outlives the call that created it can use
+// that call's locals in place, without capturing them.
+static int resolveOuterLocal(Compiler* compiler, Token* name) {
+  if (compiler->escapes) return -1;
+
+  int local = resolveLocal(compiler->enclosing, name);
+  if (local == -1) return -1;
+  if (local < compiler->usesOuterLocalCapacity &&
+      compiler->usesOuterLocal[local]) {
+    return local;
+  }
+
+  if (closureVariableCount(compiler) == UINT16_COUNT) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+
+  if (local >= compiler->usesOuterLocalCapacity) {
+    int oldCapacity = compiler->usesOuterLocalCapacity;
+    compiler->usesOuterLocalCapacity = compiler->enclosing->localCount;
+    compiler->usesOuterLocal = GROW_ARRAY(bool, compiler->usesOuterLocal,
+        oldCapacity, compiler->usesOuterLocalCapacity);
+    for (int i = oldCapacity; i < compiler->usesOuterLocalCapacity; i++) {
+      compiler->usesOuterLocal[i] = false;
+    }
+  }
+
+  compiler->usesOuterLocal[local] = true;
+  compiler->outerLocalCount++;
+  return local;
+}
+
+//< Optimization omit
 //> Local Variables add-local
 static void addLocal(Token name) {
 //> too-many-locals
+/* Local Variables too-many-locals < Optimization omit
   if (current->localCount == UINT8_COUNT) {
+*/
+//> Optimization omit
+  if (current->localCount == UINT16_COUNT) {
+//< Optimization omit
     error("Too many local variables in function.");
     return;
   }
 
 //< too-many-locals
+/* Local Variables add-local < Optimization omit
   Local* local = &current->locals[current->localCount++];
+*/
+//> Optimization omit
+  Local* local = pushLocal(current);
+//< Optimization omit
   local->name = name;
 /* Local Variables add-local < Local Variables declare-undefined
   local->depth = current->scopeDepth;
@@ -512,6 +1154,12 @@ static void addLocal(Token name) {
 //> Closures init-is-captured
   local->isCaptured = false;
 //< Closures init-is-captured
+//> Optimization omit
+  local->constantLength = 0;
+  local->braceDepth = parser.braceDepth;
+  local->isAssigned = false;
+  local->isDefining = false;
+//< Optimization omit
 }
 //< Local Variables add-local
 //> Local Variables declare-variable
@@ -536,7 +1184,12 @@ static void declareVariable() {
 }
 //< Local Variables declare-variable
 //> Global Variables parse-variable
+/* Global Variables parse-variable < Optimization omit
 static uint8_t parseVariable(const char* errorMessage) {
+*/
+//> Optimization omit
+static int parseVariable(const char* errorMessage) {
+//< Optimization omit
   consume(TOKEN_IDENTIFIER, errorMessage);
 //> Local Variables parse-local
 
@@ -557,7 +1210,12 @@ static void markInitialized() {
 }
 //< Local Variables mark-initialized
 //> Global Variables define-variable
+/* Global Variables define-variable < Optimization omit
 static void defineVariable(uint8_t global) {
+*/
+//> Optimization omit
+static void defineVariable(int global) {
+//< Optimization omit
 //> Local Variables define-variable
   if (current->scopeDepth > 0) {
 //> define-local
@@ -567,7 +1225,12 @@ static void defineVariable(uint8_t global) {
   }
 
 //< Local Variables define-variable
+/* Global Variables define-variable < Optimization omit
   emitBytes(OP_DEFINE_GLOBAL, global);
+*/
+//> Optimization omit
+  emitOperand(OP_DEFINE_GLOBAL, global);
+//< Optimization omit
 }
 //< Global Variables define-variable
 //> Calls and Functions argument-list
@@ -609,20 +1272,37 @@ static void binary(bool canAssign) {
 //< Global Variables binary
   // Remember the operator.
   TokenType operatorType = parser.previous.type;
+//> Optimization omit
+  int leftStart = parser.leftStart;
+  int rightStart = currentChunk()->count;
+//< Optimization omit
 
   // Compile the right operand.
   ParseRule* rule = getRule(operatorType);
   parsePrecedence((Precedence)(rule->precedence + 1));
+//> Optimization omit
+  if (foldBinary(operatorType, leftStart, rightStart)) return;
+//< Optimization omit
 
   // Emit the operator instruction.
   switch (operatorType) {
 //> Types of Values comparison-operators
+/* Types of Values comparison-operators < Optimization omit
     case TOKEN_BANG_EQUAL:    emitBytes(OP_EQUAL, OP_NOT); break;
     case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
     case TOKEN_GREATER:       emitByte(OP_GREATER); break;
     case TOKEN_GREATER_EQUAL: emitBytes(OP_LESS, OP_NOT); break;
     case TOKEN_LESS:          emitByte(OP_LESS); break;
     case TOKEN_LESS_EQUAL:    emitBytes(OP_GREATER, OP_NOT); break;
+*/
+//> Optimization omit
+    case TOKEN_BANG_EQUAL:    emitByte(OP_NOT_EQUAL); break;
+    case TOKEN_EQUAL_EQUAL:   emitByte(OP_EQUAL); break;
+    case TOKEN_GREATER:       emitByte(OP_GREATER); break;
+    case TOKEN_GREATER_EQUAL: emitByte(OP_GREATER_EQUAL); break;
+    case TOKEN_LESS:          emitByte(OP_LESS); break;
+    case TOKEN_LESS_EQUAL:    emitByte(OP_LESS_EQUAL); break;
+//< Optimization omit
 //< Types of Values comparison-operators
     case TOKEN_PLUS:          emitByte(OP_ADD); break;
     case TOKEN_MINUS:         emitByte(OP_SUBTRACT); break;
@@ -639,22 +1319,57 @@ static void call(bool canAssign) {
   emitBytes(OP_CALL, argCount);
 }
 //< Calls and Functions compile-call
+//> Optimization omit
+static void subscript(bool canAssign) {
+  expression();
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+  if (canAssign && match(TOKEN_EQUAL)) {
+    expression();
+    emitByte(OP_SET_INDEX);
+  } else {
+    emitByte(OP_GET_INDEX);
+  }
+}
+//< Optimization omit
 //> Classes and Instances compile-dot
 static void dot(bool canAssign) {
   consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
+/* Classes and Instances compile-dot < Optimization omit
   uint8_t name = identifierConstant(&parser.previous);
+*/
+//> Optimization omit
+  int name = identifierConstant(&parser.previous);
+//< Optimization omit
 
   if (canAssign && match(TOKEN_EQUAL)) {
     expression();
+/* Classes and Instances compile-dot < Optimization omit
     emitBytes(OP_SET_PROPERTY, name);
+*/
+//> Optimization omit
+    emitOperand(OP_SET_PROPERTY, name);
+//< Optimization omit
 //> Methods and Initializers parse-call
   } else if (match(TOKEN_LEFT_PAREN)) {
     uint8_t argCount = argumentList();
+/* Methods and Initializers parse-call < Optimization omit
     emitBytes(OP_INVOKE, name);
+*/
+//> Optimization omit
+    emitOperand(OP_INVOKE, name);
+//< Optimization omit
     emitByte(argCount);
 //< Methods and Initializers parse-call
   } else {
+/* Classes and Instances compile-dot < Optimization omit
     emitBytes(OP_GET_PROPERTY, name);
+*/
+//> Optimization omit
+    emitOperand(OP_GET_PROPERTY, name);
+    parser.propertyGetEnd = currentChunk()->count;
+    parser.propertyGetName = name;
+//< Optimization omit
   }
 }
 //< Classes and Instances compile-dot
@@ -681,8 +1396,25 @@ static void grouping() {
 //> Global Variables grouping
 static void grouping(bool canAssign) {
 //< Global Variables grouping
+//> Optimization omit
+  parser.propertyGetEnd = -1;
+//< Optimization omit
   expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after expression.");
+//> Optimization omit
+
+  // Calling a property read in parentheses, like `(a.b)()`, compiles
+  // to an invoke, so a method isn't bound just to be called.
+  if (parser.propertyGetEnd == currentChunk()->count &&
+      match(TOKEN_LEFT_PAREN)) {
+    int name = parser.propertyGetName;
+    currentChunk()->count -= name > UINT8_MAX ? 4 : 2;
+
+    uint8_t argCount = argumentList();
+    emitOperand(OP_INVOKE, name);
+    emitByte(argCount);
+  }
+//< Optimization omit
 }
 //< Compiling Expressions grouping
 /* Compiling Expressions number < Global Variables number
@@ -693,6 +1425,13 @@ static void number() {
 static void number(bool canAssign) {
 //< Global Variables number
   double value = strtod(parser.previous.start, NULL);
+//> Optimization omit
+  if (value <= INT32_MAX && value == (int32_t)value) {
+    emitConstant(INT_VAL((int32_t)value));
+    return;
+  }
+
+//< Optimization omit
 /* Compiling Expressions number < Types of Values const-number-val
   emitConstant(value);
 */
@@ -720,10 +1459,39 @@ static void string() {
 //> Global Variables string
 static void string(bool canAssign) {
 //< Global Variables string
+/* Strings parse-string < Optimization omit
   emitConstant(OBJ_VAL(copyString(parser.previous.start + 1,
                                   parser.previous.length - 2)));
+*/
+//> Optimization omit
+  emitConstant(stringValue(parser.previous.start + 1,
+                           parser.previous.length - 2));
+//< Optimization omit
 }
 //< Strings parse-string
+//> Optimization omit
+static void list(bool canAssign) {
+  int itemCount = 0;
+  if (!check(TOKEN_RIGHT_BRACKET)) {
+    do {
+      expression();
+      if (itemCount == UINT16_MAX) {
+        error("Can't have more than 65535 items in a list literal.");
+      }
+      itemCount++;
+    } while (match(TOKEN_COMMA));
+  }
+
+  consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list items.");
+
+  // The items are all on the stack until the list is built.
+  int slots = current->localCount + itemCount;
+  if (slots > current->function->slotCount) {
+    current->function->slotCount = slots;
+  }
+  emitOperand(OP_BUILD_LIST, itemCount);
+}
+//< Optimization omit
 /* Global Variables read-named-variable < Global Variables named-variable-signature
 static void namedVariable(Token name) {
 */
@@ -735,11 +1503,25 @@ static void namedVariable(Token name, bool canAssign) {
 */
 //> Global Variables read-named-variable
 //> Local Variables named-local
+//> Optimization omit
+  bool isAssignment = canAssign && check(TOKEN_EQUAL);
+  if (isAssignment) markAssigned(current, &name);
+
+//< Optimization omit
   uint8_t getOp, setOp;
   int arg = resolveLocal(current, &name);
   if (arg != -1) {
     getOp = OP_GET_LOCAL;
     setOp = OP_SET_LOCAL;
+//> Optimization omit
+  } else if ((arg = resolveOuterLocal(current, &name)) != -1) {
+    getOp = OP_GET_OUTER;
+    setOp = OP_SET_OUTER;
+  } else if (!isAssignment &&
+             (arg = resolveCapture(current, &name)) != -1) {
+    getOp = OP_GET_CAPTURE;
+    setOp = OP_GET_CAPTURE; // Never assigned.
+//< Optimization omit
 //> Closures named-variable-upvalue
   } else if ((arg = resolveUpvalue(current, &name)) != -1) {
     getOp = OP_GET_UPVALUE;
@@ -767,14 +1549,32 @@ static void namedVariable(Token name, bool canAssign) {
     emitBytes(OP_SET_GLOBAL, arg);
 */
 //> Local Variables emit-set
+/* Local Variables emit-set < Optimization omit
     emitBytes(setOp, (uint8_t)arg);
+*/
+//> Optimization omit
+    emitOperand(setOp, arg);
+//< Optimization omit
 //< Local Variables emit-set
+//> Optimization omit
+  } else if (getOp == OP_GET_LOCAL &&
+             current->locals[arg].constantLength > 0) {
+    Local* local = &current->locals[arg];
+    for (int i = 0; i < local->constantLength; i++) {
+      emitByte(local->constantCode[i]);
+    }
+//< Optimization omit
   } else {
 /* Global Variables named-variable < Local Variables emit-get
     emitBytes(OP_GET_GLOBAL, arg);
 */
 //> Local Variables emit-get
+/* Local Variables emit-get < Optimization omit
     emitBytes(getOp, (uint8_t)arg);
+*/
+//> Optimization omit
+    emitOperand(getOp, arg);
+//< Optimization omit
 //< Local Variables emit-get
   }
 //< named-variable
@@ -810,7 +1610,12 @@ static void super_(bool canAssign) {
 //< super-errors
   consume(TOKEN_DOT, "Expect '.' after 'super'.");
   consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+/* Superclasses super < Optimization omit
   uint8_t name = identifierConstant(&parser.previous);
+*/
+//> Optimization omit
+  int name = identifierConstant(&parser.previous);
+//< Optimization omit
 //> super-get
   
   namedVariable(syntheticToken("this"), false);
@@ -823,11 +1628,21 @@ static void super_(bool canAssign) {
   if (match(TOKEN_LEFT_PAREN)) {
     uint8_t argCount = argumentList();
     namedVariable(syntheticToken("super"), false);
+/* Superclasses super-invoke < Optimization omit
     emitBytes(OP_SUPER_INVOKE, name);
+*/
+//> Optimization omit
+    emitOperand(OP_SUPER_INVOKE, name);
+//< Optimization omit
     emitByte(argCount);
   } else {
     namedVariable(syntheticToken("super"), false);
+/* Superclasses super-invoke < Optimization omit
     emitBytes(OP_GET_SUPER, name);
+*/
+//> Optimization omit
+    emitOperand(OP_GET_SUPER, name);
+//< Optimization omit
   }
 //< super-invoke
 }
@@ -851,6 +1666,9 @@ static void unary() {
 static void unary(bool canAssign) {
 //< Global Variables unary
   TokenType operatorType = parser.previous.type;
+//> Optimization omit
+  int operandStart = currentChunk()->count;
+//< Optimization omit
 
   // Compile the operand.
 /* Compiling Expressions unary < Compiling Expressions unary-operand
@@ -859,6 +1677,9 @@ static void unary(bool canAssign) {
 //> unary-operand
   parsePrecedence(PREC_UNARY);
 //< unary-operand
+//> Optimization omit
+  if (foldUnary(operatorType, operandStart)) return;
+//< Optimization omit
 
   // Emit the operator instruction.
   switch (operatorType) {
@@ -882,6 +1703,10 @@ ParseRule rules[] = {
   [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
   [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, // [big]
   [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
+//> Optimization omit
+  [TOKEN_LEFT_BRACKET]  = {list,     subscript, PREC_CALL},
+  [TOKEN_RIGHT_BRACKET] = {NULL,     NULL,   PREC_NONE},
+//< Optimization omit
   [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
 /* Compiling Expressions rules < Classes and Instances table-dot
   [TOKEN_DOT]           = {NULL,     NULL,   PREC_NONE},
@@ -996,6 +1821,9 @@ static void parsePrecedence(Precedence precedence) {
 */
 //> precedence-body
   advance();
+//> Optimization omit
+  int start = currentChunk()->count;
+//< Optimization omit
   ParseFn prefixRule = getRule(parser.previous.type)->prefix;
   if (prefixRule == NULL) {
     error("Expect expression.");
@@ -1018,6 +1846,9 @@ static void parsePrecedence(Precedence precedence) {
     infixRule();
 */
 //> Global Variables infix-rule
+//> Optimization omit
+    parser.leftStart = start;
+//< Optimization omit
     infixRule(canAssign);
 //< Global Variables infix-rule
   }
@@ -1055,10 +1886,127 @@ static void block() {
   consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
 }
 //< Local Variables block
+//> Optimization omit
+// How many tokens escapesScope() looks at before giving up. Every
+// local function scans its own scope, so without a bound, a long block
+// of them would take time quadratic in its length to compile.
+#define MAX_ESCAPE_SCAN 4096
+
+// Whether the local function [name], whose parameter list starts at
+// the current token, could be called after its enclosing call returns.
+// It can't if the rest of its scope only ever calls it directly, and
+// not from inside another function or class. Errs on the side of yes,
+// including when the scope is too long to scan.
+static bool escapesScope(Token* name) {
+  ScannerState saved = saveScanner();
+  Token previous = parser.previous;
+  Token token = parser.current;
+  int depth = 0;
+  // The depth of the nested function or class body the scan is in, or
+  // 0 if none. [isNesting] is set between `fun` or `class` and its body.
+  int nestedDepth = 0;
+  bool isNesting = false;
+  bool escapes = false;
+
+  for (int scanned = 0; token.type != TOKEN_EOF; scanned++) {
+    if (scanned == MAX_ESCAPE_SCAN) {
+      escapes = true;
+      break;
+    }
+
+    Token next = scanToken();
+    if (token.type == TOKEN_FUN || token.type == TOKEN_CLASS) {
+      if (nestedDepth == 0) isNesting = true;
+    } else if (token.type == TOKEN_LEFT_BRACE) {
+      depth++;
+      if (isNesting) {
+        nestedDepth = depth;
+        isNesting = false;
+      }
+    } else if (token.type == TOKEN_RIGHT_BRACE) {
+      if (depth == nestedDepth) nestedDepth = 0;
+      if (--depth < 0) break;
+    } else if (token.type == TOKEN_IDENTIFIER &&
+               previous.type != TOKEN_DOT &&
+               identifiersEqual(&token, name)) {
+      if (nestedDepth != 0 || isNesting ||
+          next.type != TOKEN_LEFT_PAREN) {
+        escapes = true;
+        break;
+      }
+    }
+
+    previous = token;
+    token = next;
+  }
+
+  restoreScanner(saved);
+  return escapes;
+}
+
+// Whether the body of the function [compiler] is for can be compiled
+// on its first call instead. That is limited to functions and methods
+// declared at the top level, which can't capture any variables. The
+// only local there is the "super" of a class with a superclass.
+static bool canDefer(Compiler* compiler) {
+  if (!lazyCompilation) return false;
+  if (compiler->type != TYPE_FUNCTION && compiler->type != TYPE_METHOD) {
+    return false;
+  }
+
+  Compiler* script = compiler->enclosing;
+  if (script->type != TYPE_SCRIPT) return false;
+
+  Token super = syntheticToken("super");
+  for (int i = 1; i < script->localCount; i++) {
+    if (!identifiersEqual(&script->locals[i].name, &super)) return false;
+  }
+
+  return true;
+}
+
+// Checks the parameter list and body of the function [compiler] is
+// for, and emits a closure whose body will be compiled when it is
+// first called. Returns false, leaving the parser where it was, if the
+// body has errors or is too big and must be compiled now.
+static bool deferFunction(Compiler* compiler) {
+  FunctionKind kind =
+      compiler->type == TYPE_METHOD ? KIND_METHOD : KIND_FUNCTION;
+  Token previous = parser.previous;
+  Token next = parser.current;
+  int arity;
+  ScannerState state = saveScanner();
+  if (!preparseFunction(kind, &previous, &next, &arity)) {
+    restoreScanner(state);
+    return false;
+  }
+
+  ObjFunction* function = compiler->function;
+  function->arity = arity;
+  function->lazySource = parser.current.start;
+  function->lazyLine = parser.current.line;
+  function->lazyMethod = kind == KIND_METHOD;
+
+  parser.previous = previous;
+  parser.current = next;
+  current = compiler->enclosing;
+  freeCompiler(compiler);
+  emitOperand(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+  return true;
+}
+
+//< Optimization omit
 //> Calls and Functions compile-function
 static void function(FunctionType type) {
   Compiler compiler;
   initCompiler(&compiler, type);
+//> Optimization omit
+  if (canDefer(&compiler) && deferFunction(&compiler)) return;
+
+  if (type == TYPE_FUNCTION && compiler.enclosing->scopeDepth > 0) {
+    compiler.escapes = escapesScope(&parser.previous);
+  }
+//< Optimization omit
   beginScope(); // [no-end-scope]
 
   // Compile the parameter list.
@@ -1071,7 +2019,12 @@ static void function(FunctionType type) {
         errorAtCurrent("Can't have more than 255 parameters.");
       }
       
+/* Calls and Functions parameters < Optimization omit
       uint8_t paramConstant = parseVariable(
+*/
+//> Optimization omit
+      int paramConstant = parseVariable(
+//< Optimization omit
           "Expect parameter name.");
       defineVariable(paramConstant);
     } while (match(TOKEN_COMMA));
@@ -1089,21 +2042,44 @@ static void function(FunctionType type) {
   emitBytes(OP_CONSTANT, makeConstant(OBJ_VAL(function)));
 */
 //> Closures emit-closure
+/* Closures emit-closure < Optimization omit
   emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+*/
+//> Optimization omit
+  emitOperand(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+//< Optimization omit
 //< Closures emit-closure
 //> Closures capture-upvalues
 
   for (int i = 0; i < function->upvalueCount; i++) {
+/* Closures capture-upvalues < Optimization omit
     emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
     emitByte(compiler.upvalues[i].index);
+*/
+//> Optimization omit
+    emitCapture(&compiler.upvalues[i]);
+//< Optimization omit
   }
 //< Closures capture-upvalues
+//> Optimization omit
+
+  for (int i = 0; i < function->captureCount; i++) {
+    emitCapture(&compiler.captures[i]);
+  }
+
+  freeCompiler(&compiler);
+//< Optimization omit
 }
 //< Calls and Functions compile-function
 //> Methods and Initializers method
 static void method() {
   consume(TOKEN_IDENTIFIER, "Expect method name.");
+/* Methods and Initializers method < Optimization omit
   uint8_t constant = identifierConstant(&parser.previous);
+*/
+//> Optimization omit
+  int constant = identifierConstant(&parser.previous);
+//< Optimization omit
 //> method-body
 
 //< method-body
@@ -1123,7 +2099,12 @@ static void method() {
 //> method-body
   function(type);
 //< method-body
+/* Methods and Initializers method < Optimization omit
   emitBytes(OP_METHOD, constant);
+*/
+//> Optimization omit
+  emitOperand(OP_METHOD, constant);
+//< Optimization omit
 }
 //< Methods and Initializers method
 //> Classes and Instances class-declaration
@@ -1132,10 +2113,20 @@ static void classDeclaration() {
 //> Methods and Initializers class-name
   Token className = parser.previous;
 //< Methods and Initializers class-name
+/* Classes and Instances class-declaration < Optimization omit
   uint8_t nameConstant = identifierConstant(&parser.previous);
+*/
+//> Optimization omit
+  int nameConstant = identifierConstant(&parser.previous);
+//< Optimization omit
   declareVariable();
 
+/* Classes and Instances class-declaration < Optimization omit
   emitBytes(OP_CLASS, nameConstant);
+*/
+//> Optimization omit
+  emitOperand(OP_CLASS, nameConstant);
+//< Optimization omit
   defineVariable(nameConstant);
 
 //> Methods and Initializers create-class-compiler
@@ -1200,15 +2191,58 @@ static void classDeclaration() {
 //< Classes and Instances class-declaration
 //> Calls and Functions fun-declaration
 static void funDeclaration() {
+/* Calls and Functions fun-declaration < Optimization omit
   uint8_t global = parseVariable("Expect function name.");
+*/
+//> Optimization omit
+  int global = parseVariable("Expect function name.");
+//< Optimization omit
   markInitialized();
+/* Calls and Functions fun-declaration < Optimization omit
   function(TYPE_FUNCTION);
+*/
+//> Optimization omit
+  if (current->scopeDepth > 0) {
+    Local* local = &current->locals[current->localCount - 1];
+    local->isDefining = true;
+    function(TYPE_FUNCTION);
+    local->isDefining = false;
+  } else {
+    function(TYPE_FUNCTION);
+  }
+//< Optimization omit
   defineVariable(global);
 }
 //< Calls and Functions fun-declaration
+//> Optimization omit
+// Lets uses of the local just declared load its value directly if it
+// is a constant that never changes, so they can be folded.
+static void recordConstantLocal(int initializerStart) {
+  Local* local = &current->locals[current->localCount - 1];
+  Value value;
+  if (!constantOperand(initializerStart, currentChunk()->count, &value) ||
+      isAssignedLater(&local->name, 0)) {
+    return;
+  }
+
+  local->constantLength = currentChunk()->count - initializerStart;
+  memcpy(local->constantCode, &currentChunk()->code[initializerStart],
+         local->constantLength);
+  current->keptConstants = currentChunk()->constants.count;
+}
+
+//< Optimization omit
 //> Global Variables var-declaration
 static void varDeclaration() {
+/* Global Variables var-declaration < Optimization omit
   uint8_t global = parseVariable("Expect variable name.");
+*/
+//> Optimization omit
+  int global = parseVariable("Expect variable name.");
+//< Optimization omit
+//> Optimization omit
+  int initializerStart = currentChunk()->count;
+//< Optimization omit
 
   if (match(TOKEN_EQUAL)) {
     expression();
@@ -1217,6 +2251,12 @@ static void varDeclaration() {
   }
   consume(TOKEN_SEMICOLON,
           "Expect ';' after variable declaration.");
+//> Optimization omit
+
+  if (current->scopeDepth > 0 && !parser.hadError) {
+    recordConstantLocal(initializerStart);
+  }
+//< Optimization omit
 
   defineVariable(global);
 }
@@ -1483,6 +2523,10 @@ bool compile(const char* source, Chunk* chunk) {
 //> Calls and Functions compile-signature
 ObjFunction* compile(const char* source) {
 //< Calls and Functions compile-signature
+//> Optimization omit
+  if (useAstCompiler) return compileAst(source);
+
+//< Optimization omit
   initScanner(source);
 /* Scanning on Demand dump-tokens < Compiling Expressions compile-chunk
   int line = -1;
@@ -1518,6 +2562,9 @@ ObjFunction* compile(const char* source) {
   parser.panicMode = false;
 
 //< init-parser-error
+//> Optimization omit
+  parser.braceDepth = 0;
+//< Optimization omit
   advance();
 //< Compiling Expressions compile-chunk
 /* Compiling Expressions compile-chunk < Global Variables compile
@@ -1539,9 +2586,59 @@ ObjFunction* compile(const char* source) {
 */
 //> Calls and Functions call-end-compiler
   ObjFunction* function = endCompiler();
+//> Optimization omit
+  freeCompiler(&compiler);
+  freeAssignments();
+//< Optimization omit
   return parser.hadError ? NULL : function;
 //< Calls and Functions call-end-compiler
 }
+//> Optimization omit
+bool compileLazily(ObjFunction* deferred) {
+  ScannerState state;
+  state.start = deferred->lazySource;
+  state.current = deferred->lazySource;
+  state.line = deferred->lazyLine;
+  restoreScanner(state);
+
+  // Compile it as the only function in an otherwise empty script.
+  Compiler compiler;
+  initCompiler(&compiler, TYPE_SCRIPT);
+
+  ClassCompiler classCompiler;
+  classCompiler.enclosing = NULL;
+  classCompiler.name = syntheticToken("");
+  classCompiler.hasSuperclass = false;
+  if (deferred->lazyMethod) currentClass = &classCompiler;
+
+  parser.hadError = false;
+  parser.panicMode = false;
+  parser.braceDepth = deferred->lazyMethod ? 1 : 0;
+  advance();
+
+  parser.previous.type = TOKEN_IDENTIFIER;
+  parser.previous.start = deferred->name->chars;
+  parser.previous.length = deferred->name->length;
+  lazyCompilation = false;
+  function(deferred->lazyMethod ? TYPE_METHOD : TYPE_FUNCTION);
+  lazyCompilation = true;
+
+  current = NULL;
+  currentClass = NULL;
+  freeCompiler(&compiler);
+  freeAssignments();
+  if (parser.hadError) return false;
+
+  ObjFunction* function =
+      AS_FUNCTION(compiler.function->chunk.constants.values[0]);
+  deferred->chunk = function->chunk;
+  deferred->slotCount = function->slotCount;
+  initChunk(&function->chunk);
+  deferred->lazySource = NULL;
+  return true;
+}
+
+//< Optimization omit
 //> Garbage Collection mark-compiler-roots
 void markCompilerRoots() {
   Compiler* compiler = current;
@@ -1549,5 +2646,9 @@ void markCompilerRoots() {
     markObject((Obj*)compiler->function);
     compiler = compiler->enclosing;
   }
+//> Optimization omit
+
+  markAstRoots();
+//< Optimization omit
 }
 //< Garbage Collection mark-compiler-roots
@@ -21,5 +21,19 @@ ObjFunction* compile(const char* source);
 //> Garbage Collection mark-compiler-roots-h
 void markCompilerRoots();
 //< Garbage Collection mark-compiler-roots-h
+//> Optimization omit
+
+// When set, compile() builds a syntax tree and optimizes it before
+// emitting code instead of compiling in a single pass. See ast.h.
+extern bool useAstCompiler;
+
+// When set, the bodies of top-level functions and methods are only
+// checked for errors up front, and compiled on their first call. The
+// source must outlive every function compiled from it.
+extern bool lazyCompilation;
+
+// Compiles the body of a function whose compilation was deferred.
+bool compileLazily(ObjFunction* function);
+//< Optimization omit
 
 #endif
@@ -63,16 +63,153 @@ static int jumpInstruction(const char* name, int sign,
   return offset + 3;
 }
 //< Jumping Back and Forth jump-instruction
+//> Optimization omit
+// A jump with a constant after its offset.
+static int jumpConstantInstruction(const char* name, Chunk* chunk,
+                                   int offset) {
+  uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
+  jump |= chunk->code[offset + 2];
+  uint8_t constant = chunk->code[offset + 3];
+  printf("%-16s %4d -> %d '", name, offset, offset + 4 + jump);
+  printValue(chunk->constants.values[constant]);
+  printf("'\n");
+  return offset + 4;
+}
+
+static int farJumpInstruction(const char* name, int sign,
+                              Chunk* chunk, int offset) {
+  int constant = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+  int jump = (int)AS_NUMBER(chunk->constants.values[constant]);
+  printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+  return offset + 3;
+}
+
+// Prints the variables an OP_CLOSURE for [function] captures, listed
+// from [offset] on, and returns the offset after them.
+static int captureList(Chunk* chunk, int offset, ObjFunction* function) {
+  int count = function->upvalueCount + function->captureCount;
+  for (int j = 0; j < count; j++) {
+    int start = offset;
+    uint8_t flags = chunk->code[offset++];
+    int index = chunk->code[offset++];
+    if (flags & CAPTURE_WIDE) index = (index << 8) | chunk->code[offset++];
+
+    bool isLocal = (flags & 1) != 0;
+    const char* kind;
+    if (j < function->upvalueCount) {
+      kind = isLocal ? "local" : "upvalue";
+    } else {
+      kind = isLocal ? "copy local" : "copy capture";
+    }
+    printf("%04d      |                     %s %d\n", start, kind, index);
+  }
+
+  return offset;
+}
+
+// Prints the operands of each instruction in a superinstruction.
+static int superInstruction(const char* name, Chunk* chunk, int offset) {
+  const Superinstruction* super =
+      &superinstructions[chunk->code[offset] - FIRST_SUPERINSTRUCTION];
+  printf("%-16s", name);
+  int operand = offset + 1;
+  for (int i = 0; i < super->count; i++) {
+    switch (super->parts[i]) {
+      case OP_CONSTANT: {
+        uint8_t constant = chunk->code[operand++];
+        printf(" %4d '", constant);
+        printValue(chunk->constants.values[constant]);
+        printf("'");
+        break;
+      }
+      case OP_GET_LOCAL:
+      case OP_SET_LOCAL:
+      case OP_SET_LOCAL_POP:
+      case OP_GET_UPVALUE:
+        printf(" %4d", chunk->code[operand++]);
+        break;
+      default:
+        break;
+    }
+  }
+  printf("\n");
+  return operand;
+}
+
+// An instruction after OP_WIDE, whose first operand is two bytes.
+static int wideInstruction(Chunk* chunk, int offset) {
+  uint8_t instruction = chunk->code[offset + 1];
+  int operand = (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+  const char* name;
+  bool isNumber = false;
+  switch (instruction) {
+    case OP_CONSTANT: name = "OP_CONSTANT"; break;
+    case OP_GET_LOCAL: name = "OP_GET_LOCAL"; isNumber = true; break;
+    case OP_SET_LOCAL: name = "OP_SET_LOCAL"; isNumber = true; break;
+    case OP_GET_GLOBAL: name = "OP_GET_GLOBAL"; break;
+    case OP_DEFINE_GLOBAL: name = "OP_DEFINE_GLOBAL"; break;
+    case OP_SET_GLOBAL: name = "OP_SET_GLOBAL"; break;
+    case OP_GET_UPVALUE: name = "OP_GET_UPVALUE"; isNumber = true; break;
+    case OP_SET_UPVALUE: name = "OP_SET_UPVALUE"; isNumber = true; break;
+    case OP_GET_CAPTURE: name = "OP_GET_CAPTURE"; isNumber = true; break;
+    case OP_GET_OUTER: name = "OP_GET_OUTER"; isNumber = true; break;
+    case OP_SET_OUTER: name = "OP_SET_OUTER"; isNumber = true; break;
+    case OP_GET_PROPERTY: name = "OP_GET_PROPERTY"; break;
+    case OP_SET_PROPERTY: name = "OP_SET_PROPERTY"; break;
+    case OP_GET_SUPER: name = "OP_GET_SUPER"; break;
+    case OP_BUILD_LIST: name = "OP_BUILD_LIST"; isNumber = true; break;
+    case OP_INVOKE: name = "OP_INVOKE"; break;
+    case OP_SUPER_INVOKE: name = "OP_SUPER_INVOKE"; break;
+    case OP_CLOSURE: name = "OP_CLOSURE"; break;
+    case OP_CLASS: name = "OP_CLASS"; break;
+    case OP_METHOD: name = "OP_METHOD"; break;
+    default:
+      printf("Unknown wide opcode %d\n", instruction);
+      return offset + 4;
+  }
+
+  printf("OP_WIDE %-16s ", name);
+  if (isNumber) {
+    printf("%4d\n", operand);
+    return offset + 4;
+  }
+
+  bool isInvoke =
+      instruction == OP_INVOKE || instruction == OP_SUPER_INVOKE;
+  if (isInvoke) printf("(%d args) ", chunk->code[offset + 4]);
+
+  Value constant = chunk->constants.values[operand];
+  printf("%4d '", operand);
+  printValue(constant);
+  printf("'\n");
+
+  if (isInvoke) return offset + 5;
+  if (instruction == OP_CLOSURE) {
+    return captureList(chunk, offset + 4, AS_FUNCTION(constant));
+  }
+  return offset + 4;
+}
+//< Optimization omit
 //> disassemble-instruction
 int disassembleInstruction(Chunk* chunk, int offset) {
   printf("%04d ", offset);
 //> show-location
+/* Chunks of Bytecode show-location < Optimization omit
   if (offset > 0 &&
       chunk->lines[offset] == chunk->lines[offset - 1]) {
     printf("   | ");
   } else {
     printf("%4d ", chunk->lines[offset]);
   }
+*/
+//> Optimization omit
+  int line = getLine(chunk, offset);
+  if (offset > 0 && line == getLine(chunk, offset - 1)) {
+    printf("   | ");
+  } else {
+    printf("%4d ", line);
+  }
+//< Optimization omit
 //< show-location
   
   uint8_t instruction = chunk->code[offset];
@@ -81,6 +218,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
     case OP_CONSTANT:
       return constantInstruction("OP_CONSTANT", chunk, offset);
 //< disassemble-constant
+//> Optimization omit
+    case OP_WIDE:
+      return wideInstruction(chunk, offset);
+//< Optimization omit
 //> Types of Values disassemble-literals
     case OP_NIL:
       return simpleInstruction("OP_NIL", offset);
@@ -98,6 +239,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return byteInstruction("OP_GET_LOCAL", chunk, offset);
     case OP_SET_LOCAL:
       return byteInstruction("OP_SET_LOCAL", chunk, offset);
+//> Optimization omit
+    case OP_SET_LOCAL_POP:
+      return byteInstruction("OP_SET_LOCAL_POP", chunk, offset);
+//< Optimization omit
 //< Local Variables disassemble-local
 //> Global Variables disassemble-get-global
     case OP_GET_GLOBAL:
@@ -118,11 +263,27 @@ int disassembleInstruction(Chunk* chunk, int offset) {
     case OP_SET_UPVALUE:
       return byteInstruction("OP_SET_UPVALUE", chunk, offset);
 //< Closures disassemble-upvalue-ops
+//> Optimization omit
+    case OP_GET_CAPTURE:
+      return byteInstruction("OP_GET_CAPTURE", chunk, offset);
+    case OP_GET_OUTER:
+      return byteInstruction("OP_GET_OUTER", chunk, offset);
+    case OP_SET_OUTER:
+      return byteInstruction("OP_SET_OUTER", chunk, offset);
+//< Optimization omit
 //> Classes and Instances disassemble-property-ops
     case OP_GET_PROPERTY:
       return constantInstruction("OP_GET_PROPERTY", chunk, offset);
     case OP_SET_PROPERTY:
       return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+//> Optimization omit
+    case OP_BUILD_LIST:
+      return byteInstruction("OP_BUILD_LIST", chunk, offset);
+    case OP_GET_INDEX:
+      return simpleInstruction("OP_GET_INDEX", offset);
+    case OP_SET_INDEX:
+      return simpleInstruction("OP_SET_INDEX", offset);
+//< Optimization omit
 //< Classes and Instances disassemble-property-ops
 //> Superclasses disassemble-get-super
     case OP_GET_SUPER:
@@ -135,6 +296,14 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return simpleInstruction("OP_GREATER", offset);
     case OP_LESS:
       return simpleInstruction("OP_LESS", offset);
+//> Optimization omit
+    case OP_NOT_EQUAL:
+      return simpleInstruction("OP_NOT_EQUAL", offset);
+    case OP_GREATER_EQUAL:
+      return simpleInstruction("OP_GREATER_EQUAL", offset);
+    case OP_LESS_EQUAL:
+      return simpleInstruction("OP_LESS_EQUAL", offset);
+//< Optimization omit
 //< Types of Values disassemble-comparison
 //> A Virtual Machine disassemble-binary
     case OP_ADD:
@@ -163,10 +332,45 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return jumpInstruction("OP_JUMP", 1, chunk, offset);
     case OP_JUMP_IF_FALSE:
       return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+//> Optimization omit
+    case OP_JUMP_IF_TRUE:
+      return jumpInstruction("OP_JUMP_IF_TRUE", 1, chunk, offset);
+    case OP_JUMP_FAR:
+      return farJumpInstruction("OP_JUMP_FAR", 1, chunk, offset);
+    case OP_JUMP_IF_FALSE_FAR:
+      return farJumpInstruction("OP_JUMP_IF_FALSE_FAR", 1, chunk,
+                                offset);
+    case OP_JUMP_IF_NOT_LESS:
+      return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+      return jumpInstruction("OP_JUMP_IF_NOT_LESS_EQUAL", 1, chunk,
+                             offset);
+    case OP_JUMP_IF_NOT_GREATER:
+      return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER_EQUAL:
+      return jumpInstruction("OP_JUMP_IF_NOT_GREATER_EQUAL", 1, chunk,
+                             offset);
+    case OP_JUMP_IF_NOT_LESS_CONSTANT:
+      return jumpConstantInstruction("OP_JUMP_IF_NOT_LESS_CONSTANT",
+                                     chunk, offset);
+    case OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT:
+      return jumpConstantInstruction(
+          "OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT", chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER_CONSTANT:
+      return jumpConstantInstruction("OP_JUMP_IF_NOT_GREATER_CONSTANT",
+                                     chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT:
+      return jumpConstantInstruction(
+          "OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT", chunk, offset);
+//< Optimization omit
 //< Jumping Back and Forth disassemble-jump
 //> Jumping Back and Forth disassemble-loop
     case OP_LOOP:
       return jumpInstruction("OP_LOOP", -1, chunk, offset);
+//> Optimization omit
+    case OP_LOOP_FAR:
+      return farJumpInstruction("OP_LOOP_FAR", -1, chunk, offset);
+//< Optimization omit
 //< Jumping Back and Forth disassemble-loop
 //> Calls and Functions disassemble-call
     case OP_CALL:
@@ -175,6 +379,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 //> Methods and Initializers disassemble-invoke
     case OP_INVOKE:
       return invokeInstruction("OP_INVOKE", chunk, offset);
+//> Optimization omit
+    case OP_GUARD_CALL:
+      return jumpConstantInstruction("OP_GUARD_CALL", chunk, offset);
+    case OP_GUARD_INVOKE:
+      return jumpConstantInstruction("OP_GUARD_INVOKE", chunk, offset);
+//< Optimization omit
 //< Methods and Initializers disassemble-invoke
 //> Superclasses disassemble-super-invoke
     case OP_SUPER_INVOKE:
@@ -191,6 +401,7 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 //> disassemble-upvalues
       ObjFunction* function = AS_FUNCTION(
           chunk->constants.values[constant]);
+/* Closures disassemble-upvalues < Optimization omit
       for (int j = 0; j < function->upvalueCount; j++) {
         int isLocal = chunk->code[offset++];
         int index = chunk->code[offset++];
@@ -198,6 +409,11 @@ int disassembleInstruction(Chunk* chunk, int offset) {
                offset - 2, isLocal ? "local" : "upvalue", index);
       }
       
+*/
+//> Optimization omit
+      offset = captureList(chunk, offset, function);
+
+//< Optimization omit
 //< disassemble-upvalues
       return offset;
     }
@@ -208,6 +424,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 //< Closures disassemble-close-upvalue
     case OP_RETURN:
       return simpleInstruction("OP_RETURN", offset);
+//> Optimization omit
+    case OP_RETURN_NIL:
+      return simpleInstruction("OP_RETURN_NIL", offset);
+//< Optimization omit
 //> Classes and Instances disassemble-class
     case OP_CLASS:
       return constantInstruction("OP_CLASS", chunk, offset);
@@ -220,6 +440,15 @@ int disassembleInstruction(Chunk* chunk, int offset) {
     case OP_METHOD:
       return constantInstruction("OP_METHOD", chunk, offset);
 //< Methods and Initializers disassemble-method
+//> Optimization omit
+#define PAIR(name, a, b) \
+    case OP_##name: \
+      return superInstruction("OP_" #name, chunk, offset);
+#define TRIPLE(name, a, b, c) PAIR(name, a, b)
+    SUPERINSTRUCTIONS(PAIR, TRIPLE)
+#undef PAIR
+#undef TRIPLE
+//< Optimization omit
     default:
       printf("Unknown opcode %d\n", instruction);
       return offset + 1;
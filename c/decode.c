@@ -0,0 +1,240 @@
+//> Optimization omit
+#include "decode.h"
+#include "memory.h"
+#include "object.h"
+
+// Decoding takes two passes over the code. The first only counts the
+// words each instruction needs, so that the second knows where every
+// jump lands.
+typedef struct {
+  Chunk* chunk;
+  // The index of the first word of the instruction at each offset, and
+  // of the end at [chunk->count].
+  int* wordStarts;
+  // NULL during the first pass.
+  Word* words;
+  int* wordOffsets;
+  int count;
+} Decoder;
+
+// Adds a word decoded from the code at [source].
+static void emit(Decoder* decoder, int source, Word word) {
+  if (decoder->words != NULL) {
+    decoder->words[decoder->count] = word;
+    decoder->wordOffsets[decoder->count] = source;
+  }
+  decoder->count++;
+}
+
+static void emitValue(Decoder* decoder, int source, uint32_t value) {
+  Word word;
+  word.value = value;
+  emit(decoder, source, word);
+}
+
+static void emitConstant(Decoder* decoder, int source, int constant) {
+  Word word;
+  word.constant = &decoder->chunk->constants.values[constant];
+  emit(decoder, source, word);
+}
+
+// Adds the offset of a jump that is [length] bytes long, counting
+// anything after the offset, and lands on [target].
+static void emitJump(Decoder* decoder, int offset, int length,
+                     int target) {
+  uint32_t jump = 0;
+  if (decoder->words != NULL) {
+    int origin = decoder->wordStarts[offset + length];
+    int destination = decoder->wordStarts[target];
+    jump = (uint32_t)(destination > origin ? destination - origin
+                                           : origin - destination);
+  }
+  emitValue(decoder, offset + 1, jump);
+}
+
+// Adds the variables captured by an OP_CLOSURE for the function in
+// [constant], listed from [offset] on, as an isLocal flag and an index
+// each. Returns the offset after them.
+static int emitCaptures(Decoder* decoder, int offset, int constant) {
+  uint8_t* code = decoder->chunk->code;
+  ObjFunction* function =
+      AS_FUNCTION(decoder->chunk->constants.values[constant]);
+  int count = function->upvalueCount + function->captureCount;
+  for (int i = 0; i < count; i++) {
+    uint8_t flags = code[offset];
+    int index = code[offset + 1];
+    int length = 2;
+    if (flags & CAPTURE_WIDE) {
+      index = (index << 8) | code[offset + 2];
+      length = 3;
+    }
+
+    emitValue(decoder, offset, flags & 1);
+    emitValue(decoder, offset + 1, (uint32_t)index);
+    offset += length;
+  }
+  return offset;
+}
+
+static int decodeSuperinstruction(Decoder* decoder, int offset) {
+  uint8_t* code = decoder->chunk->code;
+  const Superinstruction* super =
+      &superinstructions[code[offset] - FIRST_SUPERINSTRUCTION];
+  int operand = offset + 1;
+  for (int i = 0; i < super->count; i++) {
+    switch (super->parts[i]) {
+      case OP_CONSTANT:
+        emitConstant(decoder, operand, code[operand]);
+        operand++;
+        break;
+      case OP_GET_LOCAL:
+      case OP_SET_LOCAL:
+      case OP_SET_LOCAL_POP:
+      case OP_GET_UPVALUE:
+        emitValue(decoder, operand, code[operand]);
+        operand++;
+        break;
+      default:
+        break;
+    }
+  }
+  return operand;
+}
+
+// Decodes the instruction at [offset] and returns the offset of the
+// next one.
+static int decodeInstruction(Decoder* decoder, int offset) {
+  uint8_t* code = decoder->chunk->code;
+  uint8_t instruction = code[offset];
+  emitValue(decoder, offset, instruction);
+
+  if (instruction >= FIRST_SUPERINSTRUCTION) {
+    return decodeSuperinstruction(decoder, offset);
+  }
+
+  switch (instruction) {
+    case OP_CONSTANT:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_GET_SUPER:
+    case OP_CLASS:
+    case OP_METHOD:
+      emitConstant(decoder, offset + 1, code[offset + 1]);
+      return offset + 2;
+
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_SET_LOCAL_POP:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_CAPTURE:
+    case OP_GET_OUTER:
+    case OP_SET_OUTER:
+    case OP_BUILD_LIST:
+    case OP_CALL:
+      emitValue(decoder, offset + 1, code[offset + 1]);
+      return offset + 2;
+
+    case OP_INVOKE:
+    case OP_SUPER_INVOKE:
+      emitConstant(decoder, offset + 1, code[offset + 1]);
+      emitValue(decoder, offset + 2, code[offset + 2]);
+      return offset + 3;
+
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_JUMP_IF_TRUE:
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+    case OP_JUMP_IF_NOT_GREATER:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    case OP_LOOP: {
+      int jump = (code[offset + 1] << 8) | code[offset + 2];
+      int origin = offset + 3;
+      emitJump(decoder, offset, 3, instruction == OP_LOOP
+          ? origin - jump : origin + jump);
+      return origin;
+    }
+
+    case OP_GUARD_CALL:
+    case OP_GUARD_INVOKE:
+    case OP_JUMP_IF_NOT_LESS_CONSTANT:
+    case OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT:
+    case OP_JUMP_IF_NOT_GREATER_CONSTANT:
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT: {
+      int jump = (code[offset + 1] << 8) | code[offset + 2];
+      emitJump(decoder, offset, 4, offset + 4 + jump);
+      emitConstant(decoder, offset + 3, code[offset + 3]);
+      return offset + 4;
+    }
+
+    case OP_JUMP_FAR:
+    case OP_JUMP_IF_FALSE_FAR:
+    case OP_LOOP_FAR: {
+      // The offset is looked up now instead of on every jump.
+      int constant = (code[offset + 1] << 8) | code[offset + 2];
+      int jump =
+          (int)AS_NUMBER(decoder->chunk->constants.values[constant]);
+      int origin = offset + 3;
+      emitJump(decoder, offset, 3, instruction == OP_LOOP_FAR
+          ? origin - jump : origin + jump);
+      return origin;
+    }
+
+    case OP_CLOSURE:
+      emitConstant(decoder, offset + 1, code[offset + 1]);
+      return emitCaptures(decoder, offset + 2, code[offset + 1]);
+
+    case OP_WIDE: {
+      // Instructions with a two-byte operand are rare enough that the
+      // VM still handles them apart, and looks up their constants
+      // itself.
+      uint8_t wide = code[offset + 1];
+      int operand = (code[offset + 2] << 8) | code[offset + 3];
+      emitValue(decoder, offset + 1, wide);
+      emitValue(decoder, offset + 2, (uint32_t)operand);
+      if (wide == OP_INVOKE || wide == OP_SUPER_INVOKE) {
+        emitValue(decoder, offset + 4, code[offset + 4]);
+        return offset + 5;
+      } else if (wide == OP_CLOSURE) {
+        return emitCaptures(decoder, offset + 4, operand);
+      }
+      return offset + 4;
+    }
+
+    default:
+      return offset + 1;
+  }
+}
+
+void decodeChunk(Chunk* chunk) {
+  Decoder decoder;
+  decoder.chunk = chunk;
+  decoder.wordStarts = ALLOCATE(int, chunk->count + 1);
+  decoder.words = NULL;
+  decoder.wordOffsets = NULL;
+  decoder.count = 0;
+
+  for (int offset = 0; offset < chunk->count;) {
+    decoder.wordStarts[offset] = decoder.count;
+    offset = decodeInstruction(&decoder, offset);
+  }
+  decoder.wordStarts[chunk->count] = decoder.count;
+
+  int wordCount = decoder.count;
+  decoder.words = ALLOCATE(Word, wordCount);
+  decoder.wordOffsets = ALLOCATE(int, wordCount);
+  decoder.count = 0;
+  for (int offset = 0; offset < chunk->count;) {
+    offset = decodeInstruction(&decoder, offset);
+  }
+
+  FREE_ARRAY(int, decoder.wordStarts, chunk->count + 1);
+  chunk->words = decoder.words;
+  chunk->wordOffsets = decoder.wordOffsets;
+  chunk->wordCount = wordCount;
+}
+//< Optimization omit
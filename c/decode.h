@@ -0,0 +1,12 @@
+//> Optimization omit
+#ifndef clox_decode_h
+#define clox_decode_h
+
+#include "chunk.h"
+
+// Fills in [chunk]'s words from its code. The chunk must be packed, so
+// that its constants don't move afterwards.
+void decodeChunk(Chunk* chunk);
+
+#endif
+//< Optimization omit
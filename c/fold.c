@@ -0,0 +1,115 @@
+//> Optimization omit
+#include <math.h>
+#include <string.h>
+
+#include "fold.h"
+#include "memory.h"
+#include "object.h"
+
+// Like the VM, but integral results go back to being ints.
+static Value foldedNumber(double number) {
+  if (number >= INT32_MIN && number <= INT32_MAX &&
+      number == (int32_t)number && !signbit(number)) {
+    return INT_VAL((int32_t)number);
+  }
+  return NUMBER_VAL(number);
+}
+
+bool isFalseyConstant(Value value) {
+  return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static Value concatenateConstants(Value a, Value b) {
+  char aBuffer[SHORT_STRING_MAX + 1];
+  char bBuffer[SHORT_STRING_MAX + 1];
+  int aLength;
+  int bLength;
+  const char* aChars = stringChars(a, aBuffer, &aLength);
+  const char* bChars = stringChars(b, bBuffer, &bLength);
+
+  int length = aLength + bLength;
+  if (length <= SHORT_STRING_MAX) {
+    char chars[SHORT_STRING_MAX + 1];
+    memcpy(chars, aChars, aLength);
+    memcpy(chars + aLength, bChars, bLength);
+    return stringValue(chars, length);
+  }
+
+  char* chars = ALLOCATE(char, length + 1);
+  memcpy(chars, aChars, aLength);
+  memcpy(chars + aLength, bChars, bLength);
+  chars[length] = '\0';
+  return OBJ_VAL(takeString(chars, length));
+}
+
+bool evaluateUnary(TokenType operatorType, Value operand, Value* result) {
+  switch (operatorType) {
+    case TOKEN_BANG:
+      *result = BOOL_VAL(isFalseyConstant(operand));
+      return true;
+    case TOKEN_MINUS:
+      if (!IS_NUMBER(operand)) return false;
+      *result = foldedNumber(-AS_NUMBER(operand));
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool evaluateBinary(TokenType operatorType, Value a, Value b,
+                    Value* result) {
+  bool numbers = IS_NUMBER(a) && IS_NUMBER(b);
+  double x = numbers ? AS_NUMBER(a) : 0;
+  double y = numbers ? AS_NUMBER(b) : 0;
+
+  switch (operatorType) {
+    case TOKEN_BANG_EQUAL:
+      *result = BOOL_VAL(!valuesEqual(a, b));
+      return true;
+    case TOKEN_EQUAL_EQUAL:
+      *result = BOOL_VAL(valuesEqual(a, b));
+      return true;
+    // These mirror how the VM composes <= and >= from > and <, so NaN
+    // compares the same way.
+    case TOKEN_GREATER:
+      if (!numbers) return false;
+      *result = BOOL_VAL(x > y);
+      return true;
+    case TOKEN_GREATER_EQUAL:
+      if (!numbers) return false;
+      *result = BOOL_VAL(!(x < y));
+      return true;
+    case TOKEN_LESS:
+      if (!numbers) return false;
+      *result = BOOL_VAL(x < y);
+      return true;
+    case TOKEN_LESS_EQUAL:
+      if (!numbers) return false;
+      *result = BOOL_VAL(!(x > y));
+      return true;
+    case TOKEN_PLUS:
+      if (IS_ANY_STRING(a) && IS_ANY_STRING(b)) {
+        *result = concatenateConstants(a, b);
+      } else if (numbers) {
+        *result = foldedNumber(x + y);
+      } else {
+        return false;
+      }
+      return true;
+    case TOKEN_MINUS:
+      if (!numbers) return false;
+      *result = foldedNumber(x - y);
+      return true;
+    case TOKEN_STAR:
+      if (!numbers) return false;
+      *result = foldedNumber(x * y);
+      return true;
+    case TOKEN_SLASH:
+      if (!numbers) return false;
+      *result = foldedNumber(x / y);
+      return true;
+    default:
+      return false;
+  }
+}
+//< Optimization omit
@@ -0,0 +1,18 @@
+//> Optimization omit
+#ifndef clox_fold_h
+#define clox_fold_h
+
+#include "scanner.h"
+#include "value.h"
+
+// Compile-time evaluation of operators on constant operands, shared by
+// the single-pass compiler and the syntax tree optimizer. Each returns
+// false if the result can't be known until runtime, including when
+// the operation would be a runtime error that the VM should report.
+bool isFalseyConstant(Value value);
+bool evaluateUnary(TokenType operatorType, Value operand, Value* result);
+bool evaluateBinary(TokenType operatorType, Value a, Value b,
+                    Value* result);
+
+#endif
+//< Optimization omit
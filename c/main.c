@@ -5,6 +5,16 @@
 #include <string.h>
 
 //< Scanning on Demand main-includes
+//> Optimization omit
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//< Optimization omit
 #include "common.h"
 //> main-include-chunk
 #include "chunk.h"
@@ -15,6 +25,59 @@
 //> A Virtual Machine main-include-vm
 #include "vm.h"
 //< A Virtual Machine main-include-vm
+//> Optimization omit
+#include "cache.h"
+#include "compiler.h"
+//< Optimization omit
+//> Optimization omit
+
+static bool useCache = false;
+static bool lazy = false;
+static const char* imagePath = NULL;
+static const char* saveImagePath = NULL;
+
+static void usage() {
+  fprintf(stderr, "Usage: clox [options] [path]\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "A path of \"-\" reads the script from standard input.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --ast                Compile through an optimized "
+                  "syntax tree.\n");
+  fprintf(stderr, "  --cache              Cache bytecode in path + \"c\".\n");
+  fprintf(stderr, "  --image <file>       Start from a saved heap image.\n");
+  fprintf(stderr, "  --lazy               Compile functions on their first "
+                  "call.\n");
+  fprintf(stderr, "  --save-image <file>  Save the heap after running.\n");
+  exit(64);
+}
+
+// Consumes any leading "--" options, leaving [argc] and [argv] as if
+// they had never been passed.
+static void parseOptions(int* argc, const char** argv[]) {
+  int i = 1;
+  for (; i < *argc && strncmp((*argv)[i], "--", 2) == 0; i++) {
+    const char* option = (*argv)[i];
+    if (strcmp(option, "--ast") == 0) {
+      useAstCompiler = true;
+    } else if (strcmp(option, "--cache") == 0) {
+      useCache = true;
+    } else if (strcmp(option, "--lazy") == 0) {
+      lazy = true;
+    } else if (strcmp(option, "--image") == 0 && i + 1 < *argc) {
+      imagePath = (*argv)[++i];
+    } else if (strcmp(option, "--save-image") == 0 && i + 1 < *argc) {
+      saveImagePath = (*argv)[++i];
+    } else {
+      fprintf(stderr, "Unknown option \"%s\".\n", option);
+      usage();
+    }
+  }
+
+  *argc -= i - 1;
+  *argv += i - 1;
+}
+//< Optimization omit
 //> Scanning on Demand repl
 
 static void repl() {
@@ -67,11 +130,114 @@ static char* readFile(const char* path) {
   return buffer;
 }
 //< Scanning on Demand read-file
+//> Optimization omit
+// Reads all of [file] a chunk at a time, for pipes and terminals whose
+// size isn't known up front.
+static char* readStream(FILE* file, const char* path) {
+  size_t capacity = 4096;
+  size_t count = 0;
+  char* buffer = (char*)malloc(capacity);
+
+  for (;;) {
+    if (buffer == NULL) {
+      fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+      exit(74);
+    }
+
+    count += fread(buffer + count, sizeof(char), capacity - count - 1,
+                   file);
+    if (count < capacity - 1) break;
+
+    capacity *= 2;
+    buffer = (char*)realloc(buffer, capacity);
+  }
+
+  if (ferror(file)) {
+    fprintf(stderr, "Could not read file \"%s\".\n", path);
+    exit(74);
+  }
+
+  buffer[count] = '\0';
+  return buffer;
+}
+
+// Maps the file at [path] into memory and scans it in place. Pages are
+// read in as the scanner reaches them, so compiling overlaps with the
+// I/O, and the file's contents are never copied. The rest of the last
+// page is zero filled, which terminates the source. Returns NULL if
+// the file can't be mapped, or fills its last page exactly, and sets
+// [*size] to the length of the mapping.
+static char* mapSource(const char* path, size_t* size) {
+#ifdef HAS_MMAP
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0 ||
+      info.st_size % sysconf(_SC_PAGESIZE) == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *size = (size_t)info.st_size;
+  void* bytes = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return bytes == MAP_FAILED ? NULL : (char*)bytes;
+#else
+  return NULL;
+#endif
+}
+
+// Loads the script at [path], or from standard input if it is "-".
+// Sets [*mapped] to the length of its mapping if it was mapped, or 0 if
+// it was read into the heap.
+static char* loadSource(const char* path, size_t* mapped) {
+  *mapped = 0;
+  if (strcmp(path, "-") == 0) return readStream(stdin, "<stdin>");
+
+  char* source = mapSource(path, mapped);
+  if (source != NULL) return source;
+
+  *mapped = 0;
+  return readFile(path);
+}
+
+static void freeSource(char* source, size_t mapped) {
+#ifdef HAS_MMAP
+  if (mapped != 0) {
+    munmap(source, mapped);
+    return;
+  }
+#endif
+
+  free(source);
+}
+//< Optimization omit
 //> Scanning on Demand run-file
 static void runFile(const char* path) {
+/* Scanning on Demand run-file < Optimization omit
   char* source = readFile(path);
   InterpretResult result = interpret(source);
+*/
+//> Optimization omit
+  size_t mapped;
+  char* source = loadSource(path, &mapped);
+  // There is no file to cache the bytecode of standard input next to.
+  bool cached = useCache && strcmp(path, "-") != 0;
+
+  // Cached bytecode and saved images must hold every function fully
+  // compiled, since the source is gone by the time they are loaded.
+  lazyCompilation = lazy && !cached && saveImagePath == NULL;
+  InterpretResult result = cached ? interpretCached(path, source)
+                                  : interpret(source);
+  lazyCompilation = false;
+//< Optimization omit
+/* Scanning on Demand run-file < Optimization omit
   free(source); // [owner]
+*/
+//> Optimization omit
+  freeSource(source, mapped);
+//< Optimization omit
 
   if (result == INTERPRET_COMPILE_ERROR) exit(65);
   if (result == INTERPRET_RUNTIME_ERROR) exit(70);
@@ -79,10 +245,21 @@ static void runFile(const char* path) {
 //< Scanning on Demand run-file
 
 int main(int argc, const char* argv[]) {
+//> Optimization omit
+  parseOptions(&argc, &argv);
+
+//< Optimization omit
 //> A Virtual Machine main-init-vm
   initVM();
 
 //< A Virtual Machine main-init-vm
+//> Optimization omit
+  if (imagePath != NULL && !loadImage(imagePath)) {
+    fprintf(stderr, "Could not load image \"%s\".\n", imagePath);
+    exit(74);
+  }
+
+//< Optimization omit
 /* Chunks of Bytecode main-chunk < Scanning on Demand args
   Chunk chunk;
   initChunk(&chunk);
@@ -137,9 +314,21 @@ int main(int argc, const char* argv[]) {
   } else if (argc == 2) {
     runFile(argv[1]);
   } else {
+/* Scanning on Demand args < Optimization omit
     fprintf(stderr, "Usage: clox [path]\n");
     exit(64);
+*/
+//> Optimization omit
+    usage();
+//< Optimization omit
+  }
+//> Optimization omit
+
+  if (saveImagePath != NULL && !saveImage(saveImagePath)) {
+    fprintf(stderr, "Could not write image \"%s\".\n", saveImagePath);
+    exit(74);
   }
+//< Optimization omit
   
   freeVM();
 //< Scanning on Demand args
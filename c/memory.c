@@ -18,6 +18,12 @@
 //> Garbage Collection heap-grow-factor
 
 #define GC_HEAP_GROW_FACTOR 2
+//> Optimization omit
+// Callbacks and delegates bind methods at a high rate, so the collector
+// keeps up to this many freed bound methods around for reuse instead of
+// handing them back to the allocator.
+#define MAX_FREE_BOUND_METHODS 65536
+//< Optimization omit
 //< Garbage Collection heap-grow-factor
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
@@ -132,6 +138,11 @@ static void blackenObject(Obj* object) {
       for (int i = 0; i < closure->upvalueCount; i++) {
         markObject((Obj*)closure->upvalues[i]);
       }
+//> Optimization omit
+      for (int i = 0; i < closure->captureCount; i++) {
+        markValue(closure->captures[i]);
+      }
+//< Optimization omit
       break;
     }
 
@@ -154,13 +165,32 @@ static void blackenObject(Obj* object) {
     }
 
 //< Classes and Instances blacken-instance
+//> Optimization omit
+    case OBJ_LIST:
+      markArray(&((ObjList*)object)->items);
+      break;
+
+    case OBJ_MAP:
+      markValueTable(&((ObjMap*)object)->table);
+      break;
+
+//< Optimization omit
 //> blacken-upvalue
     case OBJ_UPVALUE:
       markValue(((ObjUpvalue*)object)->closed);
       break;
 
 //< blacken-upvalue
+//> Optimization omit
+    case OBJ_NATIVE:
+      markObject((Obj*)((ObjNative*)object)->name);
+      break;
+
+    case OBJ_FLOAT_ARRAY:
+//< Optimization omit
+/* Garbage Collection blacken-object < Optimization omit
     case OBJ_NATIVE:
+*/
     case OBJ_STRING:
       break;
   }
@@ -177,7 +207,19 @@ static void freeObject(Obj* object) {
   switch (object->type) {
 //> Methods and Initializers free-bound-method
     case OBJ_BOUND_METHOD:
+/* Methods and Initializers free-bound-method < Optimization omit
       FREE(ObjBoundMethod, object);
+*/
+//> Optimization omit
+      if (vm.freeBoundMethodCount < MAX_FREE_BOUND_METHODS) {
+        vm.bytesAllocated -= sizeof(ObjBoundMethod);
+        object->next = vm.freeBoundMethods;
+        vm.freeBoundMethods = object;
+        vm.freeBoundMethodCount++;
+      } else {
+        FREE(ObjBoundMethod, object);
+      }
+//< Optimization omit
       break;
 
 //< Methods and Initializers free-bound-method
@@ -194,12 +236,19 @@ static void freeObject(Obj* object) {
 //< Classes and Instances free-class
 //> Closures free-closure
     case OBJ_CLOSURE: {
-//> free-upvalues
+/* Closures free-upvalues < Optimization omit
       ObjClosure* closure = (ObjClosure*)object;
       FREE_ARRAY(ObjUpvalue*, closure->upvalues,
                  closure->upvalueCount);
-//< free-upvalues
+*/
+/* Closures free-closure < Optimization omit
       FREE(ObjClosure, object);
+*/
+//> Optimization omit
+      ObjClosure* closure = (ObjClosure*)object;
+      reallocate(object, closureSize(closure->upvalueCount,
+                                     closure->captureCount), 0);
+//< Optimization omit
       break;
     }
 
@@ -222,6 +271,29 @@ static void freeObject(Obj* object) {
     }
 
 //< Classes and Instances free-instance
+//> Optimization omit
+    case OBJ_LIST: {
+      ObjList* list = (ObjList*)object;
+      freeValueArray(&list->items);
+      FREE(ObjList, object);
+      break;
+    }
+
+    case OBJ_FLOAT_ARRAY: {
+      ObjFloatArray* array = (ObjFloatArray*)object;
+      FREE_ARRAY(double, array->values, array->count);
+      FREE(ObjFloatArray, object);
+      break;
+    }
+
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      freeValueTable(&map->table);
+      FREE(ObjMap, object);
+      break;
+    }
+
+//< Optimization omit
 //> Calls and Functions free-native
     case OBJ_NATIVE:
       FREE(ObjNative, object);
@@ -355,9 +427,45 @@ void freeObjects() {
     freeObject(object);
     object = next;
   }
+//> Optimization omit
+
+  // Their sizes were already taken out of bytesAllocated.
+  object = vm.freeBoundMethods;
+  while (object != NULL) {
+    Obj* next = object->next;
+    free(object);
+    object = next;
+  }
+  vm.freeBoundMethods = NULL;
+  vm.freeBoundMethodCount = 0;
+//< Optimization omit
 //> Garbage Collection free-gray-stack
 
   free(vm.grayStack);
 //< Garbage Collection free-gray-stack
 }
 //< Strings free-objects
+//> Optimization omit
+// Takes a bound method off the free list, or returns NULL if there are
+// none. The object is already linked into the heap.
+ObjBoundMethod* reuseBoundMethod() {
+  if (vm.freeBoundMethods == NULL) return NULL;
+
+  // Pace collections as if this were a new allocation. Collecting can
+  // only add to the free list.
+#ifdef DEBUG_STRESS_GC
+  collectGarbage();
+#endif
+  vm.bytesAllocated += sizeof(ObjBoundMethod);
+  if (vm.bytesAllocated > vm.nextGC) collectGarbage();
+
+  Obj* object = vm.freeBoundMethods;
+  vm.freeBoundMethods = object->next;
+  vm.freeBoundMethodCount--;
+
+  object->isMarked = false;
+  object->next = vm.objects;
+  vm.objects = object;
+  return (ObjBoundMethod*)object;
+}
+//< Optimization omit
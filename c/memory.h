@@ -43,5 +43,8 @@ void collectGarbage();
 //> Strings free-objects-h
 void freeObjects();
 //< Strings free-objects-h
+//> Optimization omit
+ObjBoundMethod* reuseBoundMethod();
+//< Optimization omit
 
 #endif
@@ -0,0 +1,334 @@
+//> Optimization omit
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "natives.h"
+#include "object.h"
+#include "simd.h"
+#include "table.h"
+
+// Stores a formatted error message as the native's result. Always
+// returns false so that natives can "return nativeError(...)".
+bool nativeError(Value* args, const char* format, ...) {
+  char message[256];
+  va_list formatArgs;
+  va_start(formatArgs, format);
+  int length = vsnprintf(message, sizeof(message), format, formatArgs);
+  va_end(formatArgs);
+
+  if (length >= (int)sizeof(message)) length = sizeof(message) - 1;
+  args[-1] = stringValue(message, length);
+  return false;
+}
+
+static bool checkArity(int expected, int argCount, Value* args) {
+  if (argCount == expected) return true;
+  return nativeError(args, "Expected %d arguments but got %d.",
+                     expected, argCount);
+}
+
+bool lenNative(int argCount, Value* args) {
+  if (!checkArity(1, argCount, args)) return false;
+
+  if (IS_LIST(args[0])) {
+    args[-1] = INT_VAL(AS_LIST(args[0])->items.count);
+    return true;
+  }
+
+  if (IS_MAP(args[0])) {
+    args[-1] = INT_VAL(AS_MAP(args[0])->table.count);
+    return true;
+  }
+
+  if (IS_FLOAT_ARRAY(args[0])) {
+    args[-1] = INT_VAL(AS_FLOAT_ARRAY(args[0])->count);
+    return true;
+  }
+
+  if (IS_ANY_STRING(args[0])) {
+    char buffer[SHORT_STRING_MAX + 1];
+    int length;
+    stringChars(args[0], buffer, &length);
+    args[-1] = INT_VAL(length);
+    return true;
+  }
+
+  return nativeError(args,
+      "Argument to len() must be a list, map, float array, or string.");
+}
+
+bool pushNative(int argCount, Value* args) {
+  if (!checkArity(2, argCount, args)) return false;
+  if (!IS_LIST(args[0])) {
+    return nativeError(args, "First argument to push() must be a list.");
+  }
+
+  writeValueArray(&AS_LIST(args[0])->items, args[1]);
+  args[-1] = NIL_VAL;
+  return true;
+}
+
+bool popNative(int argCount, Value* args) {
+  if (!checkArity(1, argCount, args)) return false;
+  if (!IS_LIST(args[0])) {
+    return nativeError(args, "Argument to pop() must be a list.");
+  }
+
+  ValueArray* items = &AS_LIST(args[0])->items;
+  if (items->count == 0) {
+    return nativeError(args, "Can't pop from an empty list.");
+  }
+
+  args[-1] = items->values[--items->count];
+  return true;
+}
+
+bool insertNative(int argCount, Value* args) {
+  if (!checkArity(3, argCount, args)) return false;
+  if (!IS_LIST(args[0])) {
+    return nativeError(args, "First argument to insert() must be a list.");
+  }
+
+  ObjList* list = AS_LIST(args[0]);
+  if (!IS_NUMBER(args[1])) {
+    return nativeError(args, "Index must be a number.");
+  }
+
+  // Unlike indexing, inserting at the very end is allowed.
+  double index = AS_NUMBER(args[1]);
+  if (!(index >= 0 && index <= list->items.count)) {
+    return nativeError(args, "Index out of bounds.");
+  }
+
+  if (index != (int)index) {
+    return nativeError(args, "Index must be an integer.");
+  }
+
+  insertIntoList(list, (int)index, args[2]);
+  args[-1] = NIL_VAL;
+  return true;
+}
+
+bool sortNative(int argCount, Value* args) {
+  if (!checkArity(1, argCount, args)) return false;
+  if (!IS_LIST(args[0])) {
+    return nativeError(args, "Argument to sort() must be a list.");
+  }
+
+  if (!sortList(AS_LIST(args[0]))) {
+    return nativeError(args,
+        "Can only sort lists of all numbers or all strings.");
+  }
+
+  args[-1] = NIL_VAL;
+  return true;
+}
+
+bool mapNative(int argCount, Value* args) {
+  if (!checkArity(0, argCount, args)) return false;
+
+  args[-1] = OBJ_VAL(newMap());
+  return true;
+}
+
+// Checks the map and key arguments shared by the map natives.
+static bool mapArguments(const char* name, int arity, int argCount,
+                         Value* args, Value* key) {
+  if (!checkArity(arity, argCount, args)) return false;
+  if (!IS_MAP(args[0])) {
+    return nativeError(args, "First argument to %s() must be a map.",
+                       name);
+  }
+
+  if (arity > 1 && !canonicalKey(args[1], key)) {
+    return nativeError(args,
+        "Map keys must be numbers, strings, Booleans, or nil.");
+  }
+
+  return true;
+}
+
+bool mapGetNative(int argCount, Value* args) {
+  Value key;
+  if (!mapArguments("mapGet", 3, argCount, args, &key)) return false;
+
+  if (!valueTableGet(&AS_MAP(args[0])->table, key, &args[-1])) {
+    args[-1] = args[2];
+  }
+  return true;
+}
+
+bool mapSetNative(int argCount, Value* args) {
+  Value key;
+  if (!mapArguments("mapSet", 3, argCount, args, &key)) return false;
+
+  valueTableSet(&AS_MAP(args[0])->table, key, args[2]);
+  args[-1] = args[2];
+  return true;
+}
+
+bool mapHasNative(int argCount, Value* args) {
+  Value key;
+  if (!mapArguments("mapHas", 2, argCount, args, &key)) return false;
+
+  Value value;
+  args[-1] = BOOL_VAL(valueTableGet(&AS_MAP(args[0])->table, key,
+                                    &value));
+  return true;
+}
+
+bool mapDeleteNative(int argCount, Value* args) {
+  Value key;
+  if (!mapArguments("mapDelete", 2, argCount, args, &key)) return false;
+
+  args[-1] = BOOL_VAL(valueTableDelete(&AS_MAP(args[0])->table, key));
+  return true;
+}
+
+bool mapKeysNative(int argCount, Value* args) {
+  if (!mapArguments("mapKeys", 1, argCount, args, NULL)) return false;
+
+  // Store the list in the result slot right away so the GC can find
+  // it while it grows.
+  ObjList* keys = newList();
+  args[-1] = OBJ_VAL(keys);
+
+  ValueTable* table = &AS_MAP(args[0])->table;
+  for (int i = 0; i < table->capacity; i++) {
+    ValueEntry* entry = &table->entries[i];
+    if (valueTableIsLive(entry)) {
+      writeValueArray(&keys->items, entry->key);
+    }
+  }
+
+  return true;
+}
+
+// Creates a float array of a given size filled with zeroes, or one
+// holding the elements of a list of numbers.
+bool floatArrayNative(int argCount, Value* args) {
+  if (!checkArity(1, argCount, args)) return false;
+
+  if (IS_LIST(args[0])) {
+    ValueArray* items = &AS_LIST(args[0])->items;
+    for (int i = 0; i < items->count; i++) {
+      if (!IS_NUMBER(items->values[i])) {
+        return nativeError(args, "Float array elements must be numbers.");
+      }
+    }
+
+    ObjFloatArray* array = newFloatArray(items->count);
+    for (int i = 0; i < items->count; i++) {
+      array->values[i] = AS_NUMBER(items->values[i]);
+    }
+    args[-1] = OBJ_VAL(array);
+    return true;
+  }
+
+  if (!IS_NUMBER(args[0])) {
+    return nativeError(args,
+        "Argument to FloatArray() must be a size or a list.");
+  }
+
+  double size = AS_NUMBER(args[0]);
+  if (!(size >= 0 && size <= INT32_MAX) || size != (int)size) {
+    return nativeError(args,
+        "Float array size must be a non-negative integer.");
+  }
+
+  args[-1] = OBJ_VAL(newFloatArray((int)size));
+  return true;
+}
+
+static bool floatArrayArguments(const char* name, int arity, int argCount,
+                                Value* args) {
+  if (!checkArity(arity, argCount, args)) return false;
+  if (!IS_FLOAT_ARRAY(args[0])) {
+    return nativeError(args,
+        "First argument to %s() must be a float array.", name);
+  }
+
+  return true;
+}
+
+static bool sameSizeArrays(const char* name, Value* args) {
+  if (!IS_FLOAT_ARRAY(args[1])) {
+    return nativeError(args,
+        "Second argument to %s() must be a float array.", name);
+  }
+
+  if (AS_FLOAT_ARRAY(args[0])->count != AS_FLOAT_ARRAY(args[1])->count) {
+    return nativeError(args, "Float arrays must be the same size.");
+  }
+
+  return true;
+}
+
+bool floatSumNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatSum", 1, argCount, args)) return false;
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  args[-1] = NUMBER_VAL(simdSum(array->values, array->count));
+  return true;
+}
+
+bool floatDotNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatDot", 2, argCount, args)) return false;
+  if (!sameSizeArrays("floatDot", args)) return false;
+
+  ObjFloatArray* a = AS_FLOAT_ARRAY(args[0]);
+  ObjFloatArray* b = AS_FLOAT_ARRAY(args[1]);
+  args[-1] = NUMBER_VAL(simdDot(a->values, b->values, a->count));
+  return true;
+}
+
+// Multiplies every element in place.
+bool floatScaleNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatScale", 2, argCount, args)) return false;
+  if (!IS_NUMBER(args[1])) {
+    return nativeError(args, "Scale factor must be a number.");
+  }
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  simdScale(array->values, array->count, AS_NUMBER(args[1]));
+  args[-1] = NIL_VAL;
+  return true;
+}
+
+// Adds the second array into the first, element by element.
+bool floatAddNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatAdd", 2, argCount, args)) return false;
+  if (!sameSizeArrays("floatAdd", args)) return false;
+
+  ObjFloatArray* dest = AS_FLOAT_ARRAY(args[0]);
+  ObjFloatArray* source = AS_FLOAT_ARRAY(args[1]);
+  simdAdd(dest->values, source->values, dest->count);
+  args[-1] = NIL_VAL;
+  return true;
+}
+
+bool floatMinNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatMin", 1, argCount, args)) return false;
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  if (array->count == 0) {
+    return nativeError(args, "Can't take the minimum of an empty array.");
+  }
+
+  args[-1] = NUMBER_VAL(simdMin(array->values, array->count));
+  return true;
+}
+
+bool floatMaxNative(int argCount, Value* args) {
+  if (!floatArrayArguments("floatMax", 1, argCount, args)) return false;
+
+  ObjFloatArray* array = AS_FLOAT_ARRAY(args[0]);
+  if (array->count == 0) {
+    return nativeError(args, "Can't take the maximum of an empty array.");
+  }
+
+  args[-1] = NUMBER_VAL(simdMax(array->values, array->count));
+  return true;
+}
+//< Optimization omit
@@ -0,0 +1,30 @@
+//> Optimization omit
+#ifndef clox_natives_h
+#define clox_natives_h
+
+#include "common.h"
+#include "value.h"
+
+bool nativeError(Value* args, const char* format, ...);
+
+bool lenNative(int argCount, Value* args);
+bool pushNative(int argCount, Value* args);
+bool popNative(int argCount, Value* args);
+bool insertNative(int argCount, Value* args);
+bool sortNative(int argCount, Value* args);
+bool mapNative(int argCount, Value* args);
+bool mapGetNative(int argCount, Value* args);
+bool mapSetNative(int argCount, Value* args);
+bool mapHasNative(int argCount, Value* args);
+bool mapDeleteNative(int argCount, Value* args);
+bool mapKeysNative(int argCount, Value* args);
+bool floatArrayNative(int argCount, Value* args);
+bool floatSumNative(int argCount, Value* args);
+bool floatDotNative(int argCount, Value* args);
+bool floatScaleNative(int argCount, Value* args);
+bool floatAddNative(int argCount, Value* args);
+bool floatMinNative(int argCount, Value* args);
+bool floatMaxNative(int argCount, Value* args);
+
+#endif
+//< Optimization omit
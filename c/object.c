@@ -1,5 +1,9 @@
 //> Strings object-c
 #include <stdio.h>
+//> Optimization omit
+#include <math.h>
+#include <stdlib.h>
+//< Optimization omit
 #include <string.h>
 
 #include "memory.h"
@@ -40,8 +44,16 @@ static Obj* allocateObject(size_t size, ObjType type) {
 //> Methods and Initializers new-bound-method
 ObjBoundMethod* newBoundMethod(Value receiver,
                                ObjClosure* method) {
+/* Methods and Initializers new-bound-method < Optimization omit
   ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod,
                                        OBJ_BOUND_METHOD);
+*/
+//> Optimization omit
+  ObjBoundMethod* bound = reuseBoundMethod();
+  if (bound == NULL) {
+    bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
+  }
+//< Optimization omit
   bound->receiver = receiver;
   bound->method = method;
   return bound;
@@ -59,20 +71,43 @@ ObjClass* newClass(ObjString* name) {
 //< Classes and Instances new-class
 //> Closures new-closure
 ObjClosure* newClosure(ObjFunction* function) {
-//> allocate-upvalue-array
+/* Closures allocate-upvalue-array < Optimization omit
   ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*,
                                    function->upvalueCount);
   for (int i = 0; i < function->upvalueCount; i++) {
     upvalues[i] = NULL;
   }
 
-//< allocate-upvalue-array
+*/
+/* Closures new-closure < Optimization omit
   ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+*/
+//> Optimization omit
+  ObjClosure* closure = (ObjClosure*)allocateObject(
+      closureSize(function->upvalueCount, function->captureCount),
+      OBJ_CLOSURE);
+//< Optimization omit
   closure->function = function;
-//> init-upvalue-fields
+/* Closures init-upvalue-fields < Optimization omit
   closure->upvalues = upvalues;
   closure->upvalueCount = function->upvalueCount;
-//< init-upvalue-fields
+*/
+//> Optimization omit
+  closure->captures = (Value*)(closure + 1);
+  closure->captureCount = function->captureCount;
+  for (int i = 0; i < closure->captureCount; i++) {
+    closure->captures[i] = NIL_VAL;
+  }
+
+  closure->upvalues =
+      (ObjUpvalue**)(closure->captures + closure->captureCount);
+  closure->upvalueCount = function->upvalueCount;
+  for (int i = 0; i < closure->upvalueCount; i++) {
+    closure->upvalues[i] = NULL;
+  }
+
+  closure->enclosingSlots = NULL;
+//< Optimization omit
   return closure;
 }
 //< Closures new-closure
@@ -84,6 +119,13 @@ ObjFunction* newFunction() {
 //> Closures init-upvalue-count
   function->upvalueCount = 0;
 //< Closures init-upvalue-count
+//> Optimization omit
+  function->captureCount = 0;
+  function->slotCount = 0;
+  function->lazySource = NULL;
+  function->lazyLine = 0;
+  function->lazyMethod = false;
+//< Optimization omit
   function->name = NULL;
   initChunk(&function->chunk);
   return function;
@@ -97,10 +139,91 @@ ObjInstance* newInstance(ObjClass* klass) {
   return instance;
 }
 //< Classes and Instances new-instance
+//> Optimization omit
+ObjList* newList() {
+  ObjList* list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+  initValueArray(&list->items);
+  return list;
+}
+
+ObjFloatArray* newFloatArray(int count) {
+  // Allocate the elements before the object. Otherwise a GC triggered
+  // by the second allocation would free the new, unrooted array.
+  double* values = ALLOCATE(double, count);
+  for (int i = 0; i < count; i++) values[i] = 0;
+
+  ObjFloatArray* array = ALLOCATE_OBJ(ObjFloatArray, OBJ_FLOAT_ARRAY);
+  array->count = count;
+  array->values = values;
+  return array;
+}
+
+ObjMap* newMap() {
+  ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+  initValueTable(&map->table);
+  return map;
+}
+
+void insertIntoList(ObjList* list, int index, Value value) {
+  // Append first so the array grows, then shift the tail up a slot.
+  writeValueArray(&list->items, value);
+  Value* items = list->items.values;
+  memmove(&items[index + 1], &items[index],
+          sizeof(Value) * (list->items.count - 1 - index));
+  items[index] = value;
+}
+
+// NaN compares unordered with everything, which would leave qsort()
+// with no consistent order, so it sorts after every other number.
+static int compareNumbers(const void* a, const void* b) {
+  double x = AS_NUMBER(*(const Value*)a);
+  double y = AS_NUMBER(*(const Value*)b);
+  bool xIsNan = isnan(x);
+  bool yIsNan = isnan(y);
+  if (xIsNan || yIsNan) return xIsNan - yIsNan;
+  return (x > y) - (x < y);
+}
+
+static int compareStrings(const void* a, const void* b) {
+  char aBuffer[SHORT_STRING_MAX + 1];
+  char bBuffer[SHORT_STRING_MAX + 1];
+  int aLength;
+  int bLength;
+  const char* aChars = stringChars(*(const Value*)a, aBuffer, &aLength);
+  const char* bChars = stringChars(*(const Value*)b, bBuffer, &bLength);
+
+  int length = aLength < bLength ? aLength : bLength;
+  int result = memcmp(aChars, bChars, length);
+  if (result != 0) return result;
+  return aLength - bLength;
+}
+
+// Sorts the list in place. Returns false and leaves the list unchanged
+// unless it contains only numbers or only strings.
+bool sortList(ObjList* list) {
+  Value* items = list->items.values;
+  int count = list->items.count;
+  if (count < 2) return true;
+
+  bool numbers = IS_NUMBER(items[0]);
+  for (int i = 0; i < count; i++) {
+    if (numbers ? !IS_NUMBER(items[i]) : !IS_ANY_STRING(items[i])) {
+      return false;
+    }
+  }
+
+  qsort(items, count, sizeof(Value),
+        numbers ? compareNumbers : compareStrings);
+  return true;
+}
+//< Optimization omit
 //> Calls and Functions new-native
 ObjNative* newNative(NativeFn function) {
   ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
   native->function = function;
+//> Optimization omit
+  native->name = NULL;
+//< Optimization omit
   return native;
 }
 //< Calls and Functions new-native
@@ -134,7 +257,20 @@ static ObjString* allocateString(char* chars, int length,
 }
 //< allocate-string
 //> Hash Tables hash-string
+//> Optimization omit
+#define HASH_PRIME_1 0x9e3779b185ebca87u
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4fu
+#define HASH_PRIME_3 0x165667b19e3779f9u
+
+static inline uint64_t hashRound(uint64_t hash, uint64_t word) {
+  hash += word * HASH_PRIME_2;
+  hash = (hash << 31) | (hash >> 33);
+  return hash * HASH_PRIME_1;
+}
+
+//< Optimization omit
 static uint32_t hashString(const char* key, int length) {
+/* Hash Tables hash-string < Optimization omit
   uint32_t hash = 2166136261u;
 
   for (int i = 0; i < length; i++) {
@@ -143,6 +279,35 @@ static uint32_t hashString(const char* key, int length) {
   }
 
   return hash;
+*/
+//> Optimization omit
+  // Hashing a byte at a time dominates interning long strings, so
+  // consume the key a word at a time instead. The word loads go
+  // through memcpy() since the key has no alignment guarantees.
+  uint64_t hash = HASH_PRIME_3 + (uint64_t)length;
+
+  int i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, key + i, sizeof(word));
+    hash = hashRound(hash, word);
+  }
+
+  if (i < length) {
+    uint64_t tail = 0;
+    memcpy(&tail, key + i, length - i);
+    hash = hashRound(hash, tail);
+  }
+
+  // Avalanche so that the low bits used to pick a bucket depend on
+  // every input bit.
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME_2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME_3;
+  hash ^= hash >> 32;
+  return (uint32_t)hash;
+//< Optimization omit
 }
 //< Hash Tables hash-string
 //> take-string
@@ -186,6 +351,40 @@ ObjString* copyString(const char* chars, int length) {
   return allocateString(heapChars, length, hash);
 //< Hash Tables copy-string-allocate
 }
+//> Optimization omit
+Value stringValue(const char* chars, int length) {
+#ifdef NAN_BOXING
+  // Every string short enough to fit in a Value is stored inline so
+  // that each string has exactly one representation and equality can
+  // stay a bitwise comparison.
+  if (length <= SHORT_STRING_MAX && memchr(chars, '\0', length) == NULL) {
+    Value value = QNAN | TAG_SHORT_STRING;
+    for (int i = 0; i < length; i++) {
+      value |= (uint64_t)(uint8_t)chars[i] << (i * 8);
+    }
+    return value;
+  }
+#endif
+
+  return OBJ_VAL(copyString(chars, length));
+}
+
+const char* stringChars(Value value, char* buffer, int* length) {
+#ifdef NAN_BOXING
+  if (IS_SHORT_STRING(value)) {
+    *length = shortStringLength(value);
+    for (int i = 0; i < *length; i++) {
+      buffer[i] = (char)(value >> (i * 8));
+    }
+    buffer[*length] = '\0';
+    return buffer;
+  }
+#endif
+
+  *length = AS_STRING(value)->length;
+  return AS_CSTRING(value);
+}
+//< Optimization omit
 //> Closures new-upvalue
 ObjUpvalue* newUpvalue(Value* slot) {
   ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
@@ -233,6 +432,18 @@ void printObject(Value value) {
       printFunction(AS_FUNCTION(value));
       break;
 //< Calls and Functions print-function
+//> Optimization omit
+    case OBJ_FLOAT_ARRAY: {
+      ObjFloatArray* array = AS_FLOAT_ARRAY(value);
+      printf("[");
+      for (int i = 0; i < array->count; i++) {
+        if (i > 0) printf(", ");
+        printf("%g", array->values[i]);
+      }
+      printf("]");
+      break;
+    }
+//< Optimization omit
 //> Classes and Instances print-instance
     case OBJ_INSTANCE:
       printf("%s instance",
@@ -244,6 +455,35 @@ void printObject(Value value) {
       printf("<native fn>");
       break;
 //< Calls and Functions print-native
+//> Optimization omit
+    case OBJ_LIST: {
+      ObjList* list = AS_LIST(value);
+      printf("[");
+      for (int i = 0; i < list->items.count; i++) {
+        if (i > 0) printf(", ");
+        printValue(list->items.values[i]);
+      }
+      printf("]");
+      break;
+    }
+    case OBJ_MAP: {
+      ValueTable* table = &AS_MAP(value)->table;
+      bool first = true;
+      printf("{");
+      for (int i = 0; i < table->capacity; i++) {
+        ValueEntry* entry = &table->entries[i];
+        if (!valueTableIsLive(entry)) continue;
+
+        if (!first) printf(", ");
+        first = false;
+        printValue(entry->key);
+        printf(": ");
+        printValue(entry->value);
+      }
+      printf("}");
+      break;
+    }
+//< Optimization omit
     case OBJ_STRING:
       printf("%s", AS_CSTRING(value));
       break;
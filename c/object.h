@@ -34,7 +34,16 @@
 //> Calls and Functions is-native
 #define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
 //< Calls and Functions is-native
+//> Optimization omit
+#define IS_FLOAT_ARRAY(value)  isObjType(value, OBJ_FLOAT_ARRAY)
+#define IS_LIST(value)         isObjType(value, OBJ_LIST)
+#define IS_MAP(value)          isObjType(value, OBJ_MAP)
+//< Optimization omit
 #define IS_STRING(value)       isObjType(value, OBJ_STRING)
+//> Optimization omit
+#define IS_ANY_STRING(value) \
+    (IS_SHORT_STRING(value) || IS_STRING(value))
+//< Optimization omit
 //< is-string
 //> as-string
 
@@ -53,6 +62,11 @@
 //> Classes and Instances as-instance
 #define AS_INSTANCE(value)     ((ObjInstance*)AS_OBJ(value))
 //< Classes and Instances as-instance
+//> Optimization omit
+#define AS_FLOAT_ARRAY(value)  ((ObjFloatArray*)AS_OBJ(value))
+#define AS_LIST(value)         ((ObjList*)AS_OBJ(value))
+#define AS_MAP(value)          ((ObjMap*)AS_OBJ(value))
+//< Optimization omit
 //> Calls and Functions as-native
 #define AS_NATIVE(value) \
     (((ObjNative*)AS_OBJ(value))->function)
@@ -75,9 +89,16 @@ typedef enum {
 //> Calls and Functions obj-type-function
   OBJ_FUNCTION,
 //< Calls and Functions obj-type-function
+//> Optimization omit
+  OBJ_FLOAT_ARRAY,
+//< Optimization omit
 //> Classes and Instances obj-type-instance
   OBJ_INSTANCE,
 //< Classes and Instances obj-type-instance
+//> Optimization omit
+  OBJ_LIST,
+  OBJ_MAP,
+//< Optimization omit
 //> Calls and Functions obj-type-native
   OBJ_NATIVE,
 //< Calls and Functions obj-type-native
@@ -105,17 +126,41 @@ typedef struct {
 //> Closures upvalue-count
   int upvalueCount;
 //< Closures upvalue-count
+//> Optimization omit
+  // Variables that are never assigned after they are captured are
+  // copied into the closure instead of going through an upvalue.
+  int captureCount;
+  // The most locals it has at once. The VM checks they fit on the
+  // stack before calling it.
+  int slotCount;
+  // While the body hasn't been compiled yet, where its parameter list
+  // starts in the source. NULL once it has. See compileLazily().
+  const char* lazySource;
+  int lazyLine;
+  bool lazyMethod;
+//< Optimization omit
   Chunk chunk;
   ObjString* name;
 } ObjFunction;
 //< Calls and Functions obj-function
 //> Calls and Functions obj-native
 
+/* Calls and Functions obj-native < Optimization omit
 typedef Value (*NativeFn)(int argCount, Value* args);
+*/
+//> Optimization omit
+// A native stores its result in args[-1] and returns true, or stores
+// an error message there and returns false.
+typedef bool (*NativeFn)(int argCount, Value* args);
+//< Optimization omit
 
 typedef struct {
   Obj obj;
   NativeFn function;
+//> Optimization omit
+  // The global it was defined as, so heap images can rebind it.
+  ObjString* name;
+//< Optimization omit
 } ObjNative;
 //< Calls and Functions obj-native
 //> obj-string
@@ -149,6 +194,16 @@ typedef struct {
   ObjUpvalue** upvalues;
   int upvalueCount;
 //< upvalue-fields
+//> Optimization omit
+  // [captures] and [upvalues] point just past the closure, into the
+  // same allocation.
+  Value* captures;
+  int captureCount;
+  // The stack slots of the call that created the closure. Only
+  // functions that can never outlive that call read them, using
+  // OP_GET_OUTER and OP_SET_OUTER.
+  Value* enclosingSlots;
+//< Optimization omit
 } ObjClosure;
 //< Closures obj-closure
 //> Classes and Instances obj-class
@@ -169,6 +224,25 @@ typedef struct {
   Table fields; // [fields]
 } ObjInstance;
 //< Classes and Instances obj-instance
+//> Optimization omit
+
+typedef struct {
+  Obj obj;
+  ValueArray items;
+} ObjList;
+
+typedef struct {
+  Obj obj;
+  ValueTable table;
+} ObjMap;
+
+// Stores unboxed doubles so bulk operations can run over them directly.
+typedef struct {
+  Obj obj;
+  int count;
+  double* values;
+} ObjFloatArray;
+//< Optimization omit
 
 //> Methods and Initializers obj-bound-method
 typedef struct {
@@ -187,6 +261,12 @@ ObjClass* newClass(ObjString* name);
 //< Classes and Instances new-class-h
 //> Closures new-closure-h
 ObjClosure* newClosure(ObjFunction* function);
+//> Optimization omit
+static inline size_t closureSize(int upvalueCount, int captureCount) {
+  return sizeof(ObjClosure) + sizeof(Value) * captureCount +
+         sizeof(ObjUpvalue*) * upvalueCount;
+}
+//< Optimization omit
 //< Closures new-closure-h
 //> Calls and Functions new-function-h
 ObjFunction* newFunction();
@@ -194,6 +274,13 @@ ObjFunction* newFunction();
 //> Classes and Instances new-instance-h
 ObjInstance* newInstance(ObjClass* klass);
 //< Classes and Instances new-instance-h
+//> Optimization omit
+ObjFloatArray* newFloatArray(int count);
+ObjList* newList();
+ObjMap* newMap();
+void insertIntoList(ObjList* list, int index, Value value);
+bool sortList(ObjList* list);
+//< Optimization omit
 //> Calls and Functions new-native-h
 ObjNative* newNative(NativeFn function);
 //< Calls and Functions new-native-h
@@ -202,6 +289,10 @@ ObjString* takeString(char* chars, int length);
 //< take-string-h
 //> copy-string-h
 ObjString* copyString(const char* chars, int length);
+//> Optimization omit
+Value stringValue(const char* chars, int length);
+const char* stringChars(Value value, char* buffer, int* length);
+//< Optimization omit
 //> Closures new-upvalue-h
 ObjUpvalue* newUpvalue(Value* slot);
 //< Closures new-upvalue-h
@@ -0,0 +1,821 @@
+//> Optimization omit
+#include <string.h>
+
+#include "ast.h"
+#include "fold.h"
+
+// The passes rewrite nodes in place, so a node keeps its position in
+// whatever list holds it.
+//
+// Constant propagation relies on the parser having counted every
+// assignment to each local. A local that is never assigned after its
+// initializer and is initialized with a constant is replaced by that
+// constant everywhere it is used, and its declaration is dropped. That
+// can leave whole expressions constant, which are then folded.
+//
+// Calls of tiny functions and methods are inlined, as described below,
+// before their results are folded.
+
+static void optimizeExpression(Node* node);
+static bool optimizeStatement(Node* node);
+static void optimizeFunction(FunctionNode* function);
+static void optimizeList(Node* list);
+
+static bool isLiteral(Node* node) {
+  return node != NULL && node->type == NODE_LITERAL;
+}
+
+static void replaceWithLiteral(Node* node, Value value) {
+  astRoot(value);
+  node->type = NODE_LITERAL;
+  node->as.literal = value;
+}
+
+static void replaceNode(Node* node, Node* replacement) {
+  Node* next = node->next;
+  *node = *replacement;
+  node->next = next;
+}
+
+static Node* copyNode(Node* node) {
+  Node* copy = (Node*)astAllocate(sizeof(Node));
+  *copy = *node;
+  copy->next = NULL;
+  return copy;
+}
+
+// Inlining ------------------------------------------------------------
+//
+// A tiny function is a few expression statements and a return that
+// read nothing but globals, the function's parameters and `this`, and
+// assign no variables. A call of one is replaced by a copy of its body,
+// with the arguments put where the parameters are used. That is only
+// done when every argument is a literal or a local, so evaluating it
+// late, more than once, or not at all makes no difference. The receiver
+// of an invoke may also be a global, since it's read once before the
+// copy runs and nothing in the copy can change it. Instructions in the
+// copy keep the callee's lines, so runtime errors point at the same
+// line, though the stack trace has no frame for the callee.
+//
+// Which function a call reaches is only known at runtime. The compiler
+// bets on the only global function or method in the script with the
+// name called, and guards the copy with a check that the callee really
+// is that function. If it isn't, the original call runs, and the guard
+// patches itself into a jump to it so the site isn't checked again.
+
+// The most nodes a body can have and still be inlined.
+#define MAX_INLINE_NODES 16
+
+// Each function or method in the script that a call could reach by
+// name. [function] is NULL once more than one declaration has the name,
+// or if the name is declared as something else.
+typedef struct Callee {
+  Token name;
+  FunctionNode* function;
+  bool isMethod;
+  struct Callee* next;
+} Callee;
+
+static Callee* callees;
+
+// An upper bound on how many constants the function being optimized
+// will need. Its code never uses more than two per node. Calls stop
+// being inlined before the copies could take it over the limit.
+static int constantBound;
+
+static void declareCallee(Token name, FunctionNode* function,
+                          bool isMethod) {
+  for (Callee* callee = callees; callee != NULL; callee = callee->next) {
+    if (callee->isMethod == isMethod &&
+        callee->name.length == name.length &&
+        memcmp(callee->name.start, name.start, name.length) == 0) {
+      callee->function = NULL;
+      return;
+    }
+  }
+
+  Callee* callee = (Callee*)astAllocate(sizeof(Callee));
+  callee->name = name;
+  callee->function = function;
+  callee->isMethod = isMethod;
+  callee->next = callees;
+  callees = callee;
+}
+
+static FunctionNode* findCallee(Token* name, bool isMethod) {
+  for (Callee* callee = callees; callee != NULL; callee = callee->next) {
+    if (callee->isMethod == isMethod &&
+        callee->name.length == name->length &&
+        memcmp(callee->name.start, name->start, name->length) == 0) {
+      return callee->function;
+    }
+  }
+  return NULL;
+}
+
+static void collectCallees(Node* statements) {
+  for (Node* node = statements; node != NULL; node = node->next) {
+    switch (node->type) {
+      case NODE_BLOCK:
+        collectCallees(node->as.statements);
+        break;
+
+      case NODE_CLASS: {
+        if (node->as.klass.decl == NULL) {
+          declareCallee(node->token, NULL, false);
+        }
+
+        FunctionNode* method = node->as.klass.methods;
+        for (; method != NULL; method = method->next) {
+          declareCallee(method->name, method, true);
+          collectCallees(method->body);
+        }
+        break;
+      }
+
+      case NODE_FUNCTION: {
+        FunctionNode* function = node->as.function.function;
+        if (node->as.function.decl == NULL) {
+          declareCallee(node->token, function, false);
+        }
+        collectCallees(function->body);
+        break;
+      }
+
+      case NODE_IF:
+      case NODE_WHILE:
+        collectCallees(node->as.branch.thenBranch);
+        collectCallees(node->as.branch.elseBranch);
+        break;
+
+      case NODE_VAR:
+        if (node->as.variable.decl == NULL) {
+          declareCallee(node->token, NULL, false);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+// Counts the nodes in [list] and everything under them, leaving out the
+// bodies of functions declared there.
+static int countNodes(Node* list) {
+  int count = 0;
+  for (Node* node = list; node != NULL; node = node->next) {
+    count++;
+    switch (node->type) {
+      case NODE_ASSIGN:
+      case NODE_VAR:
+      case NODE_VARIABLE:
+        count += countNodes(node->as.variable.value);
+        break;
+
+      case NODE_BINARY:
+      case NODE_LOGICAL:
+      case NODE_UNARY:
+        count += countNodes(node->as.binary.left);
+        count += countNodes(node->as.binary.right);
+        break;
+
+      case NODE_CALL:
+      case NODE_GET_INDEX:
+      case NODE_GET_PROPERTY:
+      case NODE_INVOKE:
+      case NODE_LIST:
+      case NODE_SET_INDEX:
+      case NODE_SET_PROPERTY:
+      case NODE_SUPER_GET:
+      case NODE_SUPER_INVOKE:
+        count += countNodes(node->as.access.object);
+        count += countNodes(node->as.access.index);
+        count += countNodes(node->as.access.value);
+        count += countNodes(node->as.access.arguments);
+        break;
+
+      case NODE_INLINE:
+        count += countNodes(node->as.inlined.call);
+        count += countNodes(node->as.inlined.body);
+        break;
+
+      case NODE_BLOCK:
+        count += countNodes(node->as.statements);
+        break;
+
+      case NODE_CLASS: {
+        count += countNodes(node->as.klass.superclass);
+        count += countNodes(node->as.klass.self);
+
+        FunctionNode* method = node->as.klass.methods;
+        for (; method != NULL; method = method->next) count++;
+        break;
+      }
+
+      case NODE_EXPRESSION:
+      case NODE_PRINT:
+      case NODE_RETURN:
+        count += countNodes(node->as.expression);
+        break;
+
+      case NODE_IF:
+      case NODE_WHILE:
+        count += countNodes(node->as.branch.condition);
+        count += countNodes(node->as.branch.thenBranch);
+        count += countNodes(node->as.branch.elseBranch);
+        break;
+
+      case NODE_FUNCTION:
+      case NODE_LITERAL:
+        break;
+    }
+  }
+  return count;
+}
+
+// Adds the nodes in the expression [node] to [count]. Returns false if
+// it contains anything a tiny function can't.
+static bool countInlinable(FunctionNode* function, Node* node,
+                           int* count) {
+  if (node == NULL) return true;
+  if (++*count > MAX_INLINE_NODES) return false;
+
+  switch (node->type) {
+    case NODE_LITERAL:
+      return true;
+
+    case NODE_VARIABLE: {
+      Decl* decl = node->as.variable.decl;
+      return decl == NULL || decl->function == function;
+    }
+
+    case NODE_BINARY:
+    case NODE_LOGICAL:
+    case NODE_UNARY:
+      return countInlinable(function, node->as.binary.left, count) &&
+             countInlinable(function, node->as.binary.right, count);
+
+    case NODE_GET_INDEX:
+    case NODE_GET_PROPERTY:
+    case NODE_LIST:
+    case NODE_SET_INDEX:
+    case NODE_SET_PROPERTY: {
+      if (!countInlinable(function, node->as.access.object, count) ||
+          !countInlinable(function, node->as.access.index, count) ||
+          !countInlinable(function, node->as.access.value, count)) {
+        return false;
+      }
+
+      Node* element = node->as.access.arguments;
+      for (; element != NULL; element = element->next) {
+        if (!countInlinable(function, element, count)) return false;
+      }
+      return true;
+    }
+
+    default:
+      // Calls would need a frame for the callee anyway.
+      return false;
+  }
+}
+
+// Returns how many nodes [function]'s body has, or -1 if it isn't tiny.
+static int inlineSize(FunctionNode* function) {
+  if (function->kind != KIND_FUNCTION &&
+      function->kind != KIND_METHOD) {
+    return -1;
+  }
+
+  int count = 0;
+  for (Node* node = function->body; node != NULL; node = node->next) {
+    bool isResult = node->type == NODE_RETURN && node->next == NULL;
+    if (node->type != NODE_EXPRESSION && !isResult) return -1;
+    if (!countInlinable(function, node->as.expression, &count)) {
+      return -1;
+    }
+  }
+  return count;
+}
+
+// Whether an argument can stand in for a parameter wherever it's used.
+static bool isSimpleArgument(Node* node) {
+  return node->type == NODE_LITERAL ||
+         (node->type == NODE_VARIABLE && node->as.variable.decl != NULL);
+}
+
+// The nodes that stand in for the parameters of an inlined function.
+typedef struct {
+  FunctionNode* function;
+  Node* receiver;
+  Node* arguments;
+} Inlining;
+
+static Node* cloneNode(Inlining* inlining, Node* node);
+
+static Node* cloneList(Inlining* inlining, Node* list) {
+  Node* head = NULL;
+  Node** tail = &head;
+  for (Node* node = list; node != NULL; node = node->next) {
+    *tail = cloneNode(inlining, node);
+    tail = &(*tail)->next;
+  }
+  return head;
+}
+
+static Node* argumentFor(Inlining* inlining, Decl* decl) {
+  if (decl == inlining->function->receiver) return inlining->receiver;
+
+  Node* argument = inlining->arguments;
+  Decl* parameter = inlining->function->parameters;
+  while (parameter != decl) {
+    parameter = parameter->next;
+    argument = argument->next;
+  }
+  return argument;
+}
+
+static Node* cloneNode(Inlining* inlining, Node* node) {
+  if (node == NULL) return NULL;
+
+  // Any local in a tiny function is one of its parameters.
+  if (node->type == NODE_VARIABLE && node->as.variable.decl != NULL) {
+    return copyNode(argumentFor(inlining, node->as.variable.decl));
+  }
+
+  Node* copy = copyNode(node);
+  switch (node->type) {
+    case NODE_ASSIGN:
+      copy->as.variable.value = cloneNode(inlining,
+                                          node->as.variable.value);
+      break;
+
+    case NODE_BINARY:
+    case NODE_LOGICAL:
+    case NODE_UNARY:
+      copy->as.binary.left = cloneNode(inlining, node->as.binary.left);
+      copy->as.binary.right = cloneNode(inlining, node->as.binary.right);
+      break;
+
+    case NODE_GET_INDEX:
+    case NODE_GET_PROPERTY:
+    case NODE_LIST:
+    case NODE_SET_INDEX:
+    case NODE_SET_PROPERTY:
+      copy->as.access.object = cloneNode(inlining, node->as.access.object);
+      copy->as.access.index = cloneNode(inlining, node->as.access.index);
+      copy->as.access.value = cloneNode(inlining, node->as.access.value);
+      copy->as.access.arguments = cloneList(inlining,
+                                            node->as.access.arguments);
+      break;
+
+    default:
+      break;
+  }
+  return copy;
+}
+
+// Copies the body of the function [inlining] calls as a list of
+// expressions that ends with the one whose value is returned.
+static Node* inlineBody(Inlining* inlining, Node* call) {
+  Node* head = NULL;
+  Node** tail = &head;
+  bool returnsValue = false;
+
+  Node* statement = inlining->function->body;
+  for (; statement != NULL; statement = statement->next) {
+    // A bare `return;` can only be last.
+    if (statement->as.expression == NULL) break;
+
+    *tail = cloneNode(inlining, statement->as.expression);
+    tail = &(*tail)->next;
+    returnsValue = statement->type == NODE_RETURN;
+  }
+
+  if (!returnsValue) {
+    Node* nil = copyNode(call);
+    nil->type = NODE_LITERAL;
+    nil->line = inlining->function->endLine;
+    nil->as.literal = NIL_VAL;
+    *tail = nil;
+  }
+  return head;
+}
+
+// Replaces [node], a call or invoke, with a guarded copy of the body of
+// the function it calls if that function is tiny.
+static void inlineCall(Node* node) {
+  Inlining inlining;
+  inlining.arguments = node->as.access.arguments;
+  if (node->type == NODE_CALL) {
+    Node* callee = node->as.access.object;
+    if (callee->type != NODE_VARIABLE ||
+        callee->as.variable.decl != NULL) {
+      return;
+    }
+
+    inlining.function = findCallee(&callee->token, false);
+    inlining.receiver = NULL;
+  } else {
+    inlining.receiver = node->as.access.object;
+    if (inlining.receiver->type != NODE_VARIABLE) return;
+    inlining.function = findCallee(&node->token, true);
+  }
+
+  FunctionNode* function = inlining.function;
+  if (function == NULL || function->arity != node->as.access.argCount) {
+    return;
+  }
+
+  Node* argument = inlining.arguments;
+  for (; argument != NULL; argument = argument->next) {
+    if (!isSimpleArgument(argument)) return;
+  }
+
+  int size = inlineSize(function);
+  if (size == -1) return;
+
+  // One more node's worth for the guard.
+  int constants = 2 * (size + 1);
+  if (constantBound + constants > UINT8_COUNT) return;
+  constantBound += constants;
+
+  Node* call = copyNode(node);
+  node->type = NODE_INLINE;
+  node->as.inlined.call = call;
+  node->as.inlined.body = inlineBody(&inlining, call);
+  node->as.inlined.function = function;
+  optimizeList(node->as.inlined.body);
+}
+
+static void optimizeList(Node* list) {
+  for (Node* node = list; node != NULL; node = node->next) {
+    optimizeExpression(node);
+  }
+}
+
+static void optimizeLogical(Node* node) {
+  Node* left = node->as.binary.left;
+  Node* right = node->as.binary.right;
+  optimizeExpression(left);
+
+  if (!isLiteral(left)) {
+    optimizeExpression(right);
+    return;
+  }
+
+  // A constant left operand decides which operand is the result.
+  bool isFalsey = isFalseyConstant(left->as.literal);
+  bool isAnd = node->token.type == TOKEN_AND;
+  if (isFalsey == isAnd) {
+    replaceNode(node, left);
+  } else {
+    optimizeExpression(right);
+    replaceNode(node, right);
+  }
+}
+
+// A call of a property read, like `(a.b)()`, becomes an invoke so that
+// a method isn't bound just to be called.
+static void fuseInvoke(Node* node) {
+  Node* callee = node->as.access.object;
+  if (callee->type != NODE_GET_PROPERTY) return;
+
+  node->type = NODE_INVOKE;
+  node->token = callee->token;
+  node->as.access.object = callee->as.access.object;
+}
+
+static void optimizeExpression(Node* node) {
+  switch (node->type) {
+    case NODE_LITERAL:
+      break;
+
+    case NODE_VARIABLE: {
+      Decl* decl = node->as.variable.decl;
+      if (decl != NULL && decl->isConstant) {
+        replaceWithLiteral(node, decl->constant);
+      }
+      break;
+    }
+
+    case NODE_ASSIGN:
+      optimizeExpression(node->as.variable.value);
+      break;
+
+    case NODE_UNARY: {
+      Node* operand = node->as.binary.left;
+      optimizeExpression(operand);
+
+      Value result;
+      if (isLiteral(operand) &&
+          evaluateUnary(node->token.type, operand->as.literal,
+                        &result)) {
+        replaceWithLiteral(node, result);
+      }
+      break;
+    }
+
+    case NODE_BINARY: {
+      Node* left = node->as.binary.left;
+      Node* right = node->as.binary.right;
+      optimizeExpression(left);
+      optimizeExpression(right);
+
+      Value result;
+      if (isLiteral(left) && isLiteral(right) &&
+          evaluateBinary(node->token.type, left->as.literal,
+                         right->as.literal, &result)) {
+        replaceWithLiteral(node, result);
+      }
+      break;
+    }
+
+    case NODE_LOGICAL:
+      optimizeLogical(node);
+      break;
+
+    case NODE_CALL:
+    case NODE_GET_INDEX:
+    case NODE_GET_PROPERTY:
+    case NODE_INVOKE:
+    case NODE_LIST:
+    case NODE_SET_INDEX:
+    case NODE_SET_PROPERTY:
+    case NODE_SUPER_GET:
+    case NODE_SUPER_INVOKE:
+      if (node->as.access.object != NULL) {
+        optimizeExpression(node->as.access.object);
+      }
+      if (node->as.access.index != NULL) {
+        optimizeExpression(node->as.access.index);
+      }
+      optimizeList(node->as.access.arguments);
+      if (node->as.access.value != NULL) {
+        optimizeExpression(node->as.access.value);
+      }
+      if (node->type == NODE_CALL) fuseInvoke(node);
+      if (node->type == NODE_CALL || node->type == NODE_INVOKE) {
+        inlineCall(node);
+      }
+      break;
+
+    default:
+      break; // Unreachable.
+  }
+}
+
+// Drops statements that can never run or that do nothing. Returns the
+// new head of the list.
+static Node* optimizeBlock(Node* statements) {
+  Node* head = NULL;
+  Node* tail = NULL;
+
+  Node* statement = statements;
+  while (statement != NULL) {
+    Node* next = statement->next;
+    statement->next = NULL;
+
+    if (optimizeStatement(statement)) {
+      if (tail == NULL) {
+        head = statement;
+      } else {
+        tail->next = statement;
+      }
+      tail = statement;
+
+      // Nothing after a return is reachable.
+      if (statement->type == NODE_RETURN) break;
+    }
+
+    statement = next;
+  }
+
+  return head;
+}
+
+// Optimizes a statement that is the whole body of an if or while.
+static Node* optimizeBranch(Node* branch) {
+  if (branch == NULL || !optimizeStatement(branch)) return NULL;
+  return branch;
+}
+
+static bool optimizeIf(Node* node) {
+  optimizeExpression(node->as.branch.condition);
+
+  Node* condition = node->as.branch.condition;
+  if (isLiteral(condition)) {
+    Node* taken = isFalseyConstant(condition->as.literal)
+        ? node->as.branch.elseBranch : node->as.branch.thenBranch;
+    taken = optimizeBranch(taken);
+    if (taken == NULL) return false;
+
+    replaceNode(node, taken);
+    return true;
+  }
+
+  node->as.branch.thenBranch = optimizeBranch(node->as.branch.thenBranch);
+  node->as.branch.elseBranch = optimizeBranch(node->as.branch.elseBranch);
+  return true;
+}
+
+static bool optimizeWhile(Node* node) {
+  Node* condition = node->as.branch.condition;
+  if (condition != NULL) {
+    optimizeExpression(condition);
+    condition = node->as.branch.condition;
+
+    if (isLiteral(condition)) {
+      if (isFalseyConstant(condition->as.literal)) return false;
+      node->as.branch.condition = NULL;
+    }
+  }
+
+  node->as.branch.thenBranch = optimizeBranch(node->as.branch.thenBranch);
+  return true;
+}
+
+// Returns false if the statement can be removed.
+static bool optimizeStatement(Node* node) {
+  switch (node->type) {
+    case NODE_BLOCK:
+      node->as.statements = optimizeBlock(node->as.statements);
+      return node->as.statements != NULL;
+
+    case NODE_CLASS: {
+      if (node->as.klass.superclass != NULL) {
+        optimizeExpression(node->as.klass.superclass);
+      }
+      optimizeExpression(node->as.klass.self);
+
+      FunctionNode* method = node->as.klass.methods;
+      for (; method != NULL; method = method->next) {
+        optimizeFunction(method);
+      }
+      return true;
+    }
+
+    case NODE_EXPRESSION:
+      optimizeExpression(node->as.expression);
+      return !isLiteral(node->as.expression);
+
+    case NODE_FUNCTION:
+      optimizeFunction(node->as.function.function);
+      return true;
+
+    case NODE_IF:
+      return optimizeIf(node);
+
+    case NODE_PRINT:
+      optimizeExpression(node->as.expression);
+      return true;
+
+    case NODE_RETURN:
+      if (node->as.expression != NULL) {
+        optimizeExpression(node->as.expression);
+      }
+      return true;
+
+    case NODE_VAR: {
+      Node* initializer = node->as.variable.value;
+      optimizeExpression(initializer);
+
+      Decl* decl = node->as.variable.decl;
+      if (decl != NULL && decl->assignments == 0 &&
+          isLiteral(initializer)) {
+        decl->isConstant = true;
+        decl->constant = initializer->as.literal;
+        return false;
+      }
+      return true;
+    }
+
+    case NODE_WHILE:
+      return optimizeWhile(node);
+
+    default:
+      return true; // Unreachable.
+  }
+}
+
+static void optimizeFunction(FunctionNode* function) {
+  int enclosingBound = constantBound;
+  constantBound = 2 * countNodes(function->body);
+  function->body = optimizeBlock(function->body);
+  constantBound = enclosingBound;
+}
+
+// Capture analysis ----------------------------------------------------
+//
+// Runs after the rewrites, since a constant that was propagated into a
+// closure no longer needs to be captured. Nor does a variable that is
+// never assigned, since closures can copy it.
+
+bool isCopied(Decl* decl) {
+  return decl->assignments == 0 && !decl->isDefining;
+}
+
+static void analyzeStatements(FunctionNode* function, Node* statements);
+static void analyzeFunction(FunctionNode* function);
+
+static void analyzeNode(FunctionNode* function, Node* node) {
+  if (node == NULL) return;
+
+  switch (node->type) {
+    case NODE_LITERAL:
+      break;
+
+    case NODE_VARIABLE:
+    case NODE_ASSIGN:
+    case NODE_VAR: {
+      Decl* decl = node->as.variable.decl;
+      if (decl != NULL && decl->function != function &&
+          !isCopied(decl)) {
+        decl->isCaptured = true;
+      }
+      analyzeNode(function, node->as.variable.value);
+      break;
+    }
+
+    case NODE_UNARY:
+    case NODE_BINARY:
+    case NODE_LOGICAL:
+      analyzeNode(function, node->as.binary.left);
+      analyzeNode(function, node->as.binary.right);
+      break;
+
+    case NODE_CALL:
+    case NODE_GET_INDEX:
+    case NODE_GET_PROPERTY:
+    case NODE_INVOKE:
+    case NODE_LIST:
+    case NODE_SET_INDEX:
+    case NODE_SET_PROPERTY:
+    case NODE_SUPER_GET:
+    case NODE_SUPER_INVOKE:
+      analyzeNode(function, node->as.access.object);
+      analyzeNode(function, node->as.access.index);
+      analyzeStatements(function, node->as.access.arguments);
+      analyzeNode(function, node->as.access.value);
+      break;
+
+    case NODE_INLINE:
+      analyzeNode(function, node->as.inlined.call);
+      analyzeStatements(function, node->as.inlined.body);
+      break;
+
+    case NODE_BLOCK:
+      analyzeStatements(function, node->as.statements);
+      break;
+
+    case NODE_CLASS: {
+      analyzeNode(function, node->as.klass.superclass);
+      analyzeNode(function, node->as.klass.self);
+
+      FunctionNode* method = node->as.klass.methods;
+      for (; method != NULL; method = method->next) {
+        analyzeFunction(method);
+      }
+      break;
+    }
+
+    case NODE_EXPRESSION:
+    case NODE_PRINT:
+    case NODE_RETURN:
+      analyzeNode(function, node->as.expression);
+      break;
+
+    case NODE_FUNCTION: {
+      Decl* decl = node->as.function.decl;
+      if (decl != NULL) decl->isDefining = true;
+      analyzeFunction(node->as.function.function);
+      if (decl != NULL) decl->isDefining = false;
+      break;
+    }
+
+    case NODE_IF:
+    case NODE_WHILE:
+      analyzeNode(function, node->as.branch.condition);
+      analyzeNode(function, node->as.branch.thenBranch);
+      analyzeNode(function, node->as.branch.elseBranch);
+      break;
+  }
+}
+
+static void analyzeStatements(FunctionNode* function, Node* statements) {
+  for (Node* node = statements; node != NULL; node = node->next) {
+    analyzeNode(function, node);
+  }
+}
+
+static void analyzeFunction(FunctionNode* function) {
+  analyzeStatements(function, function->body);
+}
+
+void optimizeAst(FunctionNode* script) {
+  callees = NULL;
+  collectCallees(script->body);
+  optimizeFunction(script);
+  analyzeFunction(script);
+}
+//< Optimization omit
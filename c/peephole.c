@@ -0,0 +1,469 @@
+//> Optimization omit
+#include <stdlib.h>
+
+#include "memory.h"
+#include "object.h"
+#include "peephole.h"
+
+// Jump threading gives up after this many hops so that a cycle of
+// jumps can't hang the compiler.
+#define MAX_JUMP_HOPS 16
+
+static bool isGuard(uint8_t instruction) {
+  return instruction == OP_GUARD_CALL || instruction == OP_GUARD_INVOKE;
+}
+
+static bool isCompareJump(uint8_t instruction) {
+  return instruction >= OP_JUMP_IF_NOT_LESS &&
+         instruction <= OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT;
+}
+
+// Guards and the _CONSTANT compare jumps have a constant after the
+// offset.
+static bool hasJumpConstant(uint8_t instruction) {
+  return isGuard(instruction) ||
+         (instruction >= OP_JUMP_IF_NOT_LESS_CONSTANT &&
+          instruction <= OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT);
+}
+
+static bool isFarJump(uint8_t instruction) {
+  return instruction == OP_JUMP_FAR ||
+         instruction == OP_JUMP_IF_FALSE_FAR || instruction == OP_LOOP_FAR;
+}
+
+static bool isJump(uint8_t instruction) {
+  return instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE ||
+         instruction == OP_JUMP_IF_TRUE || instruction == OP_LOOP ||
+         isGuard(instruction) || isCompareJump(instruction);
+}
+
+// Where a jump is measured from.
+static int jumpOrigin(uint8_t* code, int offset) {
+  return offset + (hasJumpConstant(code[offset]) ? 4 : 3);
+}
+
+static int jumpTarget(uint8_t* code, int offset) {
+  int jump = (code[offset + 1] << 8) | code[offset + 2];
+  int origin = jumpOrigin(code, offset);
+  return code[offset] == OP_LOOP ? origin - jump : origin + jump;
+}
+
+// Unconditional jumps turn into OP_LOOP and back as needed.
+static void setJumpTarget(uint8_t* code, int offset, int target) {
+  int jump = target - jumpOrigin(code, offset);
+  if (jump < 0) {
+    code[offset] = OP_LOOP;
+    jump = -jump;
+  } else if (code[offset] == OP_LOOP) {
+    code[offset] = OP_JUMP;
+  }
+
+  code[offset + 1] = (jump >> 8) & 0xff;
+  code[offset + 2] = jump & 0xff;
+}
+
+// Whether a jump at [offset] can be encoded to land on [target]. Only
+// unconditional jumps can go backwards.
+static bool canJumpTo(uint8_t* code, int offset, int target) {
+  int jump = target - jumpOrigin(code, offset);
+  uint8_t instruction = code[offset];
+  if (instruction != OP_JUMP && instruction != OP_LOOP && jump < 0) {
+    return false;
+  }
+  return jump >= -UINT16_MAX && jump <= UINT16_MAX;
+}
+
+// If the jump at [offset] lands on another jump that is sure to be
+// taken too, aims it straight at the final destination.
+static void threadJump(uint8_t* code, int offset) {
+  uint8_t instruction = code[offset];
+  int target = jumpTarget(code, offset);
+
+  for (int hops = 0; hops < MAX_JUMP_HOPS; hops++) {
+    uint8_t next = code[target];
+
+    // An unconditional jump is always taken. A conditional jump is
+    // taken if it tests the same untouched value as the one before it.
+    bool taken = next == OP_JUMP || next == OP_LOOP ||
+                 (next == instruction &&
+                  (instruction == OP_JUMP_IF_FALSE ||
+                   instruction == OP_JUMP_IF_TRUE));
+    if (!taken) break;
+
+    int forwarded = jumpTarget(code, target);
+    if (forwarded == target || !canJumpTo(code, offset, forwarded)) break;
+    target = forwarded;
+  }
+
+  setJumpTarget(code, offset, target);
+}
+
+// If the comparison at [offset] only decides a branch, returns the jump
+// that does both. That's when it is followed by an OP_JUMP_IF_FALSE
+// whose paths each start by popping the result. Returns -1 otherwise.
+static int fusedCompareJump(uint8_t* code, int count, bool* isTarget,
+                            int offset, bool hasConstant) {
+  int fused;
+  switch (code[offset]) {
+    case OP_LESS:
+      fused = hasConstant ? OP_JUMP_IF_NOT_LESS_CONSTANT
+                          : OP_JUMP_IF_NOT_LESS;
+      break;
+    case OP_LESS_EQUAL:
+      fused = hasConstant ? OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT
+                          : OP_JUMP_IF_NOT_LESS_EQUAL;
+      break;
+    case OP_GREATER:
+      fused = hasConstant ? OP_JUMP_IF_NOT_GREATER_CONSTANT
+                          : OP_JUMP_IF_NOT_GREATER;
+      break;
+    case OP_GREATER_EQUAL:
+      fused = hasConstant ? OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT
+                          : OP_JUMP_IF_NOT_GREATER_EQUAL;
+      break;
+    default:
+      return -1;
+  }
+
+  int jump = offset + 1;
+  if (jump + 3 >= count || isTarget[jump] || isTarget[jump + 3] ||
+      code[jump] != OP_JUMP_IF_FALSE || code[jump + 3] != OP_POP) {
+    return -1;
+  }
+
+  // The fused jump starts a few bytes earlier, so it needs some room.
+  int target = jumpTarget(code, jump);
+  if (code[target] != OP_POP || target - jump > UINT16_MAX - 8) return -1;
+  return fused;
+}
+
+static bool endsFlow(uint8_t instruction) {
+  return instruction == OP_RETURN || instruction == OP_RETURN_NIL ||
+         instruction == OP_JUMP || instruction == OP_LOOP;
+}
+
+// Marks the start of every instruction that can be reached from the
+// beginning of the chunk.
+static void findReachable(Chunk* chunk, bool* reachable) {
+  int* worklist = ALLOCATE(int, chunk->count);
+  int pending = 0;
+  worklist[pending++] = 0;
+  reachable[0] = true;
+
+  while (pending > 0) {
+    int offset = worklist[--pending];
+    uint8_t instruction = chunk->code[offset];
+
+    int successors[2];
+    int successorCount = 0;
+    if (!endsFlow(instruction)) {
+      successors[successorCount++] =
+          offset + instructionLength(chunk, offset);
+    }
+    if (isJump(instruction)) {
+      successors[successorCount++] = jumpTarget(chunk->code, offset);
+    }
+
+    for (int i = 0; i < successorCount; i++) {
+      int successor = successors[i];
+      if (successor >= chunk->count || reachable[successor]) continue;
+      reachable[successor] = true;
+      worklist[pending++] = successor;
+    }
+  }
+
+  FREE_ARRAY(int, worklist, chunk->count);
+}
+
+// Whether [instruction] can report a runtime error, which needs the
+// line it came from.
+static bool canFail(uint8_t instruction) {
+  switch (instruction) {
+    case OP_GREATER:
+    case OP_LESS:
+    case OP_GREATER_EQUAL:
+    case OP_LESS_EQUAL:
+    case OP_ADD:
+    case OP_SUBTRACT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// If the instructions starting at [offset] are those of a
+// superinstruction, returns the longest such and sets [*length] to how
+// many bytes they take. Returns -1 otherwise. They can't be split by a
+// jump target. The instructions in it that can fail must come from the
+// same line, which it takes as [*line], so that runtime errors still
+// report the right one.
+static int matchSuperinstruction(Chunk* chunk, bool* isTarget,
+                                 int offset, int* length, int* line) {
+  int best = -1;
+  int bestCount = 0;
+  int bestLine = *line;
+  for (int i = 0; i < superinstructionCount; i++) {
+    const Superinstruction* super = &superinstructions[i];
+    if (super->count <= bestCount) continue;
+
+    int end = offset;
+    int failLine = -1;
+    int part = 0;
+    for (; part < super->count; part++) {
+      if (end >= chunk->count || chunk->code[end] != super->parts[part] ||
+          (part > 0 && isTarget[end])) {
+        break;
+      }
+
+      if (canFail(chunk->code[end])) {
+        int partLine = getLine(chunk, end);
+        if (failLine != -1 && partLine != failLine) break;
+        failLine = partLine;
+      }
+      end += instructionLength(chunk, end);
+    }
+
+    if (part == super->count) {
+      best = FIRST_SUPERINSTRUCTION + i;
+      bestCount = super->count;
+      bestLine = failLine != -1 ? failLine : *line;
+      *length = end - offset;
+    }
+  }
+
+  *line = bestLine;
+  return best;
+}
+
+// Replaces the hottest sequences of simple instructions with the
+// superinstructions generated from a profile of the benchmarks. Runs
+// after the other rewrites, since it fuses some of their results.
+static void fuseSuperinstructions(Chunk* chunk) {
+#ifdef DEBUG_PROFILE_OPCODES
+  // The profiling build counts the instructions superinstructions are
+  // made of, so it leaves them apart.
+  return;
+#endif
+
+  int count = chunk->count;
+  bool* isTarget = ALLOCATE(bool, count);
+  for (int i = 0; i < count; i++) isTarget[i] = false;
+
+  for (int offset = 0; offset < count;
+       offset += instructionLength(chunk, offset)) {
+    if (!isJump(chunk->code[offset])) continue;
+    int target = jumpTarget(chunk->code, offset);
+    if (target < count) isTarget[target] = true;
+  }
+
+  // As before, jumps are patched once every instruction has moved.
+  Chunk output;
+  initChunk(&output);
+  output.code = ALLOCATE(uint8_t, count);
+  output.capacity = count;
+  int* newOffsets = ALLOCATE(int, count + 1);
+  int* jumps = ALLOCATE(int, count);
+  int* oldTargets = ALLOCATE(int, count);
+  int jumpCount = 0;
+
+  uint8_t* code = chunk->code;
+  int length;
+  for (int offset = 0; offset < count; offset += length) {
+    length = instructionLength(chunk, offset);
+    int line = getLine(chunk, offset);
+    newOffsets[offset] = output.count;
+
+    int super = matchSuperinstruction(chunk, isTarget, offset, &length,
+                                      &line);
+    if (super != -1) {
+      // The operands stay as they are, with the opcodes between them
+      // dropped.
+      writeChunk(&output, (uint8_t)super, line);
+      int part = offset;
+      while (part < offset + length) {
+        int partLength = instructionLength(chunk, part);
+        for (int i = 1; i < partLength; i++) {
+          writeChunk(&output, code[part + i], line);
+        }
+        part += partLength;
+      }
+      continue;
+    }
+
+    if (isJump(code[offset])) {
+      jumps[jumpCount] = output.count;
+      oldTargets[jumpCount++] = jumpTarget(code, offset);
+    }
+    for (int i = 0; i < length; i++) {
+      writeChunk(&output, code[offset + i], line);
+    }
+  }
+  newOffsets[count] = output.count;
+
+  for (int i = 0; i < jumpCount; i++) {
+    setJumpTarget(output.code, jumps[i], newOffsets[oldTargets[i]]);
+  }
+
+  FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+  FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
+  chunk->code = output.code;
+  chunk->count = output.count;
+  chunk->capacity = output.capacity;
+  chunk->lines = output.lines;
+  chunk->lineCount = output.lineCount;
+  chunk->lineCapacity = output.lineCapacity;
+
+  FREE_ARRAY(bool, isTarget, count);
+  FREE_ARRAY(int, newOffsets, count + 1);
+  FREE_ARRAY(int, jumps, count);
+  FREE_ARRAY(int, oldTargets, count);
+}
+
+void optimizeChunk(Chunk* chunk) {
+  int count = chunk->count;
+  if (count == 0) return;
+
+  // Far jumps are only in chunks too big for this to be worth the
+  // time, so it doesn't handle them.
+  for (int offset = 0; offset < count;
+       offset += instructionLength(chunk, offset)) {
+    if (isFarJump(chunk->code[offset])) return;
+  }
+
+  for (int offset = 0; offset < count;
+       offset += instructionLength(chunk, offset)) {
+    if (isJump(chunk->code[offset])) threadJump(chunk->code, offset);
+  }
+
+  bool* reachable = ALLOCATE(bool, count);
+  bool* isTarget = ALLOCATE(bool, count);
+  for (int i = 0; i < count; i++) {
+    reachable[i] = false;
+    isTarget[i] = false;
+  }
+
+  findReachable(chunk, reachable);
+  for (int offset = 0; offset < count;
+       offset += instructionLength(chunk, offset)) {
+    if (!reachable[offset] || !isJump(chunk->code[offset])) continue;
+    int target = jumpTarget(chunk->code, offset);
+    if (target < count) isTarget[target] = true;
+
+    // A fused compare jump skips the pop there.
+    if (chunk->code[offset] == OP_JUMP_IF_FALSE && target + 1 < count &&
+        chunk->code[target] == OP_POP) {
+      isTarget[target + 1] = true;
+    }
+  }
+
+  // The rewritten code is never longer than the original. Jumps are
+  // emitted with their old targets and patched once every instruction
+  // has its new offset.
+  Chunk output;
+  initChunk(&output);
+  output.code = ALLOCATE(uint8_t, count);
+  output.capacity = count;
+  int* newOffsets = ALLOCATE(int, count + 1);
+  int* jumps = ALLOCATE(int, count);
+  int* oldTargets = ALLOCATE(int, count);
+  int jumpCount = 0;
+
+  uint8_t* code = chunk->code;
+  int run = 0;
+  int length;
+  for (int offset = 0; offset < count; offset += length) {
+    length = instructionLength(chunk, offset);
+    if (!reachable[offset]) continue;
+
+    uint8_t instruction = code[offset];
+    while (run + 1 < chunk->lineCount &&
+           chunk->lines[run + 1].offset <= offset) {
+      run++;
+    }
+    int line = chunk->lines[run].line;
+    newOffsets[offset] = output.count;
+
+    // A pair can only be fused if nothing jumps between the two.
+    int next = offset + length;
+    bool canFuse = next < count && !isTarget[next];
+
+    // A comparison of two values on the stack, or of one with a
+    // constant, that decides a branch.
+    int compareJump = fusedCompareJump(code, count, isTarget, offset,
+                                       false);
+    int constantCompareJump = -1;
+    if (canFuse && instruction == OP_CONSTANT) {
+      constantCompareJump = fusedCompareJump(code, count, isTarget, next,
+                                             true);
+    }
+
+    if (compareJump != -1 || constantCompareJump != -1) {
+      // Both paths popped the comparison's result. The fused jump
+      // leaves nothing to pop, so it skips the one at the target.
+      int jump = constantCompareJump != -1 ? next + 1 : next;
+      jumps[jumpCount] = output.count;
+      oldTargets[jumpCount++] = jumpTarget(code, jump) + 1;
+      writeChunk(&output, constantCompareJump != -1 ? constantCompareJump
+                                                    : compareJump, line);
+      writeChunk(&output, 0xff, line);
+      writeChunk(&output, 0xff, line);
+      if (constantCompareJump != -1) {
+        writeChunk(&output, code[offset + 1], line);
+      }
+      length = jump + 4 - offset;
+    } else if (canFuse && instruction == OP_SET_LOCAL &&
+               code[next] == OP_POP) {
+      // An assignment used as a statement.
+      writeChunk(&output, OP_SET_LOCAL_POP, line);
+      writeChunk(&output, code[offset + 1], line);
+      length++;
+    } else if (canFuse && instruction == OP_NIL &&
+               code[next] == OP_RETURN) {
+      writeChunk(&output, OP_RETURN_NIL, line);
+      length++;
+    } else if (canFuse && instruction == OP_NOT &&
+               code[next] == OP_JUMP_IF_FALSE && next + 3 < count &&
+               code[next + 3] == OP_POP &&
+               code[jumpTarget(code, next)] == OP_POP) {
+      // The jump leaves the negated value on the stack, so only drop
+      // the negation when both paths discard it right away.
+      jumps[jumpCount] = output.count;
+      oldTargets[jumpCount++] = jumpTarget(code, next);
+      writeChunk(&output, OP_JUMP_IF_TRUE, line);
+      writeChunk(&output, 0xff, line);
+      writeChunk(&output, 0xff, line);
+      length += 3;
+    } else {
+      if (isJump(instruction)) {
+        jumps[jumpCount] = output.count;
+        oldTargets[jumpCount++] = jumpTarget(code, offset);
+      }
+
+      for (int i = 0; i < length; i++) {
+        writeChunk(&output, code[offset + i], line);
+      }
+    }
+  }
+  newOffsets[count] = output.count;
+
+  for (int i = 0; i < jumpCount; i++) {
+    setJumpTarget(output.code, jumps[i], newOffsets[oldTargets[i]]);
+  }
+
+  FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+  FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
+  chunk->code = output.code;
+  chunk->count = output.count;
+  chunk->capacity = output.capacity;
+  chunk->lines = output.lines;
+  chunk->lineCount = output.lineCount;
+  chunk->lineCapacity = output.lineCapacity;
+
+  FREE_ARRAY(bool, reachable, count);
+  FREE_ARRAY(bool, isTarget, count);
+  FREE_ARRAY(int, newOffsets, count + 1);
+  FREE_ARRAY(int, jumps, count);
+  FREE_ARRAY(int, oldTargets, count);
+  fuseSuperinstructions(chunk);
+}
+//< Optimization omit
@@ -0,0 +1,14 @@
+//> Optimization omit
+#ifndef clox_peephole_h
+#define clox_peephole_h
+
+#include "chunk.h"
+
+// Rewrites the finished bytecode in [chunk] into an equivalent but
+// shorter form: it fuses common instruction pairs, threads chains of
+// jumps, drops code that can never run, and packs the hottest runs of
+// simple instructions into superinstructions.
+void optimizeChunk(Chunk* chunk);
+
+#endif
+//< Optimization omit
@@ -0,0 +1,80 @@
+//> Optimization omit
+#include <stdio.h>
+
+#include "profile.h"
+
+// Enough for every sequence the benchmarks run, with room to spare.
+#define PROFILE_CAPACITY (1 << 18)
+
+// A sequence of two or three opcodes, packed with its length in the
+// top byte so that no key is zero.
+typedef struct {
+  uint32_t key;
+  uint64_t count;
+} SequenceCount;
+
+static SequenceCount counts[PROFILE_CAPACITY];
+
+// The two instructions that ran last, newest in the low byte, and how
+// many of them there are.
+static uint32_t history = 0;
+static int historyLength = 0;
+
+static void countSequence(uint32_t key) {
+  uint32_t index = (key * 2654435761u) & (PROFILE_CAPACITY - 1);
+  for (int probes = 0; probes < PROFILE_CAPACITY; probes++) {
+    SequenceCount* entry = &counts[index];
+    if (entry->key == key || entry->key == 0) {
+      entry->key = key;
+      entry->count++;
+      return;
+    }
+    index = (index + 1) & (PROFILE_CAPACITY - 1);
+  }
+}
+
+// Sequences are counted across jumps, calls and returns too. Only
+// instructions that never transfer control are fused, and those always
+// run in the order they appear in the code, so the generator simply
+// ignores every sequence containing one that does.
+void profileInstruction(uint8_t instruction) {
+  if (historyLength >= 1) {
+    countSequence((2u << 24) | ((history & 0xff) << 8) | instruction);
+  }
+  if (historyLength >= 2) {
+    countSequence((3u << 24) | ((history & 0xffff) << 8) | instruction);
+  }
+
+  history = (history << 8) | instruction;
+  if (historyLength < 2) historyLength++;
+}
+
+void writeProfile(const char* path) {
+  FILE* file = fopen(path, "a");
+  if (file == NULL) {
+    fprintf(stderr, "Could not write profile to \"%s\".\n", path);
+    return;
+  }
+
+  for (int i = 0; i < PROFILE_CAPACITY; i++) {
+    SequenceCount* entry = &counts[i];
+    if (entry->key == 0) continue;
+
+    int length = (int)(entry->key >> 24);
+    fprintf(file, "%llu", (unsigned long long)entry->count);
+    for (int shift = (length - 1) * 8; shift >= 0; shift -= 8) {
+      fprintf(file, " %d", (int)((entry->key >> shift) & 0xff));
+    }
+    fprintf(file, "\n");
+
+    entry->key = 0;
+    entry->count = 0;
+  }
+
+  // Ends the counts for this run.
+  fprintf(file, "\n");
+  fclose(file);
+  history = 0;
+  historyLength = 0;
+}
+//< Optimization omit
@@ -0,0 +1,20 @@
+//> Optimization omit
+#ifndef clox_profile_h
+#define clox_profile_h
+
+#include "common.h"
+
+// Only used when the VM is built with DEBUG_PROFILE_OPCODES, to find
+// the sequences of instructions worth fusing into superinstructions.
+// See tool/bin/superinstructions.dart.
+
+// Counts [instruction] as following the ones that ran right before it.
+void profileInstruction(uint8_t instruction);
+
+// Appends how often each pair and triple of instructions ran back to
+// back to the file at [path], one "<count> <opcode>..." line each and
+// then an empty line, and resets the counts.
+void writeProfile(const char* path);
+
+#endif
+//< Optimization omit
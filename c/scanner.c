@@ -4,6 +4,13 @@
 
 #include "common.h"
 #include "scanner.h"
+//> Optimization omit
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define HAS_SSE2_RUNS
+#include <emmintrin.h>
+#endif
+//< Optimization omit
 
 typedef struct {
   const char* start;
@@ -19,6 +26,21 @@ void initScanner(const char* source) {
   scanner.line = 1;
 }
 //< init-scanner
+//> Optimization omit
+ScannerState saveScanner() {
+  ScannerState state;
+  state.start = scanner.start;
+  state.current = scanner.current;
+  state.line = scanner.line;
+  return state;
+}
+
+void restoreScanner(ScannerState state) {
+  scanner.start = state.start;
+  scanner.current = state.current;
+  scanner.line = state.line;
+}
+//< Optimization omit
 //> is-alpha
 static bool isAlpha(char c) {
   return (c >= 'a' && c <= 'z') ||
@@ -36,6 +58,132 @@ static bool isAtEnd() {
   return *scanner.current == '\0';
 }
 //< is-at-end
+//> Optimization omit
+// Classes of characters the scanner skips over in bulk. Each run ends
+// at the first character outside the class, which is always the case
+// for the terminating '\0'.
+typedef enum {
+  RUN_BLANK,      // Spaces, tabs, carriage returns and newlines.
+  RUN_COMMENT,    // Anything but a newline.
+  RUN_STRING,     // Anything but a closing quote.
+  RUN_IDENTIFIER  // Letters, digits and underscores.
+} RunKind;
+
+static bool endsRun(char c, RunKind kind) {
+  switch (kind) {
+    case RUN_BLANK:
+      return c != ' ' && c != '\t' && c != '\r' && c != '\n';
+    case RUN_COMMENT: return c == '\n' || c == '\0';
+    case RUN_STRING: return c == '"' || c == '\0';
+    case RUN_IDENTIFIER:
+      return !isAlpha(c) && !isDigit(c);
+  }
+
+  return true; // Unreachable.
+}
+
+// How many characters of a run are tested one at a time before
+// switching to testing a block at a time. Most identifiers and blanks
+// end before that, and are cheaper to scan without the setup.
+#define SHORT_RUN 8
+
+#ifdef HAS_SSE2_RUNS
+// A bit for each of the 16 characters in [chars] that ends a [kind]
+// run.
+static inline unsigned runEnds(__m128i chars, RunKind kind) {
+  __m128i end = _mm_cmpeq_epi8(chars, _mm_setzero_si128());
+  switch (kind) {
+    case RUN_BLANK: {
+      __m128i blank = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                       _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))),
+          _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')),
+                       _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'))));
+      return ~_mm_movemask_epi8(blank) & 0xffff;
+    }
+
+    case RUN_COMMENT:
+      end = _mm_or_si128(end, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+      return _mm_movemask_epi8(end);
+
+    case RUN_STRING:
+      end = _mm_or_si128(end, _mm_cmpeq_epi8(chars, _mm_set1_epi8('"')));
+      return _mm_movemask_epi8(end);
+
+    case RUN_IDENTIFIER: {
+      // Setting bit 5 folds upper case letters onto lower case ones.
+      // Bytes above 0x7f are negative, so they fail both ranges.
+      __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+      __m128i letter = _mm_and_si128(
+          _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+          _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+      __m128i digit = _mm_and_si128(
+          _mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+          _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+      __m128i word = _mm_or_si128(
+          _mm_or_si128(letter, digit),
+          _mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+      return ~_mm_movemask_epi8(word) & 0xffff;
+    }
+  }
+
+  return 0xffff; // Unreachable.
+}
+
+// Tests 16 characters at a time with aligned loads, which may read
+// past the terminator but never into the next page. That is invisible
+// to the program, but not to the address sanitizer.
+__attribute__((no_sanitize_address))
+static const char* skipLongRun(const char* start, RunKind kind,
+                               int* lines) {
+  int offset = (int)((uintptr_t)start & 15);
+  const __m128i* block = (const __m128i*)(start - offset);
+  // The characters in the first block before [start].
+  unsigned before = (1u << offset) - 1;
+
+  for (;;) {
+    __m128i chars = _mm_load_si128(block);
+    unsigned ends = runEnds(chars, kind) & ~before;
+    unsigned newlines = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'))) & ~before;
+
+    if (ends != 0) {
+      int end = __builtin_ctz(ends);
+      newlines &= (1u << end) - 1;
+      if (newlines != 0) *lines += __builtin_popcount(newlines);
+      return (const char*)block + end;
+    }
+
+    if (newlines != 0) *lines += __builtin_popcount(newlines);
+    before = 0;
+    block++;
+  }
+}
+#else
+static const char* skipLongRun(const char* start, RunKind kind,
+                               int* lines) {
+  while (!endsRun(*start, kind)) {
+    if (*start == '\n') (*lines)++;
+    start++;
+  }
+
+  return start;
+}
+#endif
+
+// Returns the end of the [kind] run starting at [start], adding the
+// newlines in it to [*lines].
+static inline const char* skipRun(const char* start, RunKind kind,
+                                  int* lines) {
+  for (int i = 0; i < SHORT_RUN; i++) {
+    if (endsRun(*start, kind)) return start;
+    if (*start == '\n') (*lines)++;
+    start++;
+  }
+
+  return skipLongRun(start, kind, lines);
+}
+//< Optimization omit
 //> advance
 static char advance() {
   scanner.current++;
@@ -92,7 +240,13 @@ static void skipWhitespace() {
       case ' ':
       case '\r':
       case '\t':
+/* Scanning on Demand skip-whitespace < Optimization omit
         advance();
+*/
+//> Optimization omit
+        scanner.current = skipRun(scanner.current, RUN_BLANK,
+                                  &scanner.line);
+//< Optimization omit
         break;
 //> newline
 
@@ -106,7 +260,13 @@ static void skipWhitespace() {
       case '/':
         if (peekNext() == '/') {
           // A comment goes until the end of the line.
+/* Scanning on Demand comment < Optimization omit
           while (peek() != '\n' && !isAtEnd()) advance();
+*/
+//> Optimization omit
+          scanner.current = skipRun(scanner.current, RUN_COMMENT,
+                                    &scanner.line);
+//< Optimization omit
         } else {
           return;
         }
@@ -174,7 +334,13 @@ static TokenType identifierType() {
 //< identifier-type
 //> identifier
 static Token identifier() {
+/* Scanning on Demand identifier < Optimization omit
   while (isAlpha(peek()) || isDigit(peek())) advance();
+*/
+//> Optimization omit
+  scanner.current = skipRun(scanner.current, RUN_IDENTIFIER,
+                            &scanner.line);
+//< Optimization omit
 
   return makeToken(identifierType());
 }
@@ -196,10 +362,15 @@ static Token number() {
 //< number
 //> string
 static Token string() {
+/* Scanning on Demand string < Optimization omit
   while (peek() != '"' && !isAtEnd()) {
     if (peek() == '\n') scanner.line++;
     advance();
   }
+*/
+//> Optimization omit
+  scanner.current = skipRun(scanner.current, RUN_STRING, &scanner.line);
+//< Optimization omit
 
   if (isAtEnd()) return errorToken("Unterminated string.");
 
@@ -233,6 +404,10 @@ Token scanToken() {
     case ')': return makeToken(TOKEN_RIGHT_PAREN);
     case '{': return makeToken(TOKEN_LEFT_BRACE);
     case '}': return makeToken(TOKEN_RIGHT_BRACE);
+//> Optimization omit
+    case '[': return makeToken(TOKEN_LEFT_BRACKET);
+    case ']': return makeToken(TOKEN_RIGHT_BRACKET);
+//< Optimization omit
     case ';': return makeToken(TOKEN_SEMICOLON);
     case ',': return makeToken(TOKEN_COMMA);
     case '.': return makeToken(TOKEN_DOT);
@@ -7,6 +7,9 @@ typedef enum {
   // Single-character tokens.
   TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
   TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+//> Optimization omit
+  TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
+//< Optimization omit
   TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
   TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
 
@@ -43,5 +46,18 @@ void initScanner(const char* source);
 //> scan-token-h
 Token scanToken();
 //< scan-token-h
+//> Optimization omit
+
+// A snapshot of the scanner's position, so the compiler can look ahead
+// and then rewind.
+typedef struct {
+  const char* start;
+  const char* current;
+  int line;
+} ScannerState;
+
+ScannerState saveScanner();
+void restoreScanner(ScannerState state);
+//< Optimization omit
 
 #endif
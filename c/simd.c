@@ -0,0 +1,245 @@
+//> Optimization omit
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+// Reductions keep LANES running partial results, matching two 4-wide
+// AVX2 registers, and then combine them in a fixed order.
+#define LANES 8
+
+typedef struct {
+  double (*sum)(const double* values, int count);
+  double (*dot)(const double* a, const double* b, int count);
+  void (*scale)(double* values, int count, double factor);
+  void (*add)(double* dest, const double* source, int count);
+  double (*min)(const double* values, int count);
+  double (*max)(const double* values, int count);
+} Kernels;
+
+static double combineLanes(const double* lanes) {
+  double v0 = lanes[0] + lanes[4];
+  double v1 = lanes[1] + lanes[5];
+  double v2 = lanes[2] + lanes[6];
+  double v3 = lanes[3] + lanes[7];
+  return (v0 + v1) + (v2 + v3);
+}
+
+static double scalarSum(const double* values, int count) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] += values[i + j];
+  }
+
+  double sum = combineLanes(lanes);
+  for (; i < count; i++) sum += values[i];
+  return sum;
+}
+
+static double scalarDot(const double* a, const double* b, int count) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] += a[i + j] * b[i + j];
+  }
+
+  double sum = combineLanes(lanes);
+  for (; i < count; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+static void scalarScale(double* values, int count, double factor) {
+  for (int i = 0; i < count; i++) values[i] *= factor;
+}
+
+static void scalarAdd(double* dest, const double* source, int count) {
+  for (int i = 0; i < count; i++) dest[i] += source[i];
+}
+
+// The comparisons are written to match the operand order of the AVX2
+// min and max instructions, which matters for NaN and -0.
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static double scalarMin(const double* values, int count) {
+  double lanes[LANES];
+  for (int j = 0; j < LANES; j++) lanes[j] = values[0];
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) {
+      lanes[j] = MIN(values[i + j], lanes[j]);
+    }
+  }
+
+  for (int j = 0; j < 4; j++) lanes[j] = MIN(lanes[j], lanes[j + 4]);
+  double min = MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+  for (; i < count; i++) min = MIN(values[i], min);
+  return min;
+}
+
+static double scalarMax(const double* values, int count) {
+  double lanes[LANES];
+  for (int j = 0; j < LANES; j++) lanes[j] = values[0];
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) {
+      lanes[j] = MAX(values[i + j], lanes[j]);
+    }
+  }
+
+  for (int j = 0; j < 4; j++) lanes[j] = MAX(lanes[j], lanes[j + 4]);
+  double max = MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+  for (; i < count; i++) max = MAX(values[i], max);
+  return max;
+}
+
+static Kernels kernels = {
+  scalarSum, scalarDot, scalarScale, scalarAdd, scalarMin, scalarMax
+};
+#ifdef HAS_AVX2_KERNELS
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void storeLanes(double* lanes, __m256d low, __m256d high) {
+  _mm256_storeu_pd(lanes, low);
+  _mm256_storeu_pd(lanes + 4, high);
+}
+
+AVX2 static double avx2Sum(const double* values, int count) {
+  __m256d low = _mm256_setzero_pd();
+  __m256d high = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    low = _mm256_add_pd(low, _mm256_loadu_pd(values + i));
+    high = _mm256_add_pd(high, _mm256_loadu_pd(values + i + 4));
+  }
+
+  double lanes[LANES];
+  storeLanes(lanes, low, high);
+  double sum = combineLanes(lanes);
+  for (; i < count; i++) sum += values[i];
+  return sum;
+}
+
+AVX2 static double avx2Dot(const double* a, const double* b, int count) {
+  __m256d low = _mm256_setzero_pd();
+  __m256d high = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    // Multiply and add separately instead of fusing so the rounding
+    // matches the scalar version.
+    low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                           _mm256_loadu_pd(b + i)));
+    high = _mm256_add_pd(high,
+                         _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                       _mm256_loadu_pd(b + i + 4)));
+  }
+
+  double lanes[LANES];
+  storeLanes(lanes, low, high);
+  double sum = combineLanes(lanes);
+  for (; i < count; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+AVX2 static void avx2Scale(double* values, int count, double factor) {
+  __m256d factors = _mm256_set1_pd(factor);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm256_storeu_pd(values + i,
+        _mm256_mul_pd(_mm256_loadu_pd(values + i), factors));
+  }
+
+  for (; i < count; i++) values[i] *= factor;
+}
+
+AVX2 static void avx2Add(double* dest, const double* source, int count) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm256_storeu_pd(dest + i,
+        _mm256_add_pd(_mm256_loadu_pd(dest + i),
+                      _mm256_loadu_pd(source + i)));
+  }
+
+  for (; i < count; i++) dest[i] += source[i];
+}
+
+AVX2 static double avx2Min(const double* values, int count) {
+  __m256d low = _mm256_set1_pd(values[0]);
+  __m256d high = low;
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    low = _mm256_min_pd(_mm256_loadu_pd(values + i), low);
+    high = _mm256_min_pd(_mm256_loadu_pd(values + i + 4), high);
+  }
+
+  double lanes[LANES];
+  storeLanes(lanes, low, high);
+  for (int j = 0; j < 4; j++) lanes[j] = MIN(lanes[j], lanes[j + 4]);
+  double min = MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+  for (; i < count; i++) min = MIN(values[i], min);
+  return min;
+}
+
+AVX2 static double avx2Max(const double* values, int count) {
+  __m256d low = _mm256_set1_pd(values[0]);
+  __m256d high = low;
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    low = _mm256_max_pd(_mm256_loadu_pd(values + i), low);
+    high = _mm256_max_pd(_mm256_loadu_pd(values + i + 4), high);
+  }
+
+  double lanes[LANES];
+  storeLanes(lanes, low, high);
+  for (int j = 0; j < 4; j++) lanes[j] = MAX(lanes[j], lanes[j + 4]);
+  double max = MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+  for (; i < count; i++) max = MAX(values[i], max);
+  return max;
+}
+#endif
+
+void initSimd() {
+#ifdef HAS_AVX2_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.sum = avx2Sum;
+    kernels.dot = avx2Dot;
+    kernels.scale = avx2Scale;
+    kernels.add = avx2Add;
+    kernels.min = avx2Min;
+    kernels.max = avx2Max;
+  }
+#endif
+}
+
+double simdSum(const double* values, int count) {
+  return kernels.sum(values, count);
+}
+
+double simdDot(const double* a, const double* b, int count) {
+  return kernels.dot(a, b, count);
+}
+
+void simdScale(double* values, int count, double factor) {
+  kernels.scale(values, count, factor);
+}
+
+void simdAdd(double* dest, const double* source, int count) {
+  kernels.add(dest, source, count);
+}
+
+// The array must not be empty.
+double simdMin(const double* values, int count) {
+  return kernels.min(values, count);
+}
+
+double simdMax(const double* values, int count) {
+  return kernels.max(values, count);
+}
+//< Optimization omit
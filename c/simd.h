@@ -0,0 +1,21 @@
+//> Optimization omit
+#ifndef clox_simd_h
+#define clox_simd_h
+
+#include "common.h"
+
+// Bulk kernels over arrays of doubles. Each one has an AVX2 version and
+// a portable scalar version, chosen once at startup by initSimd(). The
+// scalar versions accumulate in the same lane order as the vector ones
+// so results don't depend on which one the CPU gets.
+void initSimd();
+
+double simdSum(const double* values, int count);
+double simdDot(const double* a, const double* b, int count);
+void simdScale(double* values, int count, double factor);
+void simdAdd(double* dest, const double* source, int count);
+double simdMin(const double* values, int count);
+double simdMax(const double* values, int count);
+
+#endif
+//< Optimization omit
@@ -0,0 +1,33 @@
+//> Optimization omit
+// Generated by tool/bin/superinstructions.dart from a profile of the
+// benchmarks. Do not edit. Run "make superinstructions" to regenerate.
+#ifndef clox_superinstructions_h
+#define clox_superinstructions_h
+
+// PAIR(name, a, b) and TRIPLE(name, a, b, c) give the name of each
+// superinstruction and the instructions it does, most dispatches saved
+// first.
+#define SUPERINSTRUCTIONS(PAIR, TRIPLE) \
+    PAIR(GET_LOCAL_CONSTANT, GET_LOCAL, CONSTANT) \
+    PAIR(CONSTANT_ADD, CONSTANT, ADD) \
+    TRIPLE(CONSTANT_ADD_SET_LOCAL_POP, CONSTANT, ADD, SET_LOCAL_POP) \
+    TRIPLE(GET_LOCAL_CONSTANT_ADD, GET_LOCAL, CONSTANT, ADD) \
+    PAIR(POP_GET_LOCAL, POP, GET_LOCAL) \
+    PAIR(GET_LOCAL_GET_LOCAL, GET_LOCAL, GET_LOCAL) \
+    TRIPLE(POP_GET_LOCAL_CONSTANT, POP, GET_LOCAL, CONSTANT) \
+    PAIR(POP_CONSTANT, POP, CONSTANT) \
+    TRIPLE(GET_LOCAL_CONSTANT_SUBTRACT, GET_LOCAL, CONSTANT, SUBTRACT) \
+    TRIPLE(POP_CONSTANT_POP, POP, CONSTANT, POP) \
+    TRIPLE(ADD_POP_CONSTANT, ADD, POP, CONSTANT) \
+    TRIPLE(CONSTANT_ADD_POP, CONSTANT, ADD, POP) \
+    TRIPLE(CONSTANT_POP_CONSTANT, CONSTANT, POP, CONSTANT) \
+    PAIR(CONSTANT_EQUAL, CONSTANT, EQUAL) \
+    TRIPLE(GET_LOCAL_GET_LOCAL_CONSTANT, GET_LOCAL, GET_LOCAL, CONSTANT) \
+    TRIPLE(GET_LOCAL_CONSTANT_EQUAL, GET_LOCAL, CONSTANT, EQUAL)
+
+// Changes along with the list, so that bytecode cached by a build with
+// other superinstructions is rejected.
+#define SUPERINSTRUCTIONS_HASH 0xdebf43b0u
+
+#endif
+//< Optimization omit
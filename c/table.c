@@ -1,4 +1,7 @@
 //> Hash Tables table-c
+//> Optimization omit
+#include <math.h>
+//< Optimization omit
 #include <stdlib.h>
 #include <string.h>
 
@@ -216,3 +219,203 @@ void markTable(Table* table) {
   }
 }
 //< Garbage Collection mark-table
+//> Optimization omit
+// Empty buckets in a ValueTable have this as their key. Tombstones also
+// have it but with a true value, like Table. NaN can't be a key, so a
+// NaN works as the marker.
+#ifdef NAN_BOXING
+#define EMPTY_KEY ((Value)QNAN)
+#define IS_EMPTY_KEY(value) ((value) == EMPTY_KEY)
+#define KEYS_EQUAL(a, b) ((a) == (b))
+#else
+#define EMPTY_KEY NUMBER_VAL(NAN)
+#define IS_EMPTY_KEY(value) \
+    (IS_NUMBER(value) && isnan(AS_NUMBER(value)))
+#define KEYS_EQUAL(a, b) valuesEqual(a, b)
+#endif
+
+// Validates that [value] can be used as a key and stores its canonical
+// form in [key]. Only numbers, strings, Booleans, and nil are hashable.
+// Numbers are compared by value, so:
+//
+// - Integral doubles in int range use the int form, making 1 and 1.0
+//   the same key.
+// - -0 is folded into 0 since they compare equal.
+// - NaN is rejected since it isn't equal to anything, including
+//   itself, so it could never be looked up again.
+//
+// Strings are already canonical: short ones are stored inline and
+// longer ones are interned.
+bool canonicalKey(Value value, Value* key) {
+  if (IS_INT(value) || IS_BOOL(value) || IS_NIL(value) ||
+      IS_ANY_STRING(value)) {
+    *key = value;
+    return true;
+  }
+
+  if (!IS_NUMBER(value)) return false;
+
+  double number = AS_NUMBER(value);
+  if (isnan(number)) return false;
+
+  if (number >= INT32_MIN && number <= INT32_MAX &&
+      number == (int32_t)number) {
+    *key = INT_VAL((int32_t)number);
+  } else {
+    *key = NUMBER_VAL(number);
+  }
+
+  return true;
+}
+
+static uint32_t hashBits(uint64_t bits) {
+  bits ^= bits >> 33;
+  bits *= 0xff51afd7ed558ccdu;
+  bits ^= bits >> 33;
+  bits *= 0xc4ceb9fe1a85ec53u;
+  bits ^= bits >> 33;
+  return (uint32_t)bits;
+}
+
+static uint32_t hashValue(Value key) {
+  if (IS_STRING(key)) return AS_STRING(key)->hash;
+
+#ifdef NAN_BOXING
+  return hashBits(key);
+#else
+  if (IS_NUMBER(key)) {
+    double number = AS_NUMBER(key);
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return hashBits(bits);
+  }
+
+  if (IS_BOOL(key)) return hashBits(AS_BOOL(key) ? 2 : 3);
+  return hashBits(1);
+#endif
+}
+
+void initValueTable(ValueTable* table) {
+  table->count = 0;
+  table->tombstones = 0;
+  table->capacity = 0;
+  table->entries = NULL;
+}
+
+void freeValueTable(ValueTable* table) {
+  FREE_ARRAY(ValueEntry, table->entries, table->capacity);
+  initValueTable(table);
+}
+
+// Mirrors findEntry().
+static ValueEntry* findValueEntry(ValueEntry* entries, int capacity,
+                                  Value key) {
+  uint32_t index = hashValue(key) & (capacity - 1);
+  ValueEntry* tombstone = NULL;
+
+  for (;;) {
+    ValueEntry* entry = &entries[index];
+
+    if (IS_EMPTY_KEY(entry->key)) {
+      if (IS_NIL(entry->value)) {
+        // Empty entry.
+        return tombstone != NULL ? tombstone : entry;
+      } else {
+        // We found a tombstone.
+        if (tombstone == NULL) tombstone = entry;
+      }
+    } else if (KEYS_EQUAL(entry->key, key)) {
+      // We found the key.
+      return entry;
+    }
+
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+bool valueTableGet(ValueTable* table, Value key, Value* value) {
+  if (table->count == 0) return false;
+
+  ValueEntry* entry = findValueEntry(table->entries, table->capacity,
+                                     key);
+  if (IS_EMPTY_KEY(entry->key)) return false;
+
+  *value = entry->value;
+  return true;
+}
+
+static void adjustValueCapacity(ValueTable* table, int capacity) {
+  ValueEntry* entries = ALLOCATE(ValueEntry, capacity);
+  for (int i = 0; i < capacity; i++) {
+    entries[i].key = EMPTY_KEY;
+    entries[i].value = NIL_VAL;
+  }
+
+  // Rehashing drops the tombstones.
+  for (int i = 0; i < table->capacity; i++) {
+    ValueEntry* entry = &table->entries[i];
+    if (IS_EMPTY_KEY(entry->key)) continue;
+
+    ValueEntry* dest = findValueEntry(entries, capacity, entry->key);
+    dest->key = entry->key;
+    dest->value = entry->value;
+  }
+
+  FREE_ARRAY(ValueEntry, table->entries, table->capacity);
+  table->tombstones = 0;
+  table->entries = entries;
+  table->capacity = capacity;
+}
+
+bool valueTableSet(ValueTable* table, Value key, Value value) {
+  if (table->count + table->tombstones + 1 >
+      table->capacity * TABLE_MAX_LOAD) {
+    // Only grow if live entries need the room. Otherwise, rebuilding
+    // at the same size is enough to clear out the tombstones.
+    int capacity = table->capacity;
+    if (table->count + 1 > capacity * TABLE_MAX_LOAD / 2) {
+      capacity = GROW_CAPACITY(capacity);
+    }
+    adjustValueCapacity(table, capacity);
+  }
+
+  ValueEntry* entry = findValueEntry(table->entries, table->capacity,
+                                     key);
+  bool isNewKey = IS_EMPTY_KEY(entry->key);
+  if (isNewKey) {
+    table->count++;
+    if (!IS_NIL(entry->value)) table->tombstones--;
+  }
+
+  entry->key = key;
+  entry->value = value;
+  return isNewKey;
+}
+
+bool valueTableDelete(ValueTable* table, Value key) {
+  if (table->count == 0) return false;
+
+  ValueEntry* entry = findValueEntry(table->entries, table->capacity,
+                                     key);
+  if (IS_EMPTY_KEY(entry->key)) return false;
+
+  // Place a tombstone in the entry.
+  entry->key = EMPTY_KEY;
+  entry->value = BOOL_VAL(true);
+  table->count--;
+  table->tombstones++;
+  return true;
+}
+
+bool valueTableIsLive(ValueEntry* entry) {
+  return !IS_EMPTY_KEY(entry->key);
+}
+
+void markValueTable(ValueTable* table) {
+  for (int i = 0; i < table->capacity; i++) {
+    ValueEntry* entry = &table->entries[i];
+    markValue(entry->key);
+    markValue(entry->value);
+  }
+}
+//< Optimization omit
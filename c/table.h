@@ -46,6 +46,31 @@ void tableRemoveWhite(Table* table);
 //> Garbage Collection mark-table-h
 void markTable(Table* table);
 //< Garbage Collection mark-table-h
+//> Optimization omit
+
+// A table keyed by arbitrary hashable Values. Keys must first be put in
+// canonical form by canonicalKey() so that equal keys are identical.
+typedef struct {
+  Value key;
+  Value value;
+} ValueEntry;
+
+typedef struct {
+  int count;
+  int tombstones;
+  int capacity;
+  ValueEntry* entries;
+} ValueTable;
+
+bool canonicalKey(Value value, Value* key);
+void initValueTable(ValueTable* table);
+void freeValueTable(ValueTable* table);
+bool valueTableGet(ValueTable* table, Value key, Value* value);
+bool valueTableSet(ValueTable* table, Value key, Value value);
+bool valueTableDelete(ValueTable* table, Value key);
+bool valueTableIsLive(ValueEntry* entry);
+void markValueTable(ValueTable* table);
+//< Optimization omit
 
 //< init-table-h
 #endif
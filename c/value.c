@@ -42,8 +42,25 @@ void printValue(Value value) {
     printf(AS_BOOL(value) ? "true" : "false");
   } else if (IS_NIL(value)) {
     printf("nil");
+//> omit
+  } else if (IS_INT(value)) {
+    // Match the "%g" formatting of the equivalent double, which
+    // switches to exponent notation at a million.
+    int32_t n = AS_INT(value);
+    if (n > -1000000 && n < 1000000) {
+      printf("%d", (int)n);
+    } else {
+      printf("%g", (double)n);
+    }
+//< omit
   } else if (IS_NUMBER(value)) {
     printf("%g", AS_NUMBER(value));
+//> omit
+  } else if (IS_SHORT_STRING(value)) {
+    char buffer[SHORT_STRING_MAX + 1];
+    int length;
+    printf("%s", stringChars(value, buffer, &length));
+//< omit
   } else if (IS_OBJ(value)) {
     printObject(value);
   }
@@ -77,10 +94,16 @@ bool valuesEqual(Value a, Value b) {
 //> Optimization values-equal
 #ifdef NAN_BOXING
 //> nan-equality
+//> omit
+  if (IS_INT(a) && IS_INT(b)) return a == b;
+//< omit
   if (IS_NUMBER(a) && IS_NUMBER(b)) {
     return AS_NUMBER(a) == AS_NUMBER(b);
   }
 //< nan-equality
+//> omit
+  // Short strings are canonical, so a bitwise comparison covers them.
+//< omit
   return a == b;
 #else
 //< Optimization values-equal
@@ -30,6 +30,20 @@ typedef struct ObjString ObjString;
 #define TAG_FALSE 2 // 10.
 #define TAG_TRUE  3 // 11.
 //< tags
+//> Optimization omit
+
+// Strings of up to SHORT_STRING_MAX bytes are stored directly in the
+// payload, one byte per octet starting at the low end. Lox strings
+// can't contain NUL bytes, so the unused octets are zero and double
+// as the terminator.
+#define TAG_SHORT_STRING ((uint64_t)1 << 49)
+#define SHORT_STRING_MAX 6
+
+// Numbers that are integers in int32 range may also be stored as an
+// int in the low 32 bits. The two forms are interchangeable: anything
+// that doesn't have an integer fast path goes through AS_NUMBER().
+#define TAG_INT          ((uint64_t)1 << 48)
+//< Optimization omit
 
 typedef uint64_t Value;
 //> is-number
@@ -40,18 +54,34 @@ typedef uint64_t Value;
 //> is-nil
 #define IS_NIL(value)       ((value) == NIL_VAL)
 //< is-nil
+/* Optimization is-number < Optimization omit
 #define IS_NUMBER(value)    (((value) & QNAN) != QNAN)
+*/
+//> Optimization omit
+#define IS_INT(value) \
+    (((value) & (SIGN_BIT | QNAN | TAG_SHORT_STRING | TAG_INT)) == \
+        (QNAN | TAG_INT))
+#define IS_NUMBER(value)    ((((value) & QNAN) != QNAN) || IS_INT(value))
+//< Optimization omit
 //< is-number
 //> is-obj
 #define IS_OBJ(value) \
     (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
 //< is-obj
+//> Optimization omit
+#define IS_SHORT_STRING(value) \
+    (((value) & (SIGN_BIT | QNAN | TAG_SHORT_STRING)) == \
+        (QNAN | TAG_SHORT_STRING))
+//< Optimization omit
 //> as-number
 
 //> as-bool
 #define AS_BOOL(value)      ((value) == TRUE_VAL)
 //< as-bool
 #define AS_NUMBER(value)    valueToNum(value)
+//> Optimization omit
+#define AS_INT(value)       ((int32_t)(uint32_t)(value))
+//< Optimization omit
 //< as-number
 //> as-obj
 #define AS_OBJ(value) \
@@ -70,6 +100,10 @@ typedef uint64_t Value;
 #define NIL_VAL         ((Value)(uint64_t)(QNAN | TAG_NIL))
 //< nil-val
 #define NUMBER_VAL(num) numToValue(num)
+//> Optimization omit
+#define INT_VAL(i) \
+    ((Value)(uint64_t)(QNAN | TAG_INT | (uint32_t)(int32_t)(i)))
+//< Optimization omit
 //< number-val
 //> obj-val
 #define OBJ_VAL(obj) \
@@ -78,6 +112,10 @@ typedef uint64_t Value;
 //> value-to-num
 
 static inline double valueToNum(Value value) {
+//> omit
+  if (IS_INT(value)) return AS_INT(value);
+
+//< omit
   double num;
   memcpy(&num, &value, sizeof(Value));
   return num;
@@ -91,6 +129,17 @@ static inline Value numToValue(double num) {
   return value;
 }
 //< num-to-value
+//> Optimization omit
+
+static inline int shortStringLength(Value value) {
+  int length = 0;
+  while (length < SHORT_STRING_MAX &&
+         ((value >> (length * 8)) & 0xff) != 0) {
+    length++;
+  }
+  return length;
+}
+//< Optimization omit
 
 #else
 
@@ -129,6 +178,13 @@ typedef struct {
 //> Strings is-obj
 #define IS_OBJ(value)     ((value).type == VAL_OBJ)
 //< Strings is-obj
+//> Optimization omit
+#define SHORT_STRING_MAX 0
+#define IS_SHORT_STRING(value) false
+#define IS_INT(value) false
+#define AS_INT(value) ((int32_t)AS_NUMBER(value))
+#define INT_VAL(i) NUMBER_VAL(i)
+//< Optimization omit
 //< Types of Values is-macros
 //> Types of Values as-macros
 
@@ -151,6 +207,15 @@ typedef struct {
 
 #endif
 //< Optimization end-if-nan-boxing
+//> Optimization omit
+
+// Wraps the result of integer arithmetic, falling back to a double
+// when it no longer fits in an int.
+static inline Value int64ToValue(int64_t n) {
+  if (n >= INT32_MIN && n <= INT32_MAX) return INT_VAL((int32_t)n);
+  return NUMBER_VAL((double)n);
+}
+//< Optimization omit
 //> value-array
 
 typedef struct {
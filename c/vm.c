@@ -23,13 +23,28 @@
 #include "object.h"
 #include "memory.h"
 //< Strings vm-include-object-memory
+//> Optimization omit
+#include "cache.h"
+#include "decode.h"
+#include "natives.h"
+#include "profile.h"
+#include "simd.h"
+//< Optimization omit
 #include "vm.h"
 
 VM vm; // [one]
 //> Calls and Functions clock-native
+/* Calls and Functions clock-native < Optimization omit
 static Value clockNative(int argCount, Value* args) {
   return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
 }
+*/
+//> Optimization omit
+static bool clockNative(int argCount, Value* args) {
+  args[-1] = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+  return true;
+}
+//< Optimization omit
 //< Calls and Functions clock-native
 //> reset-stack
 static void resetStack() {
@@ -42,6 +57,36 @@ static void resetStack() {
 //< Closures init-open-upvalues
 }
 //< reset-stack
+//> Optimization omit
+// The inlined body of a call has no frame of its own. Walks the code
+// between [start] and [end] for the guard of an inlined call whose body
+// holds the byte at [instruction], and prints a line for that callee,
+// innermost first. Returns the line to report for the frame itself.
+static int printInlinedCalls(Chunk* chunk, int start, int end,
+                             int instruction) {
+  uint8_t* code = chunk->code;
+  for (int offset = start; offset < end && offset <= instruction;
+       offset += instructionLength(chunk, offset)) {
+    if (code[offset] != OP_GUARD_CALL &&
+        code[offset] != OP_GUARD_INVOKE) {
+      continue;
+    }
+
+    // The body runs from the guard up to the original call.
+    int body = offset + 4;
+    int call = body + ((code[offset + 1] << 8) | code[offset + 2]);
+    if (instruction < body || instruction >= call) continue;
+
+    ObjFunction* callee =
+        AS_FUNCTION(chunk->constants.values[code[offset + 3]]);
+    int line = printInlinedCalls(chunk, body, call, instruction);
+    fprintf(stderr, "[line %d] in %s()\n", line, callee->name->chars);
+    return getLine(chunk, offset);
+  }
+
+  return getLine(chunk, instruction);
+}
+//< Optimization omit
 //> Types of Values runtime-error
 static void runtimeError(const char* format, ...) {
   va_list args;
@@ -73,9 +118,21 @@ static void runtimeError(const char* format, ...) {
 //< Closures runtime-error-function
     // -1 because the IP is sitting on the next instruction to be
     // executed.
+/* Calls and Functions runtime-error-stack < Optimization omit
     size_t instruction = frame->ip - function->chunk.code - 1;
+*/
+//> Optimization omit
+    Chunk* chunk = &function->chunk;
+    size_t instruction = chunk->wordOffsets[frame->ip - chunk->words - 1];
+//< Optimization omit
+/* Calls and Functions runtime-error-stack < Optimization omit
     fprintf(stderr, "[line %d] in ",
             function->chunk.lines[instruction]);
+*/
+//> Optimization omit
+    fprintf(stderr, "[line %d] in ",
+            printInlinedCalls(chunk, 0, chunk->count, (int)instruction));
+//< Optimization omit
     if (function->name == NULL) {
       fprintf(stderr, "script\n");
     } else {
@@ -91,6 +148,9 @@ static void runtimeError(const char* format, ...) {
 static void defineNative(const char* name, NativeFn function) {
   push(OBJ_VAL(copyString(name, (int)strlen(name))));
   push(OBJ_VAL(newNative(function)));
+//> Optimization omit
+  ((ObjNative*)AS_OBJ(vm.stack[1]))->name = AS_STRING(vm.stack[0]);
+//< Optimization omit
   tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
   pop();
   pop();
@@ -104,6 +164,10 @@ void initVM() {
 //> Strings init-objects-root
   vm.objects = NULL;
 //< Strings init-objects-root
+//> Optimization omit
+  vm.freeBoundMethods = NULL;
+  vm.freeBoundMethodCount = 0;
+//< Optimization omit
 //> Garbage Collection init-gc-fields
   vm.bytesAllocated = 0;
   vm.nextGC = 1024 * 1024;
@@ -132,6 +196,27 @@ void initVM() {
 
   defineNative("clock", clockNative);
 //< Calls and Functions define-native-clock
+//> Optimization omit
+  defineNative("len", lenNative);
+  defineNative("push", pushNative);
+  defineNative("pop", popNative);
+  defineNative("insert", insertNative);
+  defineNative("sort", sortNative);
+  defineNative("Map", mapNative);
+  defineNative("mapGet", mapGetNative);
+  defineNative("mapSet", mapSetNative);
+  defineNative("mapHas", mapHasNative);
+  defineNative("mapDelete", mapDeleteNative);
+  defineNative("mapKeys", mapKeysNative);
+  defineNative("FloatArray", floatArrayNative);
+  defineNative("floatSum", floatSumNative);
+  defineNative("floatDot", floatDotNative);
+  defineNative("floatScale", floatScaleNative);
+  defineNative("floatAdd", floatAddNative);
+  defineNative("floatMin", floatMinNative);
+  defineNative("floatMax", floatMaxNative);
+  initSimd();
+//< Optimization omit
 }
 
 void freeVM() {
@@ -147,6 +232,11 @@ void freeVM() {
 //> Strings call-free-objects
   freeObjects();
 //< Strings call-free-objects
+//> Optimization omit
+#ifdef DEBUG_PROFILE_OPCODES
+  writeProfile("build/profile.txt");
+#endif
+//< Optimization omit
 }
 //> push
 void push(Value value) {
@@ -165,6 +255,19 @@ static Value peek(int distance) {
   return vm.stackTop[-1 - distance];
 }
 //< Types of Values peek
+//> Optimization omit
+// Gets [function] ready to run the first time it's called: compiles it
+// if that was put off, and decodes its code. Returns false if it
+// doesn't compile.
+static bool prepareFunction(ObjFunction* function) {
+  if (function->lazySource != NULL && !compileLazily(function)) {
+    return false;
+  }
+
+  decodeChunk(&function->chunk);
+  return true;
+}
+//< Optimization omit
 /* Calls and Functions call < Closures call-signature
 static bool call(ObjFunction* function, int argCount) {
 */
@@ -194,6 +297,22 @@ static bool call(ObjClosure* closure, int argCount) {
   }
 
 //< check-overflow
+//> Optimization omit
+  if (closure->function->chunk.words == NULL &&
+      !prepareFunction(closure->function)) {
+    runtimeError("Could not compile '%s'.",
+                 closure->function->name->chars);
+    return false;
+  }
+
+  // A function can have more locals than a frame's share of the stack.
+  if (vm.stackTop - argCount - 1 + closure->function->slotCount >
+      vm.stack + STACK_MAX) {
+    runtimeError("Stack overflow.");
+    return false;
+  }
+
+//< Optimization omit
   CallFrame* frame = &vm.frames[vm.frameCount++];
 /* Calls and Functions call < Closures call-init-closure
   frame->function = function;
@@ -201,7 +320,12 @@ static bool call(ObjClosure* closure, int argCount) {
 */
 //> Closures call-init-closure
   frame->closure = closure;
+/* Closures call-init-closure < Optimization omit
   frame->ip = closure->function->chunk.code;
+*/
+//> Optimization omit
+  frame->ip = closure->function->chunk.words;
+//< Optimization omit
 //< Closures call-init-closure
 
   frame->slots = vm.stackTop - argCount - 1;
@@ -255,10 +379,24 @@ static bool callValue(Value callee, int argCount) {
         
       case OBJ_NATIVE: {
         NativeFn native = AS_NATIVE(callee);
+/* Calls and Functions call-native < Optimization omit
         Value result = native(argCount, vm.stackTop - argCount);
         vm.stackTop -= argCount + 1;
         push(result);
         return true;
+*/
+//> Optimization omit
+        if (native(argCount, vm.stackTop - argCount)) {
+          vm.stackTop -= argCount;
+          return true;
+        }
+
+        char buffer[SHORT_STRING_MAX + 1];
+        int length;
+        runtimeError("%s", stringChars(vm.stackTop[-argCount - 1],
+                                       buffer, &length));
+        return false;
+//< Optimization omit
       }
 //< call-native
 
@@ -308,6 +446,58 @@ static bool invoke(ObjString* name, int argCount) {
   return invokeFromClass(instance->klass, name, argCount);
 }
 //< Methods and Initializers invoke
+//> Optimization omit
+// Whether invoking [function]'s name on [receiver] would call it.
+static bool invokesMethod(Value receiver, ObjFunction* function) {
+  if (!IS_INSTANCE(receiver)) return false;
+
+  ObjInstance* instance = AS_INSTANCE(receiver);
+  Value value;
+  if (tableGet(&instance->fields, function->name, &value)) return false;
+  return tableGet(&instance->klass->methods, function->name, &value) &&
+         AS_CLOSURE(value)->function == function;
+}
+
+// The guard at [guard] in [chunk]'s words found a different callee
+// than the one whose body the compiler inlined. Turns it into a plain
+// jump to the original call, so the site doesn't check again. The
+// bytecode is patched to match, for the cache and the disassembler.
+static void deoptimize(Chunk* chunk, Word* guard) {
+  uint8_t* code = &chunk->code[chunk->wordOffsets[guard - chunk->words]];
+
+  // OP_JUMP has no constant after its offset, so it needs to jump one
+  // byte, and one word, further.
+  int jump = ((code[1] << 8) | code[2]) + 1;
+  if (jump > UINT16_MAX) return;
+
+  code[0] = OP_JUMP;
+  code[1] = (jump >> 8) & 0xff;
+  code[2] = jump & 0xff;
+  // The constant's byte is jumped over, but it has to read as an
+  // instruction to anything that walks the code.
+  code[3] = OP_NIL;
+  guard[0].value = OP_JUMP;
+  guard[1].value++;
+}
+
+// Replaces the top [itemCount] values on the stack with a list of them.
+static void buildList(int itemCount) {
+  // The items stay on the stack while the list is allocated so the GC
+  // can see them.
+  ObjList* list = newList();
+  push(OBJ_VAL(list));
+  if (itemCount > 0) {
+    list->items.values = GROW_ARRAY(Value, NULL, 0, itemCount);
+    list->items.capacity = itemCount;
+    memcpy(list->items.values, vm.stackTop - 1 - itemCount,
+           sizeof(Value) * itemCount);
+    list->items.count = itemCount;
+  }
+
+  vm.stackTop -= itemCount + 1;
+  push(OBJ_VAL(list));
+}
+//< Optimization omit
 //> Methods and Initializers bind-method
 static bool bindMethod(ObjClass* klass, ObjString* name) {
   Value method;
@@ -353,6 +543,35 @@ static ObjUpvalue* captureUpvalue(Value* local) {
   return createdUpvalue;
 }
 //< Closures capture-upvalue
+//> Optimization omit
+// Reads the next variable in the list after an OP_CLOSURE into
+// [index]. Returns whether it is a local of the enclosing function.
+static bool readCapture(CallFrame* frame, int* index) {
+  bool isLocal = (frame->ip++)->value != 0;
+  *index = (int)(frame->ip++)->value;
+  return isLocal;
+}
+
+// Fills in the variables [closure] closes over from the list after the
+// OP_CLOSURE at [frame]'s ip that created it.
+static void captureVariables(CallFrame* frame, ObjClosure* closure) {
+  for (int i = 0; i < closure->upvalueCount; i++) {
+    int index;
+    if (readCapture(frame, &index)) {
+      closure->upvalues[i] = captureUpvalue(frame->slots + index);
+    } else {
+      closure->upvalues[i] = frame->closure->upvalues[index];
+    }
+  }
+
+  for (int i = 0; i < closure->captureCount; i++) {
+    int index;
+    closure->captures[i] = readCapture(frame, &index)
+        ? frame->slots[index] : frame->closure->captures[index];
+  }
+  closure->enclosingSlots = frame->slots;
+}
+//< Optimization omit
 //> Closures close-upvalues
 static void closeUpvalues(Value* last) {
   while (vm.openUpvalues != NULL &&
@@ -372,6 +591,43 @@ static void defineMethod(ObjString* name) {
   pop();
 }
 //< Methods and Initializers define-method
+//> Optimization omit
+// Validates [index] against an indexable of [count] elements.
+static bool checkIndex(Value index, int count, int* result) {
+  if (IS_INT(index)) {
+    *result = AS_INT(index);
+    if (*result >= 0 && *result < count) return true;
+    runtimeError("Index out of bounds.");
+    return false;
+  }
+
+  if (!IS_NUMBER(index)) {
+    runtimeError("Index must be a number.");
+    return false;
+  }
+
+  double number = AS_NUMBER(index);
+  if (!(number >= 0 && number < count)) {
+    runtimeError("Index out of bounds.");
+    return false;
+  }
+
+  *result = (int)number;
+  if (*result != number) {
+    runtimeError("Index must be an integer.");
+    return false;
+  }
+
+  return true;
+}
+
+static bool checkMapKey(Value value, Value* key) {
+  if (canonicalKey(value, key)) return true;
+
+  runtimeError("Map keys must be numbers, strings, Booleans, or nil.");
+  return false;
+}
+//< Optimization omit
 //> Types of Values is-falsey
 static bool isFalsey(Value value) {
   return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
@@ -383,10 +639,11 @@ static void concatenate() {
   ObjString* b = AS_STRING(pop());
   ObjString* a = AS_STRING(pop());
 */
-//> Garbage Collection concatenate-peek
+/* Garbage Collection concatenate-peek < Optimization omit
   ObjString* b = AS_STRING(peek(0));
   ObjString* a = AS_STRING(peek(1));
-//< Garbage Collection concatenate-peek
+*/
+/* Strings concatenate < Optimization omit
 
   int length = a->length + b->length;
   char* chars = ALLOCATE(char, length + 1);
@@ -395,11 +652,41 @@ static void concatenate() {
   chars[length] = '\0';
 
   ObjString* result = takeString(chars, length);
+*/
+//> Optimization omit
+  char aBuffer[SHORT_STRING_MAX + 1];
+  char bBuffer[SHORT_STRING_MAX + 1];
+  int aLength;
+  int bLength;
+  const char* aChars = stringChars(peek(1), aBuffer, &aLength);
+  const char* bChars = stringChars(peek(0), bBuffer, &bLength);
+
+  int length = aLength + bLength;
+  Value result;
+  if (length <= SHORT_STRING_MAX) {
+    // Small results never touch the heap.
+    char chars[SHORT_STRING_MAX];
+    memcpy(chars, aChars, aLength);
+    memcpy(chars + aLength, bChars, bLength);
+    result = stringValue(chars, length);
+  } else {
+    char* chars = ALLOCATE(char, length + 1);
+    memcpy(chars, aChars, aLength);
+    memcpy(chars + aLength, bChars, bLength);
+    chars[length] = '\0';
+    result = OBJ_VAL(takeString(chars, length));
+  }
+//< Optimization omit
 //> Garbage Collection concatenate-pop
   pop();
   pop();
 //< Garbage Collection concatenate-pop
+/* Strings concatenate < Optimization omit
   push(OBJ_VAL(result));
+*/
+//> Optimization omit
+  push(result);
+//< Optimization omit
 }
 //< Strings concatenate
 //> run
@@ -417,18 +704,30 @@ static InterpretResult run() {
 #define READ_SHORT() \
     (vm.ip += 2, (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]))
 */
+/* Calls and Functions run < Optimization omit
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() \
     (frame->ip += 2, \
     (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+*/
+//> Optimization omit
+// The VM runs the decoded words, where every operand is already whole.
+#define READ_BYTE() ((frame->ip++)->value)
+#define READ_SHORT() ((frame->ip++)->value)
+//< Optimization omit
 //< Calls and Functions run
 /* Calls and Functions run < Closures read-constant
 #define READ_CONSTANT() \
     (frame->function->chunk.constants.values[READ_BYTE()])
 */
 //> Closures read-constant
+/* Closures read-constant < Optimization omit
 #define READ_CONSTANT() \
     (frame->closure->function->chunk.constants.values[READ_BYTE()])
+*/
+//> Optimization omit
+#define READ_CONSTANT() (*(frame->ip++)->constant)
+//< Optimization omit
 //< Closures read-constant
 //> Global Variables read-string
 #define READ_STRING() AS_STRING(READ_CONSTANT())
@@ -456,6 +755,84 @@ static InterpretResult run() {
       push(valueType(a op b)); \
     } while (false)
 //< Types of Values binary-op
+//> Optimization omit
+#define NUMBER_OP(intType, valueType, op) \
+    do { \
+      if (IS_INT(peek(0)) && IS_INT(peek(1))) { \
+        int64_t b = AS_INT(pop()); \
+        int64_t a = AS_INT(pop()); \
+        push(intType(a op b)); \
+      } else { \
+        BINARY_OP(valueType, op); \
+      } \
+    } while (false)
+// <= and >= are the negations of > and <, as they were when the
+// compiler emitted OP_NOT after those, so NaN compares the same way.
+#define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+// Compares the left operand, [popCount] slots down the stack, with
+// [right], pops the operands, and jumps if the result is [jumpWhen].
+#define COMPARE_JUMP(right, popCount, op, jumpWhen) \
+    do { \
+      uint16_t offset = READ_SHORT(); \
+      Value b = (right); \
+      Value a = vm.stackTop[-(popCount)]; \
+      bool result; \
+      if (IS_INT(a) && IS_INT(b)) { \
+        result = AS_INT(a) op AS_INT(b); \
+      } else if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+        result = AS_NUMBER(a) op AS_NUMBER(b); \
+      } else { \
+        runtimeError("Operands must be numbers."); \
+        return INTERPRET_RUNTIME_ERROR; \
+      } \
+      vm.stackTop -= (popCount); \
+      if (result == (jumpWhen)) frame->ip += offset; \
+    } while (false)
+// The instructions superinstructions are made of, each as one
+// statement. They do the same as their cases in the switch below.
+#define DO_CONSTANT() push(READ_CONSTANT())
+#define DO_GET_LOCAL() push(frame->slots[READ_BYTE()])
+#define DO_SET_LOCAL() (frame->slots[READ_BYTE()] = peek(0))
+#define DO_SET_LOCAL_POP() (frame->slots[READ_BYTE()] = pop())
+#define DO_GET_UPVALUE() \
+    push(*frame->closure->upvalues[READ_BYTE()]->location)
+#define DO_POP() pop()
+#define DO_EQUAL() \
+    do { \
+      Value b = pop(); \
+      Value a = pop(); \
+      push(BOOL_VAL(valuesEqual(a, b))); \
+    } while (false)
+#define DO_NOT_EQUAL() \
+    do { \
+      Value b = pop(); \
+      Value a = pop(); \
+      push(BOOL_VAL(!valuesEqual(a, b))); \
+    } while (false)
+#define DO_GREATER() NUMBER_OP(BOOL_VAL, BOOL_VAL, >)
+#define DO_LESS() NUMBER_OP(BOOL_VAL, BOOL_VAL, <)
+#define DO_GREATER_EQUAL() NUMBER_OP(NOT_BOOL_VAL, NOT_BOOL_VAL, <)
+#define DO_LESS_EQUAL() NUMBER_OP(NOT_BOOL_VAL, NOT_BOOL_VAL, >)
+#define DO_ADD() \
+    do { \
+      if (IS_INT(peek(0)) && IS_INT(peek(1))) { \
+        int64_t b = AS_INT(pop()); \
+        int64_t a = AS_INT(pop()); \
+        push(int64ToValue(a + b)); \
+      } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) { \
+        double b = AS_NUMBER(pop()); \
+        double a = AS_NUMBER(pop()); \
+        push(NUMBER_VAL(a + b)); \
+      } else if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) { \
+        concatenate(); \
+      } else { \
+        runtimeError("Operands must be two numbers or two strings."); \
+        return INTERPRET_RUNTIME_ERROR; \
+      } \
+    } while (false)
+#define DO_SUBTRACT() NUMBER_OP(int64ToValue, NUMBER_VAL, -)
+#define DO_NOT() push(BOOL_VAL(isFalsey(pop())))
+//< Optimization omit
 
   for (;;) {
 //> trace-execution
@@ -478,13 +855,25 @@ static InterpretResult run() {
         (int)(frame->ip - frame->function->chunk.code));
 */
 //> Closures disassemble-instruction
+/* Closures disassemble-instruction < Optimization omit
     disassembleInstruction(&frame->closure->function->chunk,
         (int)(frame->ip - frame->closure->function->chunk.code));
+*/
+//> Optimization omit
+    Chunk* chunk = &frame->closure->function->chunk;
+    disassembleInstruction(chunk,
+                           chunk->wordOffsets[frame->ip - chunk->words]);
+//< Optimization omit
 //< Closures disassemble-instruction
 #endif
 
 //< trace-execution
     uint8_t instruction;
+//> Optimization omit
+#ifdef DEBUG_PROFILE_OPCODES
+    profileInstruction((uint8_t)frame->ip->value);
+#endif
+//< Optimization omit
     switch (instruction = READ_BYTE()) {
 //> op-constant
       case OP_CONSTANT: {
@@ -533,6 +922,14 @@ static InterpretResult run() {
         break;
       }
 //< Local Variables interpret-set-local
+//> Optimization omit
+
+      case OP_SET_LOCAL_POP: {
+        uint8_t slot = READ_BYTE();
+        frame->slots[slot] = pop();
+        break;
+      }
+//< Optimization omit
 //> Global Variables interpret-get-global
 
       case OP_GET_GLOBAL: {
@@ -583,6 +980,20 @@ static InterpretResult run() {
         break;
       }
 //< Closures interpret-set-upvalue
+//> Optimization omit
+
+      case OP_GET_CAPTURE:
+        push(frame->closure->captures[READ_BYTE()]);
+        break;
+
+      case OP_GET_OUTER:
+        push(frame->closure->enclosingSlots[READ_BYTE()]);
+        break;
+
+      case OP_SET_OUTER:
+        frame->closure->enclosingSlots[READ_BYTE()] = peek(0);
+        break;
+//< Optimization omit
 //> Classes and Instances interpret-get-property
 
       case OP_GET_PROPERTY: {
@@ -636,6 +1047,90 @@ static InterpretResult run() {
         break;
       }
 //< Classes and Instances interpret-set-property
+//> Optimization omit
+      case OP_BUILD_LIST:
+        buildList(READ_BYTE());
+        break;
+
+      case OP_GET_INDEX: {
+        Value target = peek(1);
+        Value result;
+        if (IS_LIST(target)) {
+          ObjList* list = AS_LIST(target);
+          int index;
+          if (!checkIndex(peek(0), list->items.count, &index)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          result = list->items.values[index];
+        } else if (IS_MAP(target)) {
+          Value key;
+          if (!checkMapKey(peek(0), &key)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+
+          if (!valueTableGet(&AS_MAP(target)->table, key, &result)) {
+            runtimeError("Key not found in map.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        } else if (IS_FLOAT_ARRAY(target)) {
+          ObjFloatArray* array = AS_FLOAT_ARRAY(target);
+          int index;
+          if (!checkIndex(peek(0), array->count, &index)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          result = NUMBER_VAL(array->values[index]);
+        } else {
+          runtimeError("Only lists, maps, and float arrays can be indexed.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        vm.stackTop -= 2;
+        push(result);
+        break;
+      }
+
+      case OP_SET_INDEX: {
+        Value target = peek(2);
+        Value value = peek(0);
+        if (IS_LIST(target)) {
+          ObjList* list = AS_LIST(target);
+          int index;
+          if (!checkIndex(peek(1), list->items.count, &index)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          list->items.values[index] = value;
+        } else if (IS_MAP(target)) {
+          Value key;
+          if (!checkMapKey(peek(1), &key)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+
+          // Growing the table may trigger a GC, so the operands stay on
+          // the stack until it's done.
+          valueTableSet(&AS_MAP(target)->table, key, value);
+        } else if (IS_FLOAT_ARRAY(target)) {
+          ObjFloatArray* array = AS_FLOAT_ARRAY(target);
+          int index;
+          if (!checkIndex(peek(1), array->count, &index)) {
+            return INTERPRET_RUNTIME_ERROR;
+          }
+
+          if (!IS_NUMBER(value)) {
+            runtimeError("Float array elements must be numbers.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+          array->values[index] = AS_NUMBER(value);
+        } else {
+          runtimeError("Only lists, maps, and float arrays can be indexed.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        vm.stackTop -= 3;
+        push(value);
+        break;
+      }
+
+//< Optimization omit
 //> Superclasses interpret-get-super
 
       case OP_GET_SUPER: {
@@ -658,8 +1153,26 @@ static InterpretResult run() {
 
 //< Types of Values interpret-equal
 //> Types of Values interpret-comparison
+/* Types of Values interpret-comparison < Optimization omit
       case OP_GREATER:  BINARY_OP(BOOL_VAL, >); break;
       case OP_LESS:     BINARY_OP(BOOL_VAL, <); break;
+*/
+//> Optimization omit
+      case OP_GREATER:  NUMBER_OP(BOOL_VAL, BOOL_VAL, >); break;
+      case OP_LESS:     NUMBER_OP(BOOL_VAL, BOOL_VAL, <); break;
+      case OP_NOT_EQUAL: {
+        Value b = pop();
+        Value a = pop();
+        push(BOOL_VAL(!valuesEqual(a, b)));
+        break;
+      }
+      case OP_GREATER_EQUAL:
+        NUMBER_OP(NOT_BOOL_VAL, NOT_BOOL_VAL, <);
+        break;
+      case OP_LESS_EQUAL:
+        NUMBER_OP(NOT_BOOL_VAL, NOT_BOOL_VAL, >);
+        break;
+//< Optimization omit
 //< Types of Values interpret-comparison
 /* A Virtual Machine op-binary < Types of Values op-arithmetic
       case OP_ADD:      BINARY_OP(+); break;
@@ -675,7 +1188,21 @@ static InterpretResult run() {
 */
 //> Strings add-strings
       case OP_ADD: {
+//> Optimization omit
+        if (IS_INT(peek(0)) && IS_INT(peek(1))) {
+          int64_t b = AS_INT(pop());
+          int64_t a = AS_INT(pop());
+          push(int64ToValue(a + b));
+          break;
+        }
+
+//< Optimization omit
+/* Strings add-strings < Optimization omit
         if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+*/
+//> Optimization omit
+        if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
+//< Optimization omit
           concatenate();
         } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
           double b = AS_NUMBER(pop());
@@ -690,8 +1217,29 @@ static InterpretResult run() {
       }
 //< Strings add-strings
 //> Types of Values op-arithmetic
+/* Types of Values op-arithmetic < Optimization omit
       case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
       case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
+*/
+//> Optimization omit
+      case OP_SUBTRACT: NUMBER_OP(int64ToValue, NUMBER_VAL, -); break;
+      case OP_MULTIPLY: {
+        if (IS_INT(peek(0)) && IS_INT(peek(1))) {
+          int64_t b = AS_INT(pop());
+          int64_t a = AS_INT(pop());
+          // A zero product with a negative operand is -0, which only
+          // a double can represent.
+          if ((a * b == 0) && (a < 0 || b < 0)) {
+            push(NUMBER_VAL(-0.0));
+          } else {
+            push(int64ToValue(a * b));
+          }
+        } else {
+          BINARY_OP(NUMBER_VAL, *);
+        }
+        break;
+      }
+//< Optimization omit
       case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
 //< Types of Values op-arithmetic
 //> Types of Values op-not
@@ -706,6 +1254,14 @@ static InterpretResult run() {
           return INTERPRET_RUNTIME_ERROR;
         }
 
+//> Optimization omit
+        // Negating int zero must give -0, so leave that to doubles.
+        if (IS_INT(peek(0)) && AS_INT(peek(0)) != 0) {
+          push(int64ToValue(-(int64_t)AS_INT(pop())));
+          break;
+        }
+
+//< Optimization omit
         push(NUMBER_VAL(-AS_NUMBER(pop())));
         break;
 //< Types of Values op-negate
@@ -743,6 +1299,39 @@ static InterpretResult run() {
         break;
       }
 //< Jumping Back and Forth op-jump-if-false
+//> Optimization omit
+
+      case OP_JUMP_IF_TRUE: {
+        uint16_t offset = READ_SHORT();
+        if (!isFalsey(peek(0))) frame->ip += offset;
+        break;
+      }
+
+      case OP_JUMP_IF_NOT_LESS:
+        COMPARE_JUMP(peek(0), 2, <, false);
+        break;
+      case OP_JUMP_IF_NOT_LESS_EQUAL:
+        COMPARE_JUMP(peek(0), 2, >, true);
+        break;
+      case OP_JUMP_IF_NOT_GREATER:
+        COMPARE_JUMP(peek(0), 2, >, false);
+        break;
+      case OP_JUMP_IF_NOT_GREATER_EQUAL:
+        COMPARE_JUMP(peek(0), 2, <, true);
+        break;
+      case OP_JUMP_IF_NOT_LESS_CONSTANT:
+        COMPARE_JUMP(READ_CONSTANT(), 1, <, false);
+        break;
+      case OP_JUMP_IF_NOT_LESS_EQUAL_CONSTANT:
+        COMPARE_JUMP(READ_CONSTANT(), 1, >, true);
+        break;
+      case OP_JUMP_IF_NOT_GREATER_CONSTANT:
+        COMPARE_JUMP(READ_CONSTANT(), 1, >, false);
+        break;
+      case OP_JUMP_IF_NOT_GREATER_EQUAL_CONSTANT:
+        COMPARE_JUMP(READ_CONSTANT(), 1, <, true);
+        break;
+//< Optimization omit
 //> Jumping Back and Forth op-loop
 
       case OP_LOOP: {
@@ -756,6 +1345,21 @@ static InterpretResult run() {
         break;
       }
 //< Jumping Back and Forth op-loop
+//> Optimization omit
+
+      case OP_JUMP_FAR:
+      case OP_JUMP_IF_FALSE_FAR:
+      case OP_LOOP_FAR: {
+        // Decoding already looked up the offset.
+        int offset = (int)READ_SHORT();
+        if (instruction == OP_LOOP_FAR) {
+          frame->ip -= offset;
+        } else if (instruction == OP_JUMP_FAR || isFalsey(peek(0))) {
+          frame->ip += offset;
+        }
+        break;
+      }
+//< Optimization omit
 //> Calls and Functions interpret-call
 
       case OP_CALL: {
@@ -781,6 +1385,28 @@ static InterpretResult run() {
         break;
       }
       
+//> Optimization omit
+      case OP_GUARD_CALL:
+      case OP_GUARD_INVOKE: {
+        Word* guard = frame->ip - 1;
+        uint16_t offset = READ_SHORT();
+        ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+        Value callee = peek(0);
+        bool matches = guard->value == OP_GUARD_CALL
+            ? IS_CLOSURE(callee) && AS_CLOSURE(callee)->function == function
+            : invokesMethod(callee, function);
+
+        if (matches) {
+          // The inlined body doesn't need the callee.
+          pop();
+        } else {
+          deoptimize(&frame->closure->function->chunk, guard);
+          frame->ip += offset;
+        }
+        break;
+      }
+
+//< Optimization omit
 //< Methods and Initializers interpret-invoke
 //> Superclasses interpret-super-invoke
       case OP_SUPER_INVOKE: {
@@ -801,6 +1427,7 @@ static InterpretResult run() {
         ObjClosure* closure = newClosure(function);
         push(OBJ_VAL(closure));
 //> interpret-capture-upvalues
+/* Closures interpret-capture-upvalues < Optimization omit
         for (int i = 0; i < closure->upvalueCount; i++) {
           uint8_t isLocal = READ_BYTE();
           uint8_t index = READ_BYTE();
@@ -811,6 +1438,10 @@ static InterpretResult run() {
             closure->upvalues[i] = frame->closure->upvalues[index];
           }
         }
+*/
+//> Optimization omit
+        captureVariables(frame, closure);
+//< Optimization omit
 //< interpret-capture-upvalues
         break;
       }
@@ -823,6 +1454,11 @@ static InterpretResult run() {
         break;
 
 //< Closures interpret-close-upvalue
+//> Optimization omit
+      case OP_RETURN_NIL:
+        push(NIL_VAL);
+        // Fall through.
+//< Optimization omit
       case OP_RETURN: {
 /* A Virtual Machine print-return < Global Variables op-return
         printValue(pop());
@@ -884,6 +1520,153 @@ static InterpretResult run() {
         defineMethod(READ_STRING());
         break;
 //< Methods and Initializers interpret-method
+//> Optimization omit
+
+#define PAIR(name, a, b) \
+      case OP_##name: DO_##a(); DO_##b(); break;
+#define TRIPLE(name, a, b, c) \
+      case OP_##name: DO_##a(); DO_##b(); DO_##c(); break;
+      SUPERINSTRUCTIONS(PAIR, TRIPLE)
+#undef PAIR
+#undef TRIPLE
+
+      case OP_WIDE: {
+        // The next instruction's first operand takes two bytes. Only
+        // the rare instructions whose operand doesn't fit in one are
+        // handled here, so the common ones stay as fast as they were.
+        instruction = READ_BYTE();
+        int operand = READ_SHORT();
+        Value* constants = frame->closure->function->chunk.constants.values;
+        switch (instruction) {
+          case OP_CONSTANT: push(constants[operand]); break;
+          case OP_GET_LOCAL: push(frame->slots[operand]); break;
+          case OP_SET_LOCAL: frame->slots[operand] = peek(0); break;
+
+          case OP_GET_GLOBAL: {
+            Value value;
+            if (!tableGet(&vm.globals, AS_STRING(constants[operand]), &value)) {
+              runtimeError("Undefined variable '%s'.",
+                           AS_CSTRING(constants[operand]));
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            push(value);
+            break;
+          }
+
+          case OP_DEFINE_GLOBAL:
+            tableSet(&vm.globals, AS_STRING(constants[operand]), peek(0));
+            pop();
+            break;
+
+          case OP_SET_GLOBAL:
+            if (tableSet(&vm.globals, AS_STRING(constants[operand]), peek(0))) {
+              tableDelete(&vm.globals, AS_STRING(constants[operand]));
+              runtimeError("Undefined variable '%s'.",
+                           AS_CSTRING(constants[operand]));
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+
+          case OP_GET_UPVALUE:
+            push(*frame->closure->upvalues[operand]->location);
+            break;
+
+          case OP_SET_UPVALUE:
+            *frame->closure->upvalues[operand]->location = peek(0);
+            break;
+
+          case OP_GET_CAPTURE:
+            push(frame->closure->captures[operand]);
+            break;
+
+          case OP_GET_OUTER:
+            push(frame->closure->enclosingSlots[operand]);
+            break;
+
+          case OP_SET_OUTER:
+            frame->closure->enclosingSlots[operand] = peek(0);
+            break;
+
+          case OP_BUILD_LIST:
+            buildList(operand);
+            break;
+
+          case OP_GET_PROPERTY: {
+            if (!IS_INSTANCE(peek(0))) {
+              runtimeError("Only instances have properties.");
+              return INTERPRET_RUNTIME_ERROR;
+            }
+
+            ObjInstance* instance = AS_INSTANCE(peek(0));
+            ObjString* name = AS_STRING(constants[operand]);
+            Value value;
+            if (tableGet(&instance->fields, name, &value)) {
+              pop(); // Instance.
+              push(value);
+            } else if (!bindMethod(instance->klass, name)) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+          }
+
+          case OP_SET_PROPERTY: {
+            if (!IS_INSTANCE(peek(1))) {
+              runtimeError("Only instances have fields.");
+              return INTERPRET_RUNTIME_ERROR;
+            }
+
+            ObjInstance* instance = AS_INSTANCE(peek(1));
+            tableSet(&instance->fields, AS_STRING(constants[operand]), peek(0));
+            Value value = pop();
+            pop();
+            push(value);
+            break;
+          }
+
+          case OP_GET_SUPER:
+            if (!bindMethod(AS_CLASS(pop()), AS_STRING(constants[operand]))) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+
+          case OP_INVOKE: {
+            int argCount = READ_BYTE();
+            if (!invoke(AS_STRING(constants[operand]), argCount)) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            frame = &vm.frames[vm.frameCount - 1];
+            break;
+          }
+
+          case OP_SUPER_INVOKE: {
+            int argCount = READ_BYTE();
+            ObjClass* superclass = AS_CLASS(pop());
+            if (!invokeFromClass(superclass, AS_STRING(constants[operand]),
+                                 argCount)) {
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            frame = &vm.frames[vm.frameCount - 1];
+            break;
+          }
+
+          case OP_CLOSURE: {
+            ObjClosure* closure = newClosure(AS_FUNCTION(constants[operand]));
+            push(OBJ_VAL(closure));
+            captureVariables(frame, closure);
+            break;
+          }
+
+          case OP_CLASS:
+            push(OBJ_VAL(newClass(AS_STRING(constants[operand]))));
+            break;
+
+          case OP_METHOD:
+            defineMethod(AS_STRING(constants[operand]));
+            break;
+        }
+        break;
+      }
+//< Optimization omit
     }
   }
 
@@ -954,7 +1737,12 @@ InterpretResult interpret(const char* source) {
   ObjClosure* closure = newClosure(function);
   pop();
   push(OBJ_VAL(closure));
+/* Closures interpret < Optimization omit
   call(closure, 0);
+*/
+//> Optimization omit
+  if (!call(closure, 0)) return INTERPRET_RUNTIME_ERROR;
+//< Optimization omit
 //< Closures interpret
 //< Scanning on Demand vm-interpret-c
 //> Compiling Expressions interpret-chunk
@@ -971,3 +1759,26 @@ InterpretResult interpret(const char* source) {
 //< Compiling Expressions interpret-chunk
 }
 //< interpret
+//> Optimization omit
+static InterpretResult runScript(ObjFunction* function) {
+  push(OBJ_VAL(function));
+  ObjClosure* closure = newClosure(function);
+  pop();
+  push(OBJ_VAL(closure));
+  if (!call(closure, 0)) return INTERPRET_RUNTIME_ERROR;
+  return run();
+}
+
+// Like interpret(), but reuses the bytecode cached for the script at
+// [path] if it was compiled from the same source, and caches it if not.
+InterpretResult interpretCached(const char* path, const char* source) {
+  ObjFunction* function = loadCache(path, source);
+  if (function == NULL) {
+    function = compile(source);
+    if (function == NULL) return INTERPRET_COMPILE_ERROR;
+    writeCache(path, source, function);
+  }
+
+  return runScript(function);
+}
+//< Optimization omit
@@ -33,7 +33,12 @@ typedef struct {
 //> Closures call-frame-closure
   ObjClosure* closure;
 //< Closures call-frame-closure
+/* Calls and Functions call-frame < Optimization omit
   uint8_t* ip;
+*/
+//> Optimization omit
+  Word* ip;
+//< Optimization omit
   Value* slots;
 } CallFrame;
 //< Calls and Functions call-frame
@@ -75,6 +80,12 @@ typedef struct {
 
   Obj* objects;
 //< Strings objects-root
+//> Optimization omit
+  // Bound methods the collector freed, linked through their `next`
+  // fields, for newBoundMethod() to reuse.
+  Obj* freeBoundMethods;
+  int freeBoundMethodCount;
+//< Optimization omit
 //> Garbage Collection vm-gray-stack
   int grayCount;
   int grayCapacity;
@@ -102,6 +113,9 @@ InterpretResult interpret(Chunk* chunk);
 //> Scanning on Demand vm-interpret-h
 InterpretResult interpret(const char* source);
 //< Scanning on Demand vm-interpret-h
+//> Optimization omit
+InterpretResult interpretCached(const char* path, const char* source);
+//< Optimization omit
 //> push-pop
 void push(Value value);
 Value pop();
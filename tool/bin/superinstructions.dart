@@ -0,0 +1,207 @@
+import 'dart:io';
+
+/// Generates c/superinstructions.h from a profile of which instructions
+/// clox ran back to back. Run it with "make superinstructions", which
+/// builds a profiling clox, runs the benchmarks, and passes their profile
+/// here.
+
+/// The instructions a superinstruction can be made of. None of them jump
+/// and each has at most a one-byte operand. Each one needs a DO_ macro in
+/// vm.c and its operand handled in superinstructionLength() in chunk.c
+/// and superInstruction() in debug.c.
+const fusable = {
+  "OP_CONSTANT",
+  "OP_GET_LOCAL",
+  "OP_SET_LOCAL",
+  "OP_SET_LOCAL_POP",
+  "OP_GET_UPVALUE",
+  "OP_POP",
+  "OP_EQUAL",
+  "OP_NOT_EQUAL",
+  "OP_GREATER",
+  "OP_LESS",
+  "OP_GREATER_EQUAL",
+  "OP_LESS_EQUAL",
+  "OP_ADD",
+  "OP_SUBTRACT",
+  "OP_NOT",
+};
+
+/// Opcodes are bytes, and the other instructions already take a good
+/// number of them.
+const maxSuperinstructions = 16;
+
+/// A superinstruction that would save fewer than this fraction of the
+/// dispatches, averaged over the benchmarks, isn't worth an opcode.
+const minSavings = 0.002;
+
+void main(List<String> arguments) {
+  if (arguments.length != 3) {
+    print("Usage: superinstructions.dart <profile> <chunk.h> <output>");
+    exit(1);
+  }
+
+  var opcodes = readOpcodes(arguments[1]);
+
+  // Each benchmark counts as much as the others, however long it runs, so
+  // every sequence is weighed by the share of its run's instructions.
+  var shares = <String, double>{};
+  var runs = 0;
+  var runCounts = <String, int>{};
+  var runTotal = 0;
+
+  for (var line in File(arguments[0]).readAsLinesSync()) {
+    if (line.isEmpty) {
+      runCounts.forEach((key, count) {
+        shares[key] = (shares[key] ?? 0.0) + count / runTotal;
+      });
+      runs++;
+      runCounts.clear();
+      runTotal = 0;
+      continue;
+    }
+
+    var fields = line.split(" ");
+    var count = int.parse(fields[0]);
+    var numbers = fields.skip(1).map(int.parse).toList();
+
+    // Every instruction starts a pair with the one after it, so the pairs
+    // add up to about how many instructions ran.
+    if (numbers.length == 2) runTotal += count;
+
+    if (numbers.any((number) => number >= opcodes.length)) continue;
+    var names = numbers.map((number) => opcodes[number]).toList();
+    if (!names.every(fusable.contains)) continue;
+
+    var key = names.join(" ");
+    runCounts[key] = (runCounts[key] ?? 0) + count;
+  }
+
+  shares.updateAll((key, share) => share / runs);
+  var chosen = chooseSequences(shares);
+  File(arguments[2]).writeAsStringSync(generateHeader(chosen));
+  print("Wrote ${chosen.length} superinstructions to ${arguments[2]}.");
+}
+
+/// Reads the names of the opcodes, in order, from the OpCode enum in
+/// chunk.h, skipping the book's code that is commented out.
+List<String> readOpcodes(String path) {
+  var opcodes = <String>[];
+  var opcodePattern = RegExp(r"^\s*(OP_\w+),?\s*$");
+  var inEnum = false;
+  var inComment = false;
+
+  for (var line in File(path).readAsLinesSync()) {
+    if (line.startsWith("typedef enum {")) {
+      inEnum = true;
+    } else if (line.startsWith("} OpCode;")) {
+      break;
+    } else if (!inEnum) {
+      continue;
+    } else if (inComment) {
+      if (line.startsWith("*/")) inComment = false;
+    } else if (line.startsWith("/*")) {
+      inComment = true;
+    } else {
+      var match = opcodePattern.firstMatch(line);
+      if (match != null) opcodes.add(match[1]);
+    }
+  }
+
+  return opcodes;
+}
+
+/// A sequence picked to become a superinstruction.
+class Sequence {
+  final List<String> parts;
+
+  /// How often it ran, as a share of all instructions.
+  final double share;
+
+  Sequence(this.parts, this.share);
+
+  /// The share of dispatches it saves.
+  double get savings => share * (parts.length - 1);
+
+  String get name =>
+      parts.map((part) => part.substring("OP_".length)).join("_");
+}
+
+/// Greedily picks the sequences that save the most dispatches.
+List<Sequence> chooseSequences(Map<String, double> shares) {
+  var remaining = Map.of(shares);
+  var chosen = <Sequence>[];
+
+  while (chosen.length < maxSuperinstructions && remaining.isNotEmpty) {
+    Sequence best;
+    for (var key in remaining.keys) {
+      var sequence = Sequence(key.split(" "), remaining[key]);
+      if (best == null || sequence.savings > best.savings) best = sequence;
+    }
+
+    if (best.savings < minSavings) break;
+    chosen.add(best);
+
+    var parts = best.parts;
+    remaining.remove(parts.join(" "));
+
+    // Where the triple runs, the compiler fuses all three, so the pairs
+    // inside it are left to run only that much less often.
+    if (parts.length == 3) {
+      for (var pair in [parts.sublist(0, 2), parts.sublist(1)]) {
+        var key = pair.join(" ");
+        if (remaining.containsKey(key)) remaining[key] -= best.share;
+      }
+    }
+  }
+
+  return chosen;
+}
+
+String generateHeader(List<Sequence> chosen) {
+  var buffer = StringBuffer();
+  buffer.writeln("//> Optimization omit");
+  buffer.writeln("// Generated by tool/bin/superinstructions.dart from a "
+      "profile of the");
+  buffer.writeln("// benchmarks. Do not edit. Run \"make superinstructions\" "
+      "to regenerate.");
+  buffer.writeln("#ifndef clox_superinstructions_h");
+  buffer.writeln("#define clox_superinstructions_h");
+  buffer.writeln();
+  buffer.writeln("// PAIR(name, a, b) and TRIPLE(name, a, b, c) give the "
+      "name of each");
+  buffer.writeln("// superinstruction and the instructions it does, most "
+      "dispatches saved");
+  buffer.writeln("// first.");
+  buffer.writeln("#define SUPERINSTRUCTIONS(PAIR, TRIPLE) \\");
+
+  for (var i = 0; i < chosen.length; i++) {
+    var sequence = chosen[i];
+    var parts = sequence.parts.map((part) => part.substring("OP_".length));
+    var macro = sequence.parts.length == 2 ? "PAIR" : "TRIPLE";
+    var end = i < chosen.length - 1 ? " \\" : "";
+    buffer.writeln("    $macro(${sequence.name}, ${parts.join(", ")})$end");
+  }
+
+  buffer.writeln();
+  buffer.writeln("// Changes along with the list, so that bytecode cached "
+      "by a build with");
+  buffer.writeln("// other superinstructions is rejected.");
+  var hash = fnv1a(chosen.map((sequence) => sequence.name).join(" "));
+  buffer.writeln("#define SUPERINSTRUCTIONS_HASH "
+      "0x${hash.toRadixString(16).padLeft(8, "0")}u");
+  buffer.writeln();
+  buffer.writeln("#endif");
+  buffer.writeln("//< Optimization omit");
+  return buffer.toString();
+}
+
+/// The 32-bit FNV-1a hash of [text].
+int fnv1a(String text) {
+  var hash = 2166136261;
+  for (var byte in text.codeUnits) {
+    hash ^= byte;
+    hash = (hash * 16777619) & 0xffffffff;
+  }
+  return hash;
+}